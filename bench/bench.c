@@ -0,0 +1,1128 @@
+#include <time.h>
+#include <pthread.h>
+#include "parser.h"
+#include "ast.h"
+#include "codegen.h"
+#include "eval.h"
+#include "fold.h"
+#include "scan.h"
+#include "pool.h"
+#include "module.h"
+#include "build.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BenchCycles() __rdtsc()
+#else
+#define BenchCycles() 0ULL
+#endif
+
+// Micro-benchmarks for the hot paths of the compiler.
+// Build with `make bench` and run `./bench/bench [name...]`; with no arguments
+// every benchmark is run.
+
+typedef struct {
+	const char *name;
+	void (*run)(void);
+} Bench;
+
+static double BenchNow(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Keeps the optimizer from discarding the measured work
+static volatile unsigned long benchSink;
+
+// Keyword recognition: the old strcmp chains against the span lookup
+static void BenchKeywords(void) {
+	static const char *words[] = {
+		"counter", "return", "buffer", "x", "int", "length", "value", "index",
+		"while", "node", "result", "unsigned", "tmp", "state", "if", "offset",
+		"compiletime", "data", "struct", "i", "left", "right", "constexpr", "size",
+		"generic", "ptr", "token", "default", "matrix", "alpha", "else", "count"
+	};
+	const int wordCount = sizeof(words) / sizeof(words[0]);
+	const int rounds = 200000;
+	char scratch[64];
+	double start, oldTime, newTime;
+	int i, j;
+
+	// Both paths must agree before timing them
+	for (i = 0; i < wordCount; i++) {
+		TokenType expected = TokenIsKeyword(words[i]) ? TokenTypeParseString(words[i]) : TOK_ID;
+		if (TokenKeywordLookup(words[i], strlen(words[i])) != expected) {
+			fprintf(stderr, "keywords: lookup mismatch for \"%s\"\n", words[i]);
+			exit(1);
+		}
+	}
+
+	start = BenchNow();
+	for (j = 0; j < rounds; j++) {
+		for (i = 0; i < wordCount; i++) {
+			size_t len = strlen(words[i]);
+			memcpy(scratch, words[i], len);
+			scratch[len] = '\0';
+			benchSink += TokenIsKeyword(scratch) ? TokenTypeParseString(scratch) : TOK_ID;
+		}
+	}
+	oldTime = BenchNow() - start;
+
+	start = BenchNow();
+	for (j = 0; j < rounds; j++) {
+		for (i = 0; i < wordCount; i++) {
+			benchSink += TokenKeywordLookup(words[i], strlen(words[i]));
+		}
+	}
+	newTime = BenchNow() - start;
+
+	double lookups = (double) rounds * wordCount;
+	printf("keywords: strcmp chains %.2f ns/word, span lookup %.2f ns/word (%.1fx)\n",
+	       oldTime * 1e9 / lookups, newTime * 1e9 / lookups, oldTime / newTime);
+}
+
+// Source text where most bytes are comments and indentation, like our
+// generated modules with license headers and doc blocks
+static char *BenchCommentedSource(size_t target, size_t *length) {
+	static const char *pieces[] = {
+		"// Licensed under the GPL, see LICENSE for the full text of the license.\n",
+		"/*\n * Generated accessor, do not edit by hand.\n *\n * Returns the value stored in the slot.\n */\n",
+		"\t\t\t\tint value = counter + 42;\n",
+		"        \n\n        // aligned trailing comment\n",
+		"\tfloat ratio = 1.5f; /* inline note */ return ratio;\n"
+	};
+	const int pieceCount = sizeof(pieces) / sizeof(pieces[0]);
+	char *source = (char *) malloc(target + 256);
+	size_t used = 0;
+	int i = 0;
+	while (used < target) {
+		size_t len = strlen(pieces[i]);
+		memcpy(source + used, pieces[i], len);
+		used += len;
+		i = (i + 1) % pieceCount;
+	}
+	source[used] = '\0';
+	*length = used;
+	return source;
+}
+static int BenchLex(char *source, size_t length, TokenBuffer *tokens) {
+	CompilerState state;
+	InitCompiler(&state, stderr);
+	CompilerSetSource(&state, source, length);
+	tokens->count = 0;
+	char *input = source;
+	int line = 1;
+	int column = 1;
+	Token token;
+	while (1) {
+		token = GetNextToken(&state, &input, &line, &column);
+		if (token.type == TOK_EOF || token.type == TOK_ERROR) break;
+		TokenBufferPush(tokens, token);
+	}
+	FreeCompiler(&state);
+	return tokens->count;
+}
+static bool BenchSameTokens(TokenBuffer *a, TokenBuffer *b) {
+	if (a->count != b->count) return false;
+	return memcmp(a->type, b->type, a->count) == 0
+		&& memcmp(a->offset, b->offset, a->count * sizeof(int)) == 0
+		&& memcmp(a->line, b->line, a->count * sizeof(int)) == 0
+		&& memcmp(a->column, b->column, a->count * sizeof(int)) == 0
+		&& memcmp(a->value, b->value, a->count * sizeof(TokenValue)) == 0;
+}
+
+// Whitespace and comment skipping with each scanner implementation
+static void BenchComments(void) {
+	static const ScanImplementation implementations[] = { SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 };
+	size_t length;
+	char *source = BenchCommentedSource(8 << 20, &length);
+	TokenBuffer reference, tokens;
+	TokenBufferInit(&reference, source, 1 << 20);
+	TokenBufferInit(&tokens, source, 1 << 20);
+	const int rounds = 5;
+	int i, j;
+
+	ScanSetImplementation(SCAN_SCALAR);
+	BenchLex(source, length, &reference);
+	for (i = 0; i < 3; i++) {
+		ScanImplementation used = ScanSetImplementation(implementations[i]);
+		if (used != implementations[i]) {
+			printf("comments: %s not supported on this CPU\n", ScanImplementationName(implementations[i]));
+			continue;
+		}
+		BenchLex(source, length, &tokens);
+		if (!BenchSameTokens(&reference, &tokens)) {
+			fprintf(stderr, "comments: %s tokens differ from scalar\n", ScanImplementationName(used));
+			exit(1);
+		}
+		double best = 0;
+		unsigned long long bestCycles = 0;
+		for (j = 0; j < rounds; j++) {
+			double start = BenchNow();
+			unsigned long long cycles = BenchCycles();
+			BenchLex(source, length, &tokens);
+			cycles = BenchCycles() - cycles;
+			double elapsed = BenchNow() - start;
+			if (j == 0 || elapsed < best) {
+				best = elapsed;
+				bestCycles = cycles;
+			}
+		}
+		printf("comments: %-6s %7.1f MB/s, %.3f bytes/cycle (%d tokens in %zu bytes)\n",
+		       ScanImplementationName(used), length / best / 1e6,
+		       bestCycles ? (double) length / bestCycles : 0.0, tokens.count, length);
+	}
+	ScanSetImplementation(SCAN_AUTO);
+	TokenBufferFree(&reference);
+	TokenBufferFree(&tokens);
+	free(source);
+}
+
+typedef struct {
+	char *source;
+	size_t length;
+	int tokens;
+	double elapsed;
+} BenchCommentRun;
+
+static void *BenchCommentLinesThread(void *argument) {
+	BenchCommentRun *run = (BenchCommentRun *) argument;
+	TokenBuffer tokens;
+	TokenBufferInit(&tokens, run->source, 16);
+	double start = BenchNow();
+	run->tokens = BenchLex(run->source, run->length, &tokens);
+	run->elapsed = BenchNow() - start;
+	TokenBufferFree(&tokens);
+	return NULL;
+}
+
+// Long runs of consecutive comment lines, lexed on a thread with a 64 KiB
+// stack: time must grow linearly with the line count and the stack must not
+static void BenchCommentLines(void) {
+	static const char *lines[] = { "// license header line\n", "/* generated doc block */\n" };
+	const int counts[] = { 250000, 500000, 1000000 };
+	int i, j;
+
+	for (i = 0; i < 3; i++) {
+		size_t length = 0;
+		char *source = (char *) malloc((size_t) counts[i] * 32 + 16);
+		for (j = 0; j < counts[i]; j++) {
+			size_t len = strlen(lines[j & 1]);
+			memcpy(source + length, lines[j & 1], len);
+			length += len;
+		}
+		length += (size_t) sprintf(source + length, "x;");
+
+		BenchCommentRun run = { source, length, 0, 0 };
+		pthread_attr_t attributes;
+		pthread_t thread;
+		pthread_attr_init(&attributes);
+		pthread_attr_setstacksize(&attributes, 64 * 1024);
+		if (pthread_create(&thread, &attributes, BenchCommentLinesThread, &run) != 0) {
+			fprintf(stderr, "comment-lines: could not start the lexer thread\n");
+			exit(1);
+		}
+		pthread_join(thread, NULL);
+		pthread_attr_destroy(&attributes);
+
+		if (run.tokens != 2) {
+			fprintf(stderr, "comment-lines: expected 2 tokens after the comments, got %d\n", run.tokens);
+			exit(1);
+		}
+		printf("comment-lines: %7d lines in %6.2f ms, %.1f ns/line\n", counts[i], run.elapsed * 1e3, run.elapsed * 1e9 / counts[i]);
+		free(source);
+	}
+}
+
+// Source whose block comments and strings are laid out so that many line
+// starts are inside a comment, to exercise the parallel lexer's resync path
+static char *BenchTrickySource(size_t target, size_t *length) {
+	static const char *pieces[] = {
+		"int counter = 0x1F + 0b101 * 3.5e2;\n",
+		"/* a comment whose lines\nint look = \"like code\";\nand never start with a star\n*/\n",
+		"string s = \"/* not a comment */\"; char c = '\\'';\n",
+		"\t// line comment with /* inside\n",
+		"x <<= y >>= z => w; a->b.c != ~d;\n",
+		"/*\n\n\n*/ float f = .5f; /**/\n"
+	};
+	const int pieceCount = sizeof(pieces) / sizeof(pieces[0]);
+	char *source = (char *) malloc(target + 256);
+	size_t used = 0;
+	unsigned int seed = 12345;
+	while (used < target) {
+		seed = seed * 1103515245u + 12345u;
+		const char *piece = pieces[(seed >> 16) % pieceCount];
+		size_t len = strlen(piece);
+		memcpy(source + used, piece, len);
+		used += len;
+	}
+	source[used] = '\0';
+	*length = used;
+	return source;
+}
+
+// Numeric literals decoded by the lexer, checked against the C library and
+// timed against reparsing each literal's text after lexing
+static void BenchLiterals(void) {
+	const int count = 400000;
+	char *source = (char *) malloc((size_t) count * 48 + 1);
+	size_t length = 0;
+	unsigned int seed = 4242;
+	int i;
+	for (i = 0; i < count; i++) {
+		seed = seed * 1103515245u + 12345u;
+		unsigned int r = seed >> 8;
+		switch (i % 6) {
+			case 0: length += (size_t) sprintf(source + length, "%u ", r); break;
+			case 1: length += (size_t) sprintf(source + length, "0x%XULL ", r * 2654435761u); break;
+			case 2: length += (size_t) sprintf(source + length, "%u.%03ue%d ", r % 100000, r % 1000, (int) (r % 61) - 30); break;
+			case 3: length += (size_t) sprintf(source + length, "%.17g ", (double) r / 7.0 + 0.5); break;
+			case 4: length += (size_t) sprintf(source + length, "%u.%uf ", r % 1000, r % 997); break;
+			default: length += (size_t) sprintf(source + length, "0x%X.%Xp%d ", r % 4096, r % 16, (int) (r % 41) - 20); break;
+		}
+	}
+
+	TokenBuffer tokens;
+	TokenBufferInit(&tokens, source, count);
+	double start = BenchNow();
+	BenchLex(source, length, &tokens);
+	double decoded = BenchNow() - start;
+	if (tokens.count != count) {
+		fprintf(stderr, "literals: lexed %d of %d literals\n", tokens.count, count);
+		exit(1);
+	}
+
+	// The same work again, plus the C library reparsing every literal
+	int mismatches = 0;
+	start = BenchNow();
+	BenchLex(source, length, &tokens);
+	for (i = 0; i < tokens.count; i++) {
+		const char *text = source + tokens.offset[i];
+		TokenType type = (TokenType) tokens.type[i];
+		if (type == TOK_FLOATLIT) mismatches += (float) tokens.value[i].real != strtof(text, NULL);
+		else if (type == TOK_DOUBLELIT) mismatches += tokens.value[i].real != strtod(text, NULL);
+		else mismatches += tokens.value[i].integer != strtoull(text, NULL, 0);
+	}
+	double reparsed = BenchNow() - start;
+	if (mismatches) {
+		fprintf(stderr, "literals: %d values differ from the C library\n", mismatches);
+		exit(1);
+	}
+	printf("literals: %d decoded while lexing in %.2f ms, lexing and reparsing with strto* %.2f ms\n",
+	       count, decoded * 1e3, reparsed * 1e3);
+	TokenBufferFree(&tokens);
+	free(source);
+}
+
+// Parallel lexing must give exactly the sequential token stream
+static void BenchParallelLex(void) {
+	static const int chunkCounts[] = { 2, 3, 4, 7, 16, 64 };
+	size_t length;
+	char *source = BenchTrickySource(16 << 20, &length);
+	CompilerState state;
+	TokenBuffer reference, tokens;
+	ThreadPool pool;
+	int threads = PoolDefaultThreads();
+	int i;
+
+	if (!PoolInit(&pool, threads < 4 ? 4 : threads)) {
+		fprintf(stderr, "parallel-lex: could not start the thread pool\n");
+		exit(1);
+	}
+	InitCompiler(&state, stderr);
+	CompilerSetSource(&state, source, length);
+	TokenBufferInit(&reference, source, 1 << 20);
+	double start = BenchNow();
+	TokenBufferLex(&state, &reference);
+	double sequential = BenchNow() - start;
+	printf("parallel-lex: sequential %7.1f MB/s (%d tokens)\n", length / sequential / 1e6, reference.count);
+
+	for (i = 0; i < (int) (sizeof(chunkCounts) / sizeof(chunkCounts[0])); i++) {
+		TokenBufferInit(&tokens, source, 1 << 20);
+		start = BenchNow();
+		TokenBufferLexParallel(&state, &tokens, &pool, chunkCounts[i]);
+		double elapsed = BenchNow() - start;
+		if (!BenchSameTokens(&reference, &tokens)) {
+			fprintf(stderr, "parallel-lex: %d chunks differ from the sequential lexer\n", chunkCounts[i]);
+			exit(1);
+		}
+		printf("parallel-lex: %2d chunks   %7.1f MB/s on %d threads, identical\n", chunkCounts[i], length / elapsed / 1e6, pool.threadCount);
+		TokenBufferFree(&tokens);
+	}
+
+	TokenBufferFree(&reference);
+	FreeCompiler(&state);
+	PoolDestroy(&pool);
+	free(source);
+}
+
+// Parses one expression from source with the streaming lexer
+static ASTNode *BenchParseExpression(CompilerState *state, char *source, size_t length) {
+	Lexer lex;
+	CompilerSetSource(state, source, length);
+	LexerInit(&lex, state);
+	ASTNode *node = ASTParseValue(state, &lex);
+	if (LexerAvailable(&lex, 1)) {
+		fprintf(stderr, "expressions: trailing tokens after the expression\n");
+		exit(1);
+	}
+	return node;
+}
+// Depth of the left spine, iteratively so deep trees cannot overflow
+static int BenchLeftDepth(ASTNode *node) {
+	int depth = 0;
+	while (node && node->type == AST_BINARYOP) {
+		node = node->binaryOp.left;
+		depth++;
+	}
+	return depth;
+}
+
+// Deeply nested and long flat expressions through the precedence-climbing parser
+static void BenchExpressions(void) {
+	const int depth = 5000;
+	const int terms = 1000000;
+	CompilerState state;
+	size_t length = 0;
+	int i;
+
+	// Precedence and associativity spot checks
+	{
+		char source[] = "a = b = 1 + 2 * 3 - 4 << 1 < 5 ? x : y ? 1 : 2";
+		InitCompiler(&state, stderr);
+		ASTNode *node = BenchParseExpression(&state, source, strlen(source));
+		if (node->type != AST_BINARYOP || node->binaryOp.op != TOK_ASSIGN
+				|| node->binaryOp.right->binaryOp.op != TOK_ASSIGN
+				|| node->binaryOp.right->binaryOp.right->type != AST_TERNARYOP
+				|| node->binaryOp.right->binaryOp.right->ternaryOp.falseValue->type != AST_TERNARYOP
+				|| node->binaryOp.right->binaryOp.right->ternaryOp.condition->binaryOp.op != TOK_LESSERTHAN) {
+			fprintf(stderr, "expressions: wrong tree for \"%s\"\n", source);
+			ASTVisualize(node);
+			exit(1);
+		}
+		FreeCompiler(&state);
+	}
+
+	char *source = (char *) malloc((size_t) terms * 8 + (size_t) depth * 4 + 16);
+	for (i = 0; i < depth; i++) source[length++] = '(';
+	source[length++] = '1';
+	for (i = 0; i < depth; i++) {
+		memcpy(source + length, "+1)", 3);
+		length += 3;
+	}
+	source[length] = '\0';
+	InitCompiler(&state, stderr);
+	double start = BenchNow();
+	ASTNode *node = BenchParseExpression(&state, source, length);
+	double elapsed = BenchNow() - start;
+	if (BenchLeftDepth(node) != depth) {
+		fprintf(stderr, "expressions: nested expression has the wrong shape\n");
+		exit(1);
+	}
+	printf("expressions: %d nested parentheses in %.2f ms\n", depth, elapsed * 1e3);
+	FreeCompiler(&state);
+
+	length = 0;
+	for (i = 0; i < terms; i++) {
+		length += (size_t) sprintf(source + length, i ? " - %d" : "%d", i % 100);
+	}
+	InitCompiler(&state, stderr);
+	start = BenchNow();
+	node = BenchParseExpression(&state, source, length);
+	elapsed = BenchNow() - start;
+	// Subtraction is left associative, so the tree is a left spine
+	if (BenchLeftDepth(node) != terms - 1) {
+		fprintf(stderr, "expressions: flat expression has the wrong shape\n");
+		exit(1);
+	}
+	printf("expressions: %d flat terms in %.2f ms, %.1f ns/term\n", terms, elapsed * 1e3, elapsed * 1e9 / terms);
+	FreeCompiler(&state);
+	free(source);
+}
+
+// Sum of the integer literals in a pointer tree, with an explicit stack
+static long BenchTreeSum(ASTNode *root, ASTNode **stack) {
+	long sum = 0;
+	int top = 0;
+	stack[top++] = root;
+	while (top) {
+		ASTNode *node = stack[--top];
+		switch (node->type) {
+			case AST_INTLIT:
+				sum += node->intLit;
+				break;
+			case AST_BINARYOP:
+				stack[top++] = node->binaryOp.right;
+				stack[top++] = node->binaryOp.left;
+				break;
+			case AST_UNARYOP:
+				stack[top++] = node->unaryOp.value;
+				break;
+			default:
+				break;
+		}
+	}
+	return sum;
+}
+
+// Flattening a tree and inflating it back, what writing and importing a
+// module interface cost besides the file itself
+static void BenchFlatAST(void) {
+	const int terms = 1000000;
+	CompilerState state;
+	ASTFlat flat;
+	size_t length = 0;
+	int i;
+
+	char *source = (char *) malloc((size_t) terms * 16);
+	for (i = 0; i < terms; i++) {
+		if (i) length += (size_t) sprintf(source + length, " %c ", i % 3 ? '+' : '*');
+		length += (size_t) sprintf(source + length, "%d", i % 100);
+	}
+	InitCompiler(&state, stderr);
+	ASTNode *root = BenchParseExpression(&state, source, length);
+	ASTFlatInit(&flat, 16);
+	double start = BenchNow();
+	ASTIndex index = ASTFlatten(&flat, &state.strings, root);
+	double flattenTime = BenchNow() - start;
+	if (index != flat.count - 1) {
+		fprintf(stderr, "flat-ast: the root is not the last node\n");
+		exit(1);
+	}
+
+	const char **strings = (const char **) malloc((state.strings.count + 1) * sizeof(const char *));
+	for (i = 0; i < state.strings.count; i++) strings[i] = InternLookup(&state.strings, i);
+	start = BenchNow();
+	ASTNode *inflated = ASTInflate(&state, &flat, strings, (ASTIndex) state.strings.count, index, root->token);
+	double inflateTime = BenchNow() - start;
+
+	ASTNode **stack = (ASTNode **) malloc((size_t) terms * 2 * sizeof(ASTNode *));
+	long treeSum = BenchTreeSum(root, stack);
+	long inflatedSum = inflated ? BenchTreeSum(inflated, stack) : -1;
+	if (treeSum != inflatedSum) {
+		fprintf(stderr, "flat-ast: the inflated tree differs (%ld != %ld)\n", treeSum, inflatedSum);
+		exit(1);
+	}
+	benchSink += inflatedSum;
+
+	printf("flat-ast: %d terms flattened in %.2f ms, inflated in %.2f ms\n", terms, flattenTime * 1e3, inflateTime * 1e3);
+	printf("flat-ast: ");
+	ASTFlatPrintStats(&flat, stdout);
+
+	free(stack);
+	free(strings);
+	ASTFlatFree(&flat);
+	FreeCompiler(&state);
+	free(source);
+}
+
+// Reporting an error on every line: both collecting and rendering must stay
+// linear in the number of errors, however far they are from the end of file
+static void BenchDiagnostics(void) {
+	const int counts[] = { 10000, 40000, 160000 };
+	FILE *sink = fopen("/dev/null", "w");
+	int i, j;
+
+	if (sink == NULL) {
+		fprintf(stderr, "diagnostics: could not open /dev/null\n");
+		exit(1);
+	}
+	for (i = 0; i < 3; i++) {
+		size_t length = 0;
+		char *source = (char *) malloc((size_t) counts[i] * 24 + 1);
+		for (j = 0; j < counts[i]; j++) length += (size_t) sprintf(source + length, "\tint x%d = 1 @ 2;\n", j % 1000);
+
+		CompilerState state;
+		Lexer lex;
+		InitCompiler(&state, sink);
+		CompilerSetSource(&state, source, length);
+		state.maxErrors = 0;
+		LexerInit(&lex, &state);
+		double start = BenchNow();
+		while (1) {
+			Token token = LexerNext(&lex);
+			if (token.type == TOK_EOF) break;
+			if (token.type == TOK_ERROR) ExitPanicMode(&state);
+		}
+		double collect = BenchNow() - start;
+		if (state.diagnostics.count != counts[i]) {
+			fprintf(stderr, "diagnostics: expected %d errors, got %d\n", counts[i], state.diagnostics.count);
+			exit(1);
+		}
+		start = BenchNow();
+		CompilerFlushDiagnostics(&state);
+		double flush = BenchNow() - start;
+		printf("diagnostics: %6d errors, lex+collect %6.2f ms, flush %6.2f ms, %.0f ns/error\n",
+		       counts[i], collect * 1e3, flush * 1e3, (collect + flush) * 1e9 / counts[i]);
+		FreeCompiler(&state);
+		free(source);
+	}
+	fclose(sink);
+}
+
+// C emitter throughput over a parsed file of many small functions
+static void BenchCodegen(void) {
+	const int functions = 20000;
+	const int rounds = 5;
+	size_t length = 0;
+	int i;
+
+	char *source = (char *) malloc((size_t) functions * 256 + 256);
+	length += (size_t) sprintf(source, "import \"stdio.h\";\ngeneric T Twice<T> (T x) {\n\tint:\n\t\treturn x * 2;\n\tfloat:\n\t\treturn x * 2.0f;\n}\n");
+	for (i = 0; i < functions; i++) {
+		length += (size_t) sprintf(source + length,
+			"int f%d(int a, int b) {\n\tint s = 0;\n\tfor (int i = 0; i < a; i++) {\n\t\tif (i %% 3 == 0 && b > 1) s += i * (b - 1);\n"
+			"\t\telse s = s - -i;\n\t}\n\treturn s > 0 ? Twice(s) : (a << 2) | b;\n}\n", i);
+	}
+
+	CompilerState state;
+	Lexer lex;
+	ASTNode *root;
+	InitCompiler(&state, stderr);
+	CompilerSetSource(&state, source, length);
+	LexerInit(&lex, &state);
+	ASTParseNode(&root, &state, &lex);
+	if (state.hadError) {
+		fprintf(stderr, "codegen: the generated source does not parse\n");
+		exit(1);
+	}
+
+	Buffer out;
+	double best = 0;
+	BufferInit(&out, 0);
+	for (i = 0; i < rounds; i++) {
+		out.length = 0;
+		double start = BenchNow();
+		if (!CodegenEmit(&state, root, &out)) {
+			fprintf(stderr, "codegen: emitting failed\n");
+			exit(1);
+		}
+		double elapsed = BenchNow() - start;
+		if (i == 0 || elapsed < best) best = elapsed;
+	}
+	benchSink += out.length;
+	printf("codegen: %d functions, %zu bytes of C in %.2f ms, %.1f MB/s\n",
+	       functions, out.length, best * 1e3, out.length / best / 1e6);
+
+	BufferFree(&out);
+	FreeCompiler(&state);
+	free(source);
+}
+
+static void BenchParseOrExit(CompilerState *state, ASTNode **root, char *source, size_t length, const char *bench) {
+	Lexer lex;
+	InitCompiler(state, stderr);
+	CompilerSetSource(state, source, length);
+	LexerInit(&lex, state);
+	ASTParseNode(root, state, &lex);
+	if (state->hadError) {
+		fprintf(stderr, "%s: the generated source does not parse\n", bench);
+		exit(1);
+	}
+}
+// Constant folding cost, and how much C it saves on constant-heavy code
+static void BenchFold(void) {
+	const int functions = 20000;
+	size_t length = 0;
+	int i;
+
+	char *source = (char *) malloc((size_t) functions * 256 + 256);
+	for (i = 0; i < functions; i++) {
+		length += (size_t) sprintf(source + length,
+			"int f%d(int x) {\n\tint k = (%d * 4 + 1) << 2;\n\tif (0 > 1) x = -x;\n"
+			"\treturn (x * 1 + 0) * k + (sizeof(int) > 2 ? 16 / 4 : 3) - (x << 0);\n}\n", i, i);
+	}
+
+	CompilerState plain, folded;
+	ASTNode *plainRoot, *foldedRoot;
+	BenchParseOrExit(&plain, &plainRoot, source, length, "fold");
+	BenchParseOrExit(&folded, &foldedRoot, source, length, "fold");
+
+	Folder folder;
+	double start = BenchNow();
+	FoldTree(&folder, &folded, foldedRoot);
+	double elapsed = BenchNow() - start;
+
+	Buffer before, after;
+	BufferInit(&before, 0);
+	BufferInit(&after, 0);
+	if (!CodegenEmit(&plain, plainRoot, &before) || !CodegenEmit(&folded, foldedRoot, &after)) {
+		fprintf(stderr, "fold: emitting failed\n");
+		exit(1);
+	}
+	printf("fold: %d functions in %.2f ms, %ld constants folded, %ld simplifications, %zu -> %zu bytes of C\n",
+	       functions, elapsed * 1e3, folder.folded, folder.simplified, before.length, after.length);
+
+	FoldFree(&folder);
+	BufferFree(&before);
+	BufferFree(&after);
+	FreeCompiler(&plain);
+	FreeCompiler(&folded);
+	free(source);
+}
+
+// Scoped name resolution: a function with many locals and deeply nested
+// blocks through the parser and codegen, then the symbol table on its own
+// against the reverse linear scan over bindings that codegen used to do
+static void BenchSymbols(void) {
+	const int locals = 10000;
+	const int depth = 2000;
+	size_t length = 0;
+	int i;
+
+	char *source = (char *) malloc((size_t) (locals + depth) * 64 + 256);
+	length += (size_t) sprintf(source + length, "int wide(int v0) {\n");
+	for (i = 1; i < locals; i++) length += (size_t) sprintf(source + length, "\tint v%d = v%d + v0;\n", i, i - 1);
+	length += (size_t) sprintf(source + length, "\treturn v%d;\n}\nint deep(int x) {\n", locals - 1);
+	for (i = 0; i < depth; i++) length += (size_t) sprintf(source + length, "{ int x = x + 1; int d%d = x;\n", i);
+	length += (size_t) sprintf(source + length, "x = d0 + d%d;\n", depth - 1);
+	for (i = 0; i < depth; i++) source[length++] = '}';
+	length += (size_t) sprintf(source + length, "\nreturn x;\n}\n");
+
+	CompilerState state;
+	ASTNode *root;
+	double start = BenchNow();
+	BenchParseOrExit(&state, &root, source, length, "symbols");
+	double parsed = BenchNow() - start;
+
+	// v9999's initializer must name v9998, not some other declaration
+	ASTNodeNode *item = root->scope.body->first->node->expression.body->function.body->scope.body->first;
+	while (item->prev->prev) item = item->prev;
+	if (item->prev->node->returnStatement.expression->declaration != item->node) {
+		fprintf(stderr, "symbols: the return does not resolve to the last local\n");
+		exit(1);
+	}
+
+	Buffer out;
+	BufferInit(&out, 0);
+	start = BenchNow();
+	if (!CodegenEmit(&state, root, &out)) {
+		fprintf(stderr, "symbols: emitting failed\n");
+		exit(1);
+	}
+	double emitted = BenchNow() - start;
+	printf("symbols: %d locals and %d nested scopes parsed in %.2f ms, emitted in %.2f ms\n", locals, depth, parsed * 1e3, emitted * 1e3);
+	BufferFree(&out);
+
+	// Every name looked up once per declaration, as a function using all its locals would
+	const char **names = (const char **) malloc(locals * sizeof(const char *));
+	char name[32];
+	for (i = 0; i < locals; i++) names[i] = InternString(&state.strings, name, sprintf(name, "n%d", i));
+	SymbolTable table;
+	SymbolTableInit(&table);
+	unsigned long found = 0;
+	double hashed = 0;
+	int round;
+	// The first round grows the table, the best one is reported
+	for (round = 0; round < 3; round++) {
+		start = BenchNow();
+		for (i = 0; i < locals; i++) {
+			SymbolScopePush(&table);
+			SymbolDeclare(&table, names[i], NULL, i);
+			found += (unsigned long) SymbolFind(&table, names[i / 2])->index;
+		}
+		for (i = 0; i < locals; i++) SymbolScopePop(&table);
+		double elapsed = BenchNow() - start;
+		if (round == 0 || elapsed < hashed) hashed = elapsed;
+	}
+
+	start = BenchNow();
+	int j;
+	for (i = 0; i < locals; i++) {
+		for (j = i; j >= 0 && names[j] != names[i / 2]; j--) {}
+		found -= (unsigned long) j;
+	}
+	double scanned = BenchNow() - start;
+	benchSink += found;
+	printf("symbols: %d scopes declared, looked up and closed in %.2f ms, linear scan lookups alone %.2f ms\n",
+	       locals, hashed * 1e3, scanned * 1e3);
+
+	SymbolTableFree(&table);
+	free(names);
+	FreeCompiler(&state);
+	free(source);
+}
+
+// Pointer types built and taken apart the way CodegenTypeOf does for &x and
+// *p, through the type table and through spelled-out interned strings
+static void BenchTypes(void) {
+	const int levels = 16;
+	const int rounds = 200000;
+	CompilerState state;
+	int i, j;
+	InitCompiler(&state, stderr);
+	TypeTable *types = &state.types;
+
+	// Every spelling of a type is the one entry
+	const Type *type = types->builtins[TYPE_UNSIGNED_LONG];
+	char spelled[256] = "unsigned long *";
+	for (i = 0; i < levels; i++) {
+		type = TypePointer(types, type);
+		if (TypeFromText(types, spelled) != type || type->base->pointer != type) {
+			fprintf(stderr, "types: %s has two entries\n", spelled);
+			exit(1);
+		}
+		strcat(spelled, "*");
+	}
+	const Type *parameter = TypeFromText(types, "T");
+	if (TypeSubstitute(types, TypeFromText(types, "const T **"), parameter, types->builtins[TYPE_INT]) != TypeFromText(types, "const int **")) {
+		fprintf(stderr, "types: substituting behind a qualifier and pointers went wrong\n");
+		exit(1);
+	}
+
+	unsigned long found = 0;
+	double start = BenchNow();
+	for (i = 0; i < rounds; i++) {
+		type = types->builtins[i % TYPE_BUILTIN_COUNT];
+		for (j = 0; j < levels; j++) type = TypePointer(types, type);
+		for (j = 0; j < levels; j++) type = type->base;
+		found += (unsigned long) type->rank;
+	}
+	double canonical = BenchNow() - start;
+
+	static const char *const names[] = { "void", "bool", "char", "int", "unsigned int", "long", "unsigned long", "long long", "unsigned long long", "float", "double", "long double", "string" };
+	start = BenchNow();
+	for (i = 0; i < rounds; i++) {
+		const char *text = InternString(&state.strings, names[i % TYPE_BUILTIN_COUNT], (int) strlen(names[i % TYPE_BUILTIN_COUNT]));
+		for (j = 0; j < levels; j++) {
+			int length = snprintf(spelled, sizeof(spelled), strchr(text, '*') ? "%s*" : "%s *", text);
+			text = InternString(&state.strings, spelled, length);
+		}
+		for (j = 0; j < levels; j++) {
+			size_t length = strlen(text) - 1;
+			while (length && text[length - 1] == ' ') length--;
+			text = InternString(&state.strings, text, (int) length);
+		}
+		found -= (unsigned long) strlen(text);
+	}
+	double strings = BenchNow() - start;
+	benchSink += found;
+	printf("types: %d pointer levels built and taken apart %d times in %.2f ms, as interned spellings %.2f ms (%d types, %ld lookups)\n",
+	       levels, rounds, canonical * 1e3, strings * 1e3, types->count, types->lookups);
+	FreeCompiler(&state);
+}
+
+// Importing a module of many functions and generics: parsing it as every
+// importer did before, building its interface once, then loading that
+// One file of the jobs bench, translated in a state of its own
+typedef struct {
+	char *source;
+	size_t length;
+	Buffer out;
+} BenchJob;
+
+static void BenchJobRun(void *argument) {
+	BenchJob *job = (BenchJob *) argument;
+	CompilerState state;
+	ASTNode *root;
+	BenchParseOrExit(&state, &root, job->source, job->length, "jobs");
+	BufferInit(&job->out, job->length * 2);
+	if (!CodegenEmit(&state, root, &job->out)) {
+		fprintf(stderr, "jobs: emitting failed\n");
+		exit(1);
+	}
+	FreeCompiler(&state);
+}
+// Many files translated one after another, then on the work-stealing pool.
+// File sizes are skewed so the round-robin deal leaves some workers with far
+// more work, which stealing has to even out.
+static void BenchJobs(void) {
+	const int files = 256;
+	BenchJob *jobs = (BenchJob *) calloc(files, sizeof(BenchJob));
+	Buffer *reference = (Buffer *) calloc(files, sizeof(Buffer));
+	ThreadPool pool;
+	int threads = PoolDefaultThreads();
+	size_t total = 0;
+	int i, j;
+
+	for (i = 0; i < files; i++) {
+		int functions = i % 8 == 0 ? 400 : 25;
+		jobs[i].source = (char *) malloc((size_t) functions * 256 + 256);
+		jobs[i].length = (size_t) sprintf(jobs[i].source, "import \"stdio.h\";\ngeneric T Twice<T> (T x) {\n\tint:\n\t\treturn x * 2;\n\tfloat:\n\t\treturn x * 2.0f;\n}\n");
+		for (j = 0; j < functions; j++) {
+			jobs[i].length += (size_t) sprintf(jobs[i].source + jobs[i].length,
+				"int f%d_%d(int a, int b) {\n\tint s = 0;\n\tfor (int i = 0; i < a; i++) s += i * (b - 1);\n\treturn s > 0 ? Twice(s) : (a << 2) | b;\n}\n", i, j);
+		}
+		total += jobs[i].length;
+	}
+
+	double start = BenchNow();
+	for (i = 0; i < files; i++) {
+		BenchJobRun(&jobs[i]);
+		reference[i] = jobs[i].out;
+	}
+	double sequential = BenchNow() - start;
+	printf("jobs: %d files, %zu bytes, sequential %7.2f ms\n", files, total, sequential * 1e3);
+
+	if (!PoolInit(&pool, threads < 4 ? 4 : threads)) {
+		fprintf(stderr, "jobs: could not start the thread pool\n");
+		exit(1);
+	}
+	start = BenchNow();
+	for (i = 0; i < files; i++) {
+		if (!PoolSubmit(&pool, BenchJobRun, &jobs[i])) BenchJobRun(&jobs[i]);
+	}
+	PoolWait(&pool);
+	double parallel = BenchNow() - start;
+	for (i = 0; i < files; i++) {
+		if (jobs[i].out.length != reference[i].length || memcmp(jobs[i].out.data, reference[i].data, reference[i].length) != 0) {
+			fprintf(stderr, "jobs: file %d differs from the sequential translation\n", i);
+			exit(1);
+		}
+		BufferFree(&jobs[i].out);
+		BufferFree(&reference[i]);
+		free(jobs[i].source);
+	}
+	printf("jobs: %d files, %zu bytes, parallel   %7.2f ms on %d threads (%ld steals), identical\n",
+	       files, total, parallel * 1e3, pool.threadCount, pool.steals);
+
+	PoolDestroy(&pool);
+	free(reference);
+	free(jobs);
+}
+
+static ASTQueue *BenchImport(CompilerState *state, ModuleCache *cache, const char *importer, ASTNode *import) {
+	InitCompiler(state, stderr);
+	state->modules = cache;
+	state->diagnostics.path = importer;
+	import->import = InternString(&state->strings, "module", 6);
+	import->exports = NULL;
+	ASTQueue *exports = ModuleImport(state, import);
+	if (exports == NULL || state->hadError) {
+		fprintf(stderr, "modules: the module could not be imported\n");
+		exit(1);
+	}
+	return exports;
+}
+static void BenchModules(void) {
+	const int functions = 4000;
+	const int generics = 200;
+	const int loads = 50;
+	char directory[] = "/tmp/czy-bench-XXXXXX";
+	char path[256], importer[256], interfaces[256];
+	size_t length = 0;
+	int i;
+	if (mkdtemp(directory) == NULL) {
+		fprintf(stderr, "modules: no temporary directory\n");
+		exit(1);
+	}
+	char *source = (char *) malloc((size_t) (functions + generics) * 160);
+	for (i = 0; i < functions; i++) length += (size_t) sprintf(source + length, "int f%d(int a, int b) {\n\tint c = a * %d + b;\n\treturn c > 0 ? c : -c;\n}\n", i, i);
+	for (i = 0; i < generics; i++) length += (size_t) sprintf(source + length, "generic T g%d<T> (T x) {\n\tint:\n\t\treturn x + %d;\n\tdefault:\n\t\treturn x;\n}\n", i, i);
+	snprintf(path, sizeof(path), "%s/module.czy", directory);
+	snprintf(importer, sizeof(importer), "%s/main.czy", directory);
+	snprintf(interfaces, sizeof(interfaces), "%s/cache", directory);
+	FILE *stream = fopen(path, "wb");
+	if (stream == NULL || fwrite(source, 1, length, stream) != length || fclose(stream) != 0) {
+		fprintf(stderr, "modules: could not write %s\n", path);
+		exit(1);
+	}
+
+	CompilerState state;
+	ASTNode *root, import = { 0 };
+	double start = BenchNow();
+	BenchParseOrExit(&state, &root, source, length, "modules");
+	double parsed = BenchNow() - start;
+	FreeCompiler(&state);
+
+	ModuleCache cache;
+	ModuleCacheInit(&cache, interfaces);
+	start = BenchNow();
+	ASTQueue *exports = BenchImport(&state, &cache, importer, &import);
+	double built = BenchNow() - start;
+	FreeCompiler(&state);
+
+	double loaded = 0;
+	for (i = 0; i < loads; i++) {
+		start = BenchNow();
+		exports = BenchImport(&state, &cache, importer, &import);
+		double elapsed = BenchNow() - start;
+		if (i == 0 || elapsed < loaded) loaded = elapsed;
+		// Every export is declared, the generics with their arms
+		ASTNode *last = SymbolLookup(&state.symbols, InternString(&state.strings, "g199", 4));
+		if (exports->length != functions + generics || last == NULL || last->generic.arms->length != 2) {
+			fprintf(stderr, "modules: the interface lost declarations\n");
+			exit(1);
+		}
+		FreeCompiler(&state);
+	}
+	if (cache.builds != 1 || cache.hits != loads) {
+		fprintf(stderr, "modules: %ld builds and %ld hits, expected 1 and %d\n", cache.builds, cache.hits, loads);
+		exit(1);
+	}
+	printf("modules: %zu byte module parsed in %.2f ms, interface built in %.2f ms, loaded in %.3f ms\n", length, parsed * 1e3, built * 1e3, loaded * 1e3);
+	ModuleCacheFree(&cache);
+
+	char command[512];
+	snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+	if (system(command) != 0) fprintf(stderr, "modules: could not remove %s\n", directory);
+	free(source);
+}
+
+// Translating a file that imports a module, against reusing its C from the
+// build cache, and that editing the module makes the C stale
+static void BenchBuildCache(void) {
+	const int functions = 4000;
+	const int lookups = 50;
+	char directory[] = "/tmp/czy-bench-XXXXXX";
+	char module[256], path[256], entries[256];
+	size_t length = 0;
+	int i;
+	if (mkdtemp(directory) == NULL) {
+		fprintf(stderr, "build-cache: no temporary directory\n");
+		exit(1);
+	}
+	char *source = (char *) malloc((size_t) functions * 128 + 64);
+	length += (size_t) sprintf(source, "import \"module\";\n");
+	for (i = 0; i < functions; i++) length += (size_t) sprintf(source + length, "int f%d(int a) {\n\treturn Base(a) * %d + a;\n}\n", i, i);
+	snprintf(module, sizeof(module), "%s/module.czy", directory);
+	snprintf(path, sizeof(path), "%s/main.czy", directory);
+	snprintf(entries, sizeof(entries), "%s/cache", directory);
+	FILE *stream = fopen(module, "wb");
+	bool written = stream && fputs("int Base(int a) {\n\treturn a + 1;\n}\n", stream) >= 0;
+	if (stream == NULL || fclose(stream) != 0 || !written || (stream = fopen(path, "wb")) == NULL
+		|| fwrite(source, 1, length, stream) != length || fclose(stream) != 0) {
+		fprintf(stderr, "build-cache: could not write %s\n", directory);
+		exit(1);
+	}
+
+	ModuleCache modules;
+	BuildCache cache;
+	ModuleCacheInit(&modules, entries);
+	BuildCacheInit(&cache, &modules);
+	CompilerState state;
+	Lexer lex;
+	ASTNode *root;
+	Buffer out, reused;
+	double start = BenchNow();
+	uint64_t key = BuildCacheKey(&cache, path, source, length, true, CZY_DEFAULT_EVAL_STEPS);
+	InitCompiler(&state, stderr);
+	CompilerSetSource(&state, source, length);
+	state.diagnostics.path = path;
+	state.modules = &modules;
+	LexerInit(&lex, &state);
+	ASTParseNode(&root, &state, &lex);
+	BufferInit(&out, length * 2);
+	if (state.hadError || !CodegenEmit(&state, root, &out)) {
+		fprintf(stderr, "build-cache: the generated source does not translate\n");
+		exit(1);
+	}
+	BuildCacheStore(&cache, key, &state, &out);
+	double translated = BenchNow() - start;
+	FreeCompiler(&state);
+
+	double best = 0;
+	BufferInit(&reused, out.length);
+	for (i = 0; i < lookups; i++) {
+		reused.length = 0;
+		start = BenchNow();
+		bool hit = BuildCacheLookup(&cache, BuildCacheKey(&cache, path, source, length, true, CZY_DEFAULT_EVAL_STEPS), &reused);
+		double elapsed = BenchNow() - start;
+		if (!hit || reused.length != out.length || memcmp(reused.data, out.data, out.length) != 0) {
+			fprintf(stderr, "build-cache: the cached C was not reused as emitted\n");
+			exit(1);
+		}
+		if (i == 0 || elapsed < best) best = elapsed;
+	}
+
+	// Sources are hashed once per run, so a fresh cache sees the edit
+	BuildCacheFree(&cache);
+	ModuleCacheFree(&modules);
+	ModuleCacheInit(&modules, entries);
+	BuildCacheInit(&cache, &modules);
+	stream = fopen(module, "ab");
+	if (stream == NULL || fputs("int Other(int a) {\n\treturn a;\n}\n", stream) < 0 || fclose(stream) != 0) {
+		fprintf(stderr, "build-cache: could not edit %s\n", module);
+		exit(1);
+	}
+	if (BuildCacheLookup(&cache, key, &reused)) {
+		fprintf(stderr, "build-cache: the C was reused after its import changed\n");
+		exit(1);
+	}
+	printf("build-cache: %zu byte file translated in %.2f ms, reused in %.3f ms, stale after editing its import\n", length, translated * 1e3, best * 1e3);
+
+	BufferFree(&out);
+	BufferFree(&reused);
+	BuildCacheFree(&cache);
+	ModuleCacheFree(&modules);
+	char command[512];
+	snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+	if (system(command) != 0) fprintf(stderr, "build-cache: could not remove %s\n", directory);
+	free(source);
+}
+
+static bool BenchResolveFunction(void *context, const char *name, bool globalOnly, EvalName *result) {
+	ASTNode *function = (ASTNode *) context;
+	(void) globalOnly;
+	if (name != function->expression.name) return false;
+	*result = (EvalName) { false, { 0 }, function };
+	return true;
+}
+// Compile-time evaluator speed on a call-heavy constexpr function
+static void BenchEval(void) {
+	static const char source[] =
+		"constexpr int fib(int n) {\n\tif (n < 2) return n;\n\treturn fib(n - 1) + fib(n - 2);\n}\n"
+		"compiletime int x = fib(25);\n";
+	CompilerState state;
+	Lexer lex;
+	ASTNode *root;
+	InitCompiler(&state, stderr);
+	CompilerSetSource(&state, source, sizeof(source) - 1);
+	state.evalSteps = 0;
+	LexerInit(&lex, &state);
+	ASTParseNode(&root, &state, &lex);
+	if (state.hadError) {
+		fprintf(stderr, "eval: the source does not parse\n");
+		exit(1);
+	}
+
+	Evaluator e;
+	EvalValue value;
+	ASTNode *fib = root->scope.body->first->node;
+	ASTNode *call = root->scope.body->first->prev->node->expression.body;
+	EvalInit(&e, &state, BenchResolveFunction, fib);
+	double start = BenchNow();
+	bool ok = EvalExpression(&e, call, &value);
+	double elapsed = BenchNow() - start;
+	if (!ok || value.i != 75025) {
+		fprintf(stderr, "eval: fib(25) gave %lld (%s)\n", ok ? value.i : 0, ok ? "wrong" : e.error);
+		exit(1);
+	}
+	printf("eval: fib(25) at compile time, %ld steps in %.2f ms, %.1f M steps/s\n",
+	       e.steps, elapsed * 1e3, e.steps / elapsed / 1e6);
+	EvalFree(&e);
+	FreeCompiler(&state);
+}
+
+static const Bench benches[] = {
+	{ "keywords", BenchKeywords },
+	{ "comments", BenchComments },
+	{ "comment-lines", BenchCommentLines },
+	{ "parallel-lex", BenchParallelLex },
+	{ "literals", BenchLiterals },
+	{ "expressions", BenchExpressions },
+	{ "flat-ast", BenchFlatAST },
+	{ "diagnostics", BenchDiagnostics },
+	{ "codegen", BenchCodegen },
+	{ "eval", BenchEval },
+	{ "fold", BenchFold },
+	{ "symbols", BenchSymbols },
+	{ "types", BenchTypes },
+	{ "modules", BenchModules },
+	{ "jobs", BenchJobs },
+	{ "build-cache", BenchBuildCache },
+	{ NULL, NULL }
+};
+
+int main(int argc, char **argv) {
+	const Bench *bench;
+	int i;
+	for (bench = benches; bench->name; bench++) {
+		bool selected = argc < 2;
+		for (i = 1; i < argc; i++) {
+			if (strcmp(argv[i], bench->name) == 0) selected = true;
+		}
+		if (selected) bench->run();
+	}
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include "arena.h"
+#ifdef CZY_ARENA_DEBUG
+#include <sys/mman.h>
+#endif
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_POISON 0xDD
+
+static ArenaBlock *ArenaBlockCreate(size_t capacity) {
+	ArenaBlock *block;
+#ifdef CZY_ARENA_DEBUG
+	block = (ArenaBlock *) mmap(NULL, sizeof(ArenaBlock) + capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (block == MAP_FAILED) return NULL;
+	memset(block->data, ARENA_POISON, capacity);
+#else
+	block = (ArenaBlock *) malloc(sizeof(ArenaBlock) + capacity);
+	if (block == NULL) return NULL;
+#endif
+	block->prev = NULL;
+	block->used = 0;
+	block->capacity = capacity;
+	return block;
+}
+static void ArenaBlockDestroy(ArenaBlock *block) {
+#ifdef CZY_ARENA_DEBUG
+	size_t size = sizeof(ArenaBlock) + block->capacity;
+	memset(block, ARENA_POISON, size);
+	mprotect(block, size, PROT_NONE);
+#else
+	free(block);
+#endif
+}
+
+void ArenaInit(Arena *arena, size_t blockSize) {
+	*arena = (Arena) { 0 };
+	arena->blockSize = blockSize ? blockSize : 64 * 1024;
+}
+static void *ArenaAllocAligned(Arena *arena, size_t size, size_t alignment) {
+	ArenaBlock *block = arena->blocks;
+	size_t start = 0;
+	if (block) start = (block->used + alignment - 1) & ~(alignment - 1);
+
+	if (block == NULL || start + size > block->capacity) {
+		size_t capacity = size > arena->blockSize ? size : arena->blockSize;
+		block = ArenaBlockCreate(capacity);
+		if (block == NULL) {
+			fprintf(stderr, "Out of memory: arena block of %zu bytes.\n", capacity);
+			exit(1);
+		}
+		block->prev = arena->blocks;
+		arena->blocks = block;
+		arena->bytesReserved += capacity;
+		start = 0;
+	}
+
+	void *memory = block->data + start;
+	block->used = start + size;
+	arena->allocations++;
+	arena->bytesUsed += size;
+	return memory;
+}
+void *ArenaAlloc(Arena *arena, size_t size) {
+	return ArenaAllocAligned(arena, size, ARENA_ALIGNMENT);
+}
+void *ArenaCalloc(Arena *arena, size_t count, size_t size) {
+	void *memory = ArenaAlloc(arena, count * size);
+	memset(memory, 0, count * size);
+	return memory;
+}
+char *ArenaStrndup(Arena *arena, const char *str, size_t length) {
+	char *copy = (char *) ArenaAllocAligned(arena, length + 1, 1);
+	memcpy(copy, str, length);
+	copy[length] = '\0';
+	return copy;
+}
+void ArenaPrintStats(Arena *arena, FILE *stream) {
+	fprintf(stream, "Arena: %zu allocations, %zu bytes used of %zu reserved\n",
+		arena->allocations, arena->bytesUsed, arena->bytesReserved);
+}
+void ArenaRelease(Arena *arena) {
+	ArenaBlock *block = arena->blocks;
+	while (block) {
+		ArenaBlock *prev = block->prev;
+		ArenaBlockDestroy(block);
+		block = prev;
+	}
+	size_t blockSize = arena->blockSize;
+	*arena = (Arena) { 0 };
+	arena->blockSize = blockSize;
+}
@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ArenaBlock ArenaBlock;
+typedef struct Arena Arena;
+
+struct ArenaBlock {
+	ArenaBlock *prev;
+	size_t used;
+	size_t capacity;
+	_Alignas(16) unsigned char data[];
+};
+
+// Bump allocator for everything that lives as long as a compilation unit.
+// Allocations are never freed one by one, ArenaRelease drops them all.
+// Building with -DCZY_ARENA_DEBUG poisons released blocks and keeps them
+// mapped without access rights, so any use after release faults.
+struct Arena {
+	ArenaBlock *blocks;
+	size_t blockSize;
+	// Statistics
+	size_t allocations;
+	size_t bytesUsed;
+	size_t bytesReserved;
+};
+
+void ArenaInit(Arena *arena, size_t blockSize);
+void *ArenaAlloc(Arena *arena, size_t size);
+void *ArenaCalloc(Arena *arena, size_t count, size_t size);
+char *ArenaStrndup(Arena *arena, const char *str, size_t length);
+void ArenaPrintStats(Arena *arena, FILE *stream);
+void ArenaRelease(Arena *arena);
+
+#endif
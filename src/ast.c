@@ -0,0 +1,773 @@
+#include "ast.h"
+#include "eval.h"
+
+// Pointer tree node being flattened, with the position of its next child
+typedef struct {
+	ASTNode *node;
+	int next;
+	ASTNodeNode *cursor;
+} ASTFlatFrame;
+
+bool ASTFlatInit(ASTFlat *ast, ASTIndex capacity) {
+	if (capacity < 16) capacity = 16;
+	ast->kind = (unsigned char *) malloc(capacity * sizeof(unsigned char));
+	ast->op = (unsigned char *) malloc(capacity * sizeof(unsigned char));
+	ast->offset = (int *) malloc(capacity * sizeof(int));
+	ast->lhs = (ASTIndex *) malloc(capacity * sizeof(ASTIndex));
+	ast->rhs = (ASTIndex *) malloc(capacity * sizeof(ASTIndex));
+	ast->count = 0;
+	ast->capacity = capacity;
+	ast->extra = NULL;
+	ast->extraCount = 0;
+	ast->extraCapacity = 0;
+	ast->nodes = NULL;
+	if (ast->kind == NULL || ast->op == NULL || ast->offset == NULL || ast->lhs == NULL || ast->rhs == NULL) {
+		ASTFlatFree(ast);
+		return false;
+	}
+	// Node 0 stands for "no node"
+	ASTFlatPush(ast, AST_ERROR, TOK_ERROR, 0, AST_NONE, AST_NONE);
+	return true;
+}
+static bool ASTFlatGrow(ASTFlat *ast) {
+	ASTIndex capacity = ast->capacity ? ast->capacity * 2 : 16;
+	unsigned char *kind = (unsigned char *) realloc(ast->kind, capacity * sizeof(unsigned char));
+	if (kind == NULL) return false;
+	ast->kind = kind;
+	unsigned char *op = (unsigned char *) realloc(ast->op, capacity * sizeof(unsigned char));
+	if (op == NULL) return false;
+	ast->op = op;
+	int *offset = (int *) realloc(ast->offset, capacity * sizeof(int));
+	if (offset == NULL) return false;
+	ast->offset = offset;
+	ASTIndex *lhs = (ASTIndex *) realloc(ast->lhs, capacity * sizeof(ASTIndex));
+	if (lhs == NULL) return false;
+	ast->lhs = lhs;
+	ASTIndex *rhs = (ASTIndex *) realloc(ast->rhs, capacity * sizeof(ASTIndex));
+	if (rhs == NULL) return false;
+	ast->rhs = rhs;
+	if (ast->nodes) {
+		ASTNode **nodes = (ASTNode **) realloc(ast->nodes, capacity * sizeof(ASTNode *));
+		if (nodes == NULL) return false;
+		ast->nodes = nodes;
+	}
+	ast->capacity = capacity;
+	return true;
+}
+// Makes ASTFlatten record the tree node behind each index, so a pass over
+// the arrays can reach what they leave out and write its result back
+bool ASTFlatKeepNodes(ASTFlat *ast) {
+	if (ast->nodes) return true;
+	ast->nodes = (ASTNode **) calloc(ast->capacity, sizeof(ASTNode *));
+	return ast->nodes != NULL;
+}
+ASTIndex ASTFlatPush(ASTFlat *ast, NodeType kind, TokenType op, int offset, ASTIndex lhs, ASTIndex rhs) {
+	if (ast->count == ast->capacity && !ASTFlatGrow(ast)) {
+		fprintf(stderr, "Out of memory for AST nodes.\n");
+		exit(1);
+	}
+
+	ast->kind[ast->count] = (unsigned char) kind;
+	ast->op[ast->count] = (unsigned char) op;
+	ast->offset[ast->count] = offset;
+	ast->lhs[ast->count] = lhs;
+	ast->rhs[ast->count] = rhs;
+	if (ast->nodes) ast->nodes[ast->count] = NULL;
+	return ast->count++;
+}
+// Appends items to the extra array and returns where they start
+ASTIndex ASTFlatPushExtra(ASTFlat *ast, const ASTIndex *items, ASTIndex count) {
+	if (ast->extraCount + count > ast->extraCapacity) {
+		ASTIndex capacity = ast->extraCapacity ? ast->extraCapacity : 16;
+		while (capacity < ast->extraCount + count) capacity *= 2;
+		ASTIndex *extra = (ASTIndex *) realloc(ast->extra, capacity * sizeof(ASTIndex));
+		if (extra == NULL) {
+			fprintf(stderr, "Out of memory for AST nodes.\n");
+			exit(1);
+		}
+		ast->extra = extra;
+		ast->extraCapacity = capacity;
+	}
+
+	ASTIndex start = ast->extraCount;
+	memcpy(ast->extra + start, items, count * sizeof(ASTIndex));
+	ast->extraCount += count;
+	return start;
+}
+// A child list is its length followed by the children
+static ASTIndex ASTFlatPushList(ASTFlat *ast, const ASTIndex *items, ASTIndex count) {
+	ASTIndex start = ASTFlatPushExtra(ast, &count, 1);
+	ASTFlatPushExtra(ast, items, count);
+	return start;
+}
+static ASTIndex ASTFlatStringId(InternTable *strings, const char *str) {
+	if (str == NULL || strings == NULL) return (ASTIndex) -1;
+	return (ASTIndex) InternId(strings, str, strlen(str));
+}
+// Types are stored by their spelling
+static ASTIndex ASTFlatTypeId(InternTable *strings, const Type *type) {
+	return ASTFlatStringId(strings, type ? type->name : NULL);
+}
+// Where the i-th child of index is kept, in the order ASTFlatten visits
+// them, NULL past the last. Only good until the next node is pushed.
+ASTIndex *ASTFlatChild(ASTFlat *ast, ASTIndex index, ASTIndex i) {
+	ASTIndex rhs = ast->rhs[index];
+	switch ((NodeType) ast->kind[index]) {
+		case AST_EXPRESSION:
+		case AST_RETURN:
+		case AST_UNARYOP:
+		case AST_CAST:
+			return i < 1 ? &ast->lhs[index] : NULL;
+		case AST_BINARYOP:
+		case AST_WHILE:
+			return i == 0 ? &ast->lhs[index] : i == 1 ? &ast->rhs[index] : NULL;
+		case AST_TERNARYOP:
+		case AST_IF:
+			return i == 0 ? &ast->lhs[index] : i < 3 ? &ast->extra[rhs + i - 1] : NULL;
+		case AST_FOR:
+			return i < 4 ? &ast->extra[rhs + i] : NULL;
+		case AST_CALL:
+		case AST_FUNCTION:
+			return i == 0 ? &ast->lhs[index] : i <= ast->extra[rhs] ? &ast->extra[rhs + i] : NULL;
+		case AST_SCOPE:
+		case AST_GENERICARM:
+			return i < ast->extra[rhs] ? &ast->extra[rhs + 1 + i] : NULL;
+		case AST_GENERIC:
+			return i < ast->extra[rhs + 3] + ast->extra[rhs + 4] ? &ast->extra[rhs + 5 + i] : NULL;
+		default:
+			return NULL;
+	}
+}
+// Yields the children of a pointer tree node in order, NULL for a missing one
+static bool ASTFlatNextChild(ASTFlatFrame *frame, ASTNode **child) {
+	ASTNode *node = frame->node;
+	int i = frame->next++;
+	switch (node->type) {
+		case AST_EXPRESSION:
+			*child = node->expression.body;
+			return i < 1;
+		case AST_RETURN:
+			*child = node->returnStatement.expression;
+			return i < 1;
+		case AST_UNARYOP:
+			*child = node->unaryOp.value;
+			return i < 1;
+		case AST_CAST:
+			*child = node->cast.value;
+			return i < 1;
+		case AST_BINARYOP:
+			*child = i == 0 ? node->binaryOp.left : node->binaryOp.right;
+			return i < 2;
+		case AST_TERNARYOP:
+			*child = i == 0 ? node->ternaryOp.condition : i == 1 ? node->ternaryOp.trueValue : node->ternaryOp.falseValue;
+			return i < 3;
+		case AST_IF:
+			*child = i == 0 ? node->ifStatement.condition : i == 1 ? node->ifStatement.then : node->ifStatement.otherwise;
+			return i < 3;
+		case AST_WHILE:
+			*child = i == 0 ? node->loop.condition : node->loop.body;
+			return i < 2;
+		case AST_FOR:
+			*child = i == 0 ? node->loop.init : i == 1 ? node->loop.condition : i == 2 ? node->loop.step : node->loop.body;
+			return i < 4;
+		case AST_CALL:
+			if (i == 0) {
+				frame->cursor = node->call.arguments ? node->call.arguments->first : NULL;
+				*child = node->call.callee;
+				return true;
+			}
+			break;
+		case AST_SCOPE:
+			if (i == 0) frame->cursor = node->scope.body ? node->scope.body->first : NULL;
+			break;
+		case AST_GENERICARM:
+			if (i == 0) frame->cursor = node->arm.body ? node->arm.body->first : NULL;
+			break;
+		case AST_GENERIC:
+			// The parameters, then the arms
+			if (i == 0) frame->cursor = node->generic.parameters->first;
+			if (i == node->generic.parameters->length) frame->cursor = node->generic.arms->first;
+			break;
+		case AST_FUNCTION:
+			if (i == 0) {
+				frame->cursor = node->function.parameters ? node->function.parameters->first : NULL;
+				*child = node->function.body;
+				return true;
+			}
+			break;
+		default:
+			return false;
+	}
+	// Lists: call arguments, statements, parameters and arms
+	if (frame->cursor == NULL) return false;
+	*child = frame->cursor->node;
+	frame->cursor = frame->cursor->prev;
+	return true;
+}
+// Copies a pointer tree into ast in post-order and returns the root's index.
+// Without strings, names and types are all stored as -1.
+// Uses explicit stacks, so arbitrarily deep trees cannot overflow the stack.
+ASTIndex ASTFlatten(ASTFlat *ast, InternTable *strings, ASTNode *root) {
+	if (root == NULL) return AST_NONE;
+
+	int frameCount = 0, frameCapacity = 64;
+	int valueCount = 0, valueCapacity = 64;
+	ASTFlatFrame *frames = (ASTFlatFrame *) malloc(frameCapacity * sizeof(ASTFlatFrame));
+	ASTIndex *values = (ASTIndex *) malloc(valueCapacity * sizeof(ASTIndex));
+	if (frames == NULL || values == NULL) {
+		fprintf(stderr, "Out of memory for AST nodes.\n");
+		exit(1);
+	}
+
+	frames[frameCount++] = (ASTFlatFrame) { root, 0, NULL };
+	while (frameCount) {
+		ASTFlatFrame *frame = &frames[frameCount - 1];
+		ASTNode *child;
+		if (valueCount == valueCapacity) {
+			valueCapacity *= 2;
+			values = (ASTIndex *) realloc(values, valueCapacity * sizeof(ASTIndex));
+			if (values == NULL) {
+				fprintf(stderr, "Out of memory for AST nodes.\n");
+				exit(1);
+			}
+		}
+		if (ASTFlatNextChild(frame, &child)) {
+			if (child == NULL) {
+				values[valueCount++] = AST_NONE;
+				continue;
+			}
+			if (frameCount == frameCapacity) {
+				frameCapacity *= 2;
+				frames = (ASTFlatFrame *) realloc(frames, frameCapacity * sizeof(ASTFlatFrame));
+				if (frames == NULL) {
+					fprintf(stderr, "Out of memory for AST nodes.\n");
+					exit(1);
+				}
+			}
+			frames[frameCount++] = (ASTFlatFrame) { child, 0, NULL };
+			continue;
+		}
+
+		// Every child is flattened, their indices are on top of the value stack
+		ASTNode *node = frame->node;
+		ASTIndex childCount = (ASTIndex) (frame->next - 1);
+		ASTIndex *children = values + valueCount - childCount;
+		ASTIndex lhs = AST_NONE, rhs = AST_NONE, pair[5];
+		TokenType op = node->token.type;
+		switch (node->type) {
+			case AST_INTLIT:
+				lhs = (ASTIndex) node->intLit;
+				rhs = (ASTIndex) (node->intLit >> 32);
+				break;
+			case AST_CHARLIT:
+				lhs = (unsigned char) node->charLit;
+				break;
+			case AST_FLOATLIT: {
+				unsigned long long bits;
+				memcpy(&bits, &node->floatLit, sizeof(bits));
+				lhs = (ASTIndex) bits;
+				rhs = (ASTIndex) (bits >> 32);
+				break;
+			}
+			case AST_STRINGLIT:
+				lhs = ASTFlatStringId(strings, node->stringLit);
+				break;
+			case AST_IDENTIFIER:
+				lhs = ASTFlatStringId(strings, node->identifier);
+				break;
+			case AST_BINARYOP:
+				op = node->binaryOp.op;
+				lhs = children[0];
+				rhs = children[1];
+				break;
+			case AST_UNARYOP:
+				op = node->unaryOp.op;
+				lhs = children[0];
+				rhs = node->unaryOp.postfix;
+				break;
+			case AST_TERNARYOP:
+				lhs = children[0];
+				rhs = ASTFlatPushExtra(ast, children + 1, 2);
+				break;
+			case AST_CALL:
+				lhs = children[0];
+				rhs = ASTFlatPushList(ast, children + 1, childCount - 1);
+				break;
+			case AST_SCOPE:
+				rhs = ASTFlatPushList(ast, children, childCount);
+				break;
+			case AST_FUNCTION:
+				lhs = children[0];
+				rhs = ASTFlatPushList(ast, children + 1, childCount - 1);
+				break;
+			case AST_CONSTANT: {
+				// Floats by their bits, the op tells them apart
+				unsigned long long bits;
+				op = node->constant->type->isFloat ? TOK_DOUBLELIT : TOK_LONGLONGLIT;
+				memcpy(&bits, &node->constant->i, sizeof(bits));
+				lhs = (ASTIndex) bits;
+				rhs = (ASTIndex) (bits >> 32);
+				break;
+			}
+			case AST_EXPRESSION:
+				op = node->expression.isConstexpr ? TOK_CONSTEXPR : node->expression.isCompiletime ? TOK_COMPILETIME : TOK_EOF;
+				lhs = children[0];
+				pair[0] = ASTFlatTypeId(strings, node->expression.type);
+				pair[1] = ASTFlatStringId(strings, node->expression.name);
+				rhs = ASTFlatPushExtra(ast, pair, 2);
+				break;
+			case AST_RETURN:
+				lhs = children[0];
+				break;
+			case AST_CAST:
+				lhs = children[0];
+				rhs = ASTFlatTypeId(strings, node->cast.type);
+				break;
+			case AST_TYPENAME:
+				rhs = ASTFlatTypeId(strings, node->cast.type);
+				break;
+			case AST_IMPORT:
+				lhs = ASTFlatStringId(strings, node->import);
+				break;
+			case AST_IF:
+				lhs = children[0];
+				rhs = ASTFlatPushExtra(ast, children + 1, 2);
+				break;
+			case AST_WHILE:
+				lhs = children[0];
+				rhs = children[1];
+				break;
+			case AST_FOR:
+				rhs = ASTFlatPushExtra(ast, children, 4);
+				break;
+			case AST_GENERICARM:
+				lhs = ASTFlatTypeId(strings, node->arm.type);
+				rhs = ASTFlatPushList(ast, children, childCount);
+				break;
+			case AST_GENERIC:
+				pair[0] = ASTFlatTypeId(strings, node->generic.returnType);
+				pair[1] = ASTFlatStringId(strings, node->generic.name);
+				pair[2] = ASTFlatTypeId(strings, node->generic.typeParameter);
+				pair[3] = (ASTIndex) node->generic.parameters->length;
+				pair[4] = (ASTIndex) node->generic.arms->length;
+				rhs = ASTFlatPushExtra(ast, pair, 5);
+				ASTFlatPushExtra(ast, children, childCount);
+				break;
+			default:
+				break;
+		}
+		valueCount -= childCount;
+		values[valueCount++] = ASTFlatPush(ast, node->type, op, node->token.offset, lhs, rhs);
+		if (ast->nodes) ast->nodes[values[valueCount - 1]] = node;
+		frameCount--;
+	}
+
+	ASTIndex index = values[0];
+	free(frames);
+	free(values);
+	return index;
+}
+
+// Points the first count items of a list at the tree nodes of items and
+// drops the rest, the list keeps its own links
+static void ASTFlatRelinkItems(const ASTFlat *ast, ASTQueue *queue, const ASTIndex *items, ASTIndex count) {
+	ASTNodeNode *item, *last = NULL;
+	ASTIndex i = 0;
+	if (queue == NULL) return;
+	for (item = queue->first; item && i < count; item = item->prev) {
+		item->node = ast->nodes[items[i++]];
+		last = item;
+	}
+	if (last) last->prev = NULL;
+	else queue->first = NULL;
+	queue->last = last;
+	queue->length = (int) i;
+}
+// Writes the children of index back into its tree node, after a pass over
+// the arrays replaced some of them or dropped items from its lists
+void ASTFlatRelink(const ASTFlat *ast, ASTIndex index) {
+	ASTNode *node = ast->nodes[index], *const *nodes = ast->nodes;
+	ASTIndex lhs = ast->lhs[index], rhs = ast->rhs[index];
+	const ASTIndex *extra = ast->extra;
+	switch (node->type) {
+		case AST_EXPRESSION:
+			node->expression.body = nodes[lhs];
+			break;
+		case AST_RETURN:
+			node->returnStatement.expression = nodes[lhs];
+			break;
+		case AST_UNARYOP:
+			node->unaryOp.value = nodes[lhs];
+			break;
+		case AST_CAST:
+			node->cast.value = nodes[lhs];
+			break;
+		case AST_BINARYOP:
+			node->binaryOp.left = nodes[lhs];
+			node->binaryOp.right = nodes[rhs];
+			break;
+		case AST_TERNARYOP:
+			node->ternaryOp.condition = nodes[lhs];
+			node->ternaryOp.trueValue = nodes[extra[rhs]];
+			node->ternaryOp.falseValue = nodes[extra[rhs + 1]];
+			break;
+		case AST_IF:
+			node->ifStatement.condition = nodes[lhs];
+			node->ifStatement.then = nodes[extra[rhs]];
+			node->ifStatement.otherwise = nodes[extra[rhs + 1]];
+			break;
+		case AST_WHILE:
+			node->loop.condition = nodes[lhs];
+			node->loop.body = nodes[rhs];
+			break;
+		case AST_FOR:
+			node->loop.init = nodes[extra[rhs]];
+			node->loop.condition = nodes[extra[rhs + 1]];
+			node->loop.step = nodes[extra[rhs + 2]];
+			node->loop.body = nodes[extra[rhs + 3]];
+			break;
+		case AST_CALL:
+			node->call.callee = nodes[lhs];
+			ASTFlatRelinkItems(ast, node->call.arguments, extra + rhs + 1, extra[rhs]);
+			break;
+		case AST_FUNCTION:
+			node->function.body = nodes[lhs];
+			ASTFlatRelinkItems(ast, node->function.parameters, extra + rhs + 1, extra[rhs]);
+			break;
+		case AST_SCOPE:
+			ASTFlatRelinkItems(ast, node->scope.body, extra + rhs + 1, extra[rhs]);
+			break;
+		case AST_GENERICARM:
+			ASTFlatRelinkItems(ast, node->arm.body, extra + rhs + 1, extra[rhs]);
+			break;
+		default:
+			break;
+	}
+}
+
+// State of rebuilding a pointer tree from a flat one
+typedef struct {
+	CompilerState *state;
+	const ASTFlat *ast;
+	const char *const *strings;
+	ASTIndex stringCount;
+	ASTNode **nodes;
+	ASTIndex index;		// Node being rebuilt, its children all come before it
+	bool ok;
+} ASTInflater;
+
+static ASTNode *ASTInflateChild(ASTInflater *in, ASTIndex child) {
+	if (child >= in->index) {
+		in->ok = false;
+		return NULL;
+	}
+	return in->nodes[child];
+}
+static const ASTIndex *ASTInflateExtra(ASTInflater *in, ASTIndex start, ASTIndex count) {
+	if (start > in->ast->extraCount || count > in->ast->extraCount - start) {
+		in->ok = false;
+		return NULL;
+	}
+	return in->ast->extra + start;
+}
+static ASTQueue *ASTInflateItems(ASTInflater *in, const ASTIndex *items, ASTIndex count) {
+	ASTQueue *queue = (ASTQueue *) ArenaCalloc(&in->state->arena, 1, sizeof(ASTQueue));
+	ASTIndex i;
+	for (i = 0; items && i < count; i++) {
+		ASTNode *child = ASTInflateChild(in, items[i]);
+		if (child) ASTQueuePush(&in->state->arena, queue, child);
+	}
+	return queue;
+}
+// A list pushed by ASTFlatPushList: its count, then the items
+static ASTQueue *ASTInflateList(ASTInflater *in, ASTIndex start) {
+	const ASTIndex *count = ASTInflateExtra(in, start, 1);
+	if (count == NULL) return ASTInflateItems(in, NULL, 0);
+	return ASTInflateItems(in, ASTInflateExtra(in, start + 1, *count), *count);
+}
+static const char *ASTInflateString(ASTInflater *in, ASTIndex id) {
+	if (id == (ASTIndex) -1) return NULL;
+	if (id >= in->stringCount) {
+		in->ok = false;
+		return NULL;
+	}
+	return in->strings[id];
+}
+static const Type *ASTInflateType(ASTInflater *in, ASTIndex id) {
+	const char *name = ASTInflateString(in, id);
+	return name ? TypeNamed(&in->state->types, name) : NULL;
+}
+// Rebuilds the tree under root in state's arena, the inverse of ASTFlatten.
+// strings holds the text of each intern id ast was flattened with, interned
+// in state. There is no source text behind the nodes: each gets origin as
+// its token, with the length 0 and the kind of token it was built from.
+// Identifiers are left unresolved. NULL when an index is out of range, so a
+// damaged file cannot crash the compiler.
+ASTNode *ASTInflate(CompilerState *state, const ASTFlat *ast, const char *const *strings, ASTIndex stringCount, ASTIndex root, Token origin) {
+	if (root == AST_NONE || root >= ast->count) return NULL;
+	ASTInflater in = { state, ast, strings, stringCount, NULL, 0, true };
+	in.nodes = (ASTNode **) calloc((size_t) root + 1, sizeof(ASTNode *));
+	if (in.nodes == NULL) {
+		fprintf(stderr, "Out of memory for AST nodes.\n");
+		exit(1);
+	}
+
+	for (in.index = 1; in.index <= root && in.ok; in.index++) {
+		ASTIndex lhs = ast->lhs[in.index], rhs = ast->rhs[in.index];
+		const ASTIndex *extra;
+		ASTNode *node = (ASTNode *) ArenaCalloc(&state->arena, 1, sizeof(ASTNode));
+		node->type = (NodeType) ast->kind[in.index];
+		node->token = origin;
+		node->token.type = (TokenType) ast->op[in.index];
+		node->token.length = 0;
+		switch (node->type) {
+			case AST_INTLIT:
+				node->intLit = (unsigned long long) lhs | (unsigned long long) rhs << 32;
+				break;
+			case AST_CHARLIT:
+				node->charLit = (char) lhs;
+				break;
+			case AST_FLOATLIT: {
+				unsigned long long bits = (unsigned long long) lhs | (unsigned long long) rhs << 32;
+				memcpy(&node->floatLit, &bits, sizeof(bits));
+				break;
+			}
+			case AST_STRINGLIT:
+				node->stringLit = ASTInflateString(&in, lhs);
+				break;
+			case AST_IDENTIFIER:
+				node->identifier = ASTInflateString(&in, lhs);
+				break;
+			case AST_BINARYOP:
+				node->binaryOp.op = node->token.type;
+				node->binaryOp.left = ASTInflateChild(&in, lhs);
+				node->binaryOp.right = ASTInflateChild(&in, rhs);
+				break;
+			case AST_UNARYOP:
+				node->unaryOp.op = node->token.type;
+				node->unaryOp.value = ASTInflateChild(&in, lhs);
+				node->unaryOp.postfix = rhs != 0;
+				break;
+			case AST_TERNARYOP:
+				node->ternaryOp.condition = ASTInflateChild(&in, lhs);
+				if ((extra = ASTInflateExtra(&in, rhs, 2))) {
+					node->ternaryOp.trueValue = ASTInflateChild(&in, extra[0]);
+					node->ternaryOp.falseValue = ASTInflateChild(&in, extra[1]);
+				}
+				break;
+			case AST_CALL:
+				node->call.callee = ASTInflateChild(&in, lhs);
+				node->call.arguments = ASTInflateList(&in, rhs);
+				break;
+			case AST_SCOPE:
+				node->scope.body = ASTInflateList(&in, rhs);
+				break;
+			case AST_FUNCTION:
+				node->function.body = ASTInflateChild(&in, lhs);
+				node->function.parameters = ASTInflateList(&in, rhs);
+				break;
+			case AST_CONSTANT: {
+				// Only whether it is a float survives flattening
+				EvalValue *value = (EvalValue *) ArenaCalloc(&state->arena, 1, sizeof(EvalValue));
+				unsigned long long bits = (unsigned long long) lhs | (unsigned long long) rhs << 32;
+				value->type = EvalTypeNamed(node->token.type == TOK_DOUBLELIT ? "double" : "long long");
+				memcpy(&value->i, &bits, sizeof(bits));
+				node->constant = value;
+				break;
+			}
+			case AST_EXPRESSION:
+				node->expression.isConstexpr = node->token.type == TOK_CONSTEXPR;
+				node->expression.isCompiletime = node->token.type == TOK_COMPILETIME;
+				node->expression.body = ASTInflateChild(&in, lhs);
+				if ((extra = ASTInflateExtra(&in, rhs, 2))) {
+					node->expression.type = ASTInflateType(&in, extra[0]);
+					node->expression.name = ASTInflateString(&in, extra[1]);
+				}
+				break;
+			case AST_RETURN:
+				node->returnStatement.expression = ASTInflateChild(&in, lhs);
+				break;
+			case AST_CAST:
+			case AST_TYPENAME:
+				node->cast.value = ASTInflateChild(&in, lhs);
+				node->cast.type = ASTInflateType(&in, rhs);
+				break;
+			case AST_IMPORT:
+				node->import = ASTInflateString(&in, lhs);
+				break;
+			case AST_IF:
+				node->ifStatement.condition = ASTInflateChild(&in, lhs);
+				if ((extra = ASTInflateExtra(&in, rhs, 2))) {
+					node->ifStatement.then = ASTInflateChild(&in, extra[0]);
+					node->ifStatement.otherwise = ASTInflateChild(&in, extra[1]);
+				}
+				break;
+			case AST_WHILE:
+				node->loop.condition = ASTInflateChild(&in, lhs);
+				node->loop.body = ASTInflateChild(&in, rhs);
+				break;
+			case AST_FOR:
+				if ((extra = ASTInflateExtra(&in, rhs, 4))) {
+					node->loop.init = ASTInflateChild(&in, extra[0]);
+					node->loop.condition = ASTInflateChild(&in, extra[1]);
+					node->loop.step = ASTInflateChild(&in, extra[2]);
+					node->loop.body = ASTInflateChild(&in, extra[3]);
+				}
+				break;
+			case AST_GENERICARM:
+				node->arm.type = ASTInflateType(&in, lhs);
+				node->arm.body = ASTInflateList(&in, rhs);
+				break;
+			case AST_GENERIC:
+				if ((extra = ASTInflateExtra(&in, rhs, 5))) {
+					ASTIndex parameters = extra[3], arms = extra[4];
+					node->generic.returnType = ASTInflateType(&in, extra[0]);
+					node->generic.name = ASTInflateString(&in, extra[1]);
+					node->generic.typeParameter = ASTInflateType(&in, extra[2]);
+					node->generic.parameters = ASTInflateItems(&in, ASTInflateExtra(&in, rhs + 5, parameters), parameters);
+					node->generic.arms = ASTInflateItems(&in, ASTInflateExtra(&in, rhs + 5 + parameters, arms), arms);
+				}
+				break;
+			case AST_BREAK:
+			case AST_CONTINUE:
+				break;
+			default:
+				in.ok = false;
+				break;
+		}
+		in.nodes[in.index] = node;
+	}
+
+	ASTNode *result = in.ok ? in.nodes[root] : NULL;
+	free(in.nodes);
+	return result;
+}
+
+static const char *ASTFlatKindName(NodeType kind) {
+	static const char *names[] = {
+		"Declaration", "Scope", "Return", "Function", "Int", "Char", "Float", "String",
+		"Ternary", "Binary", "Unary", "Identifier", "Call", "Cast", "Type", "Import",
+		"If", "While", "For", "Break", "Continue", "Generic", "Arm", "Constant", "Error"
+	};
+	return kind <= AST_ERROR ? names[kind] : "?";
+}
+static const char *ASTFlatString(InternTable *strings, ASTIndex id) {
+	const char *str = InternLookup(strings, (int) id);
+	return str ? str : "?";
+}
+// One line per node in storage order, children as %index
+void ASTFlatVisualize(ASTFlat *ast, InternTable *strings) {
+	ASTIndex i, j;
+	for (i = 1; i < ast->count; i++) {
+		ASTIndex lhs = ast->lhs[i], rhs = ast->rhs[i];
+		printf("%%%u = %s", i, ASTFlatKindName((NodeType) ast->kind[i]));
+		switch (ast->kind[i]) {
+			case AST_INTLIT:
+				printf(" %llu", (unsigned long long) rhs << 32 | lhs);
+				break;
+			case AST_CHARLIT:
+				printf(" %u", lhs);
+				break;
+			case AST_FLOATLIT: {
+				unsigned long long bits = (unsigned long long) rhs << 32 | lhs;
+				double value;
+				memcpy(&value, &bits, sizeof(value));
+				printf(" %g", value);
+				break;
+			}
+			case AST_CONSTANT: {
+				unsigned long long bits = (unsigned long long) rhs << 32 | lhs;
+				double number;
+				memcpy(&number, &bits, sizeof(number));
+				if (ast->op[i] == TOK_DOUBLELIT) printf(" %g", number);
+				else printf(" %lld", (long long) bits);
+				break;
+			}
+			case AST_STRINGLIT:
+			case AST_IDENTIFIER:
+				printf(" %s", ASTFlatString(strings, lhs));
+				break;
+			case AST_BINARYOP:
+				printf(" %s %%%u %%%u", ASTOperatorText((TokenType) ast->op[i]), lhs, rhs);
+				break;
+			case AST_UNARYOP:
+				printf(" %s%s %%%u", ASTOperatorText((TokenType) ast->op[i]), rhs ? " postfix" : "", lhs);
+				break;
+			case AST_TERNARYOP:
+				printf(" %%%u ? %%%u : %%%u", lhs, ast->extra[rhs], ast->extra[rhs + 1]);
+				break;
+			case AST_CALL:
+				printf(" %%%u (", lhs);
+				for (j = 0; j < ast->extra[rhs]; j++) printf(j ? ", %%%u" : "%%%u", ast->extra[rhs + 1 + j]);
+				printf(")");
+				break;
+			case AST_SCOPE:
+				for (j = 0; j < ast->extra[rhs]; j++) printf(" %%%u", ast->extra[rhs + 1 + j]);
+				break;
+			case AST_FUNCTION:
+				printf(" (");
+				for (j = 0; j < ast->extra[rhs]; j++) printf(j ? ", %%%u" : "%%%u", ast->extra[rhs + 1 + j]);
+				printf(") %%%u", lhs);
+				break;
+			case AST_EXPRESSION:
+				if (ast->op[i] != TOK_EOF) printf(" %s", ast->op[i] == TOK_CONSTEXPR ? "constexpr" : "compiletime");
+				printf(" %s %s", ASTFlatString(strings, ast->extra[rhs]), ASTFlatString(strings, ast->extra[rhs + 1]));
+				if (lhs != AST_NONE) printf(" = %%%u", lhs);
+				break;
+			case AST_RETURN:
+				if (lhs != AST_NONE) printf(" %%%u", lhs);
+				break;
+			case AST_CAST:
+				printf(" (%s) %%%u", ASTFlatString(strings, rhs), lhs);
+				break;
+			case AST_TYPENAME:
+				printf(" %s", ASTFlatString(strings, rhs));
+				break;
+			case AST_IMPORT:
+				printf(" %s", ASTFlatString(strings, lhs));
+				break;
+			case AST_IF:
+				printf(" %%%u then %%%u else %%%u", lhs, ast->extra[rhs], ast->extra[rhs + 1]);
+				break;
+			case AST_WHILE:
+				printf(" %%%u do %%%u", lhs, rhs);
+				break;
+			case AST_FOR:
+				printf(" %%%u; %%%u; %%%u do %%%u", ast->extra[rhs], ast->extra[rhs + 1], ast->extra[rhs + 2], ast->extra[rhs + 3]);
+				break;
+			case AST_GENERICARM:
+				printf(" %s:", lhs == (ASTIndex) -1 ? "default" : ASTFlatString(strings, lhs));
+				for (j = 0; j < ast->extra[rhs]; j++) printf(" %%%u", ast->extra[rhs + 1 + j]);
+				break;
+			case AST_GENERIC:
+				printf(" %s %s<%s> (", ASTFlatString(strings, ast->extra[rhs]), ASTFlatString(strings, ast->extra[rhs + 1]), ASTFlatString(strings, ast->extra[rhs + 2]));
+				for (j = 0; j < ast->extra[rhs + 3]; j++) printf(j ? ", %%%u" : "%%%u", ast->extra[rhs + 5 + j]);
+				printf(")");
+				for (j = 0; j < ast->extra[rhs + 4]; j++) printf(" %%%u", ast->extra[rhs + 5 + ast->extra[rhs + 3] + j]);
+				break;
+		}
+		printf("\n");
+	}
+}
+void ASTFlatPrintStats(ASTFlat *ast, FILE *stream) {
+	size_t nodeBytes = 2 * sizeof(unsigned char) + sizeof(int) + 2 * sizeof(ASTIndex);
+	size_t bytes = ast->count * nodeBytes + ast->extraCount * sizeof(ASTIndex);
+	fprintf(stream, "Flat AST: %u nodes, %u extra slots, %.1f bytes/node (pointer AST: %zu bytes/node, %zu per list item)\n",
+		ast->count - 1, ast->extraCount, ast->count > 1 ? (double) bytes / (ast->count - 1) : 0.0,
+		sizeof(ASTNode), sizeof(ASTNodeNode));
+}
+void ASTFlatFree(ASTFlat *ast) {
+	free(ast->kind);
+	free(ast->op);
+	free(ast->offset);
+	free(ast->lhs);
+	free(ast->rhs);
+	free(ast->extra);
+	free(ast->nodes);
+	ast->nodes = NULL;
+	ast->kind = ast->op = NULL;
+	ast->offset = NULL;
+	ast->lhs = ast->rhs = ast->extra = NULL;
+	ast->count = ast->capacity = 0;
+	ast->extraCount = ast->extraCapacity = 0;
+}
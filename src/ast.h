@@ -0,0 +1,69 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stdint.h>
+#include "parser.h"
+
+typedef uint32_t ASTIndex;
+typedef struct ASTFlat ASTFlat;
+
+// Index 0 is reserved, a missing child is AST_NONE
+#define AST_NONE 0
+
+// The AST as parallel arrays indexed by node, children are 32-bit indices.
+// Module interfaces store their exports this way (see module.h): the arrays
+// are written out as they are and inflated back into a tree on import.
+// Nodes are stored in post-order: every child comes before its parent and
+// the root is the last node, so a bottom-up pass is one forward scan. The
+// folder runs as such a scan and --ast prints the arrays.
+// What lhs and rhs hold depends on the kind:
+//	AST_INTLIT		lhs low and rhs high half of the value
+//	AST_CHARLIT		lhs value
+//	AST_FLOATLIT		lhs low and rhs high half of the double's bits
+//	AST_STRINGLIT, AST_IDENTIFIER	lhs intern id
+//	AST_BINARYOP		lhs left, rhs right
+//	AST_UNARYOP		lhs value, rhs 1 when postfix
+//	AST_TERNARYOP		lhs condition, rhs extra: true, false
+//	AST_CALL		lhs callee, rhs extra: count, arguments...
+//	AST_SCOPE		rhs extra: count, statements...
+//	AST_EXPRESSION		lhs body, rhs extra: type id, name id, op TOK_CONSTEXPR,
+//				TOK_COMPILETIME or TOK_EOF
+//	AST_RETURN		lhs expression
+//	AST_FUNCTION		lhs body, rhs extra: count, parameters...
+//	AST_CAST, AST_TYPENAME	lhs value, rhs type id
+//	AST_IMPORT		lhs path id
+//	AST_IF			lhs condition, rhs extra: then, else
+//	AST_WHILE		lhs condition, rhs body
+//	AST_FOR			rhs extra: init, condition, step, body
+//	AST_CONSTANT		lhs low and rhs high half of the value's bits, op TOK_DOUBLELIT
+//				for floats and TOK_LONGLONGLIT for integers
+//	AST_GENERICARM		lhs type id, -1 for default, rhs extra: count, statements...
+//	AST_GENERIC		rhs extra: return type id, name id, type parameter id,
+//				parameter count, arm count, parameters..., arms...
+struct ASTFlat {
+	unsigned char *kind;	// NodeType
+	unsigned char *op;	// TokenType of the operator or literal
+	int *offset;		// Source offset of the node's token
+	ASTIndex *lhs;
+	ASTIndex *rhs;
+	ASTIndex count;
+	ASTIndex capacity;
+	ASTIndex *extra;	// Variable-length child lists
+	ASTIndex extraCount;
+	ASTIndex extraCapacity;
+	ASTNode **nodes;	// Tree node of each index, NULL unless ASTFlatKeepNodes was called
+};
+
+bool ASTFlatInit(ASTFlat *ast, ASTIndex capacity);
+ASTIndex ASTFlatPush(ASTFlat *ast, NodeType kind, TokenType op, int offset, ASTIndex lhs, ASTIndex rhs);
+ASTIndex ASTFlatPushExtra(ASTFlat *ast, const ASTIndex *items, ASTIndex count);
+bool ASTFlatKeepNodes(ASTFlat *ast);
+ASTIndex *ASTFlatChild(ASTFlat *ast, ASTIndex index, ASTIndex i);
+ASTIndex ASTFlatten(ASTFlat *ast, InternTable *strings, ASTNode *root);
+void ASTFlatRelink(const ASTFlat *ast, ASTIndex index);
+ASTNode *ASTInflate(CompilerState *state, const ASTFlat *ast, const char *const *strings, ASTIndex stringCount, ASTIndex root, Token origin);
+void ASTFlatVisualize(ASTFlat *ast, InternTable *strings);
+void ASTFlatPrintStats(ASTFlat *ast, FILE *stream);
+void ASTFlatFree(ASTFlat *ast);
+
+#endif
@@ -0,0 +1,66 @@
+#include <stdarg.h>
+#include "buffer.h"
+
+void BufferInit(Buffer *b, size_t capacity) {
+	b->data = NULL;
+	b->length = 0;
+	b->capacity = 0;
+	if (capacity) BufferReserve(b, capacity);
+}
+// Makes room for extra more bytes plus a terminating NUL
+void BufferReserve(Buffer *b, size_t extra) {
+	if (b->length + extra < b->capacity) return;
+
+	size_t capacity = b->capacity ? b->capacity : 256;
+	while (capacity <= b->length + extra) capacity *= 2;
+	char *data = (char *) realloc(b->data, capacity);
+	if (data == NULL) {
+		fprintf(stderr, "Out of memory for output buffer.\n");
+		exit(1);
+	}
+	b->data = data;
+	b->capacity = capacity;
+}
+void BufferAppend(Buffer *b, const char *data, size_t length) {
+	BufferReserve(b, length);
+	memcpy(b->data + b->length, data, length);
+	b->length += length;
+	b->data[b->length] = '\0';
+}
+void BufferAppendString(Buffer *b, const char *str) {
+	BufferAppend(b, str, strlen(str));
+}
+void BufferAppendChar(Buffer *b, char c) {
+	BufferReserve(b, 1);
+	b->data[b->length++] = c;
+	b->data[b->length] = '\0';
+}
+void BufferAppendf(Buffer *b, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(b->data ? b->data + b->length : NULL, b->data ? b->capacity - b->length : 0, format, args);
+	va_end(args);
+	if (length < 0) return;
+
+	// Didn't fit: grow and format again
+	if (b->data == NULL || b->length + length >= b->capacity) {
+		BufferReserve(b, (size_t) length);
+		va_start(args, format);
+		vsnprintf(b->data + b->length, b->capacity - b->length, format, args);
+		va_end(args);
+	}
+	b->length += length;
+}
+// Writes the whole buffer with a single call and empties it
+bool BufferWrite(Buffer *b, FILE *stream) {
+	bool ok = b->length == 0 || fwrite(b->data, 1, b->length, stream) == b->length;
+	fflush(stream);
+	b->length = 0;
+	return ok;
+}
+void BufferFree(Buffer *b) {
+	free(b->data);
+	b->data = NULL;
+	b->length = 0;
+	b->capacity = 0;
+}
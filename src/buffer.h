@@ -0,0 +1,27 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct Buffer Buffer;
+
+// Growable byte buffer for output that is built up and written in one go
+struct Buffer {
+	char *data;
+	size_t length;
+	size_t capacity;
+};
+
+void BufferInit(Buffer *b, size_t capacity);
+void BufferReserve(Buffer *b, size_t extra);
+void BufferAppend(Buffer *b, const char *data, size_t length);
+void BufferAppendString(Buffer *b, const char *str);
+void BufferAppendChar(Buffer *b, char c);
+void BufferAppendf(Buffer *b, const char *format, ...) __attribute__((format(printf, 2, 3)));
+bool BufferWrite(Buffer *b, FILE *stream);
+void BufferFree(Buffer *b);
+
+#endif
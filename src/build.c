@@ -0,0 +1,97 @@
+#include <limits.h>
+#include <sys/mman.h>
+#include "build.h"
+
+void BuildCacheInit(BuildCache *cache, ModuleCache *modules) {
+	*cache = (BuildCache) { 0 };
+	cache->modules = modules;
+	pthread_mutex_init(&cache->lock, NULL);
+}
+void BuildCacheFree(BuildCache *cache) {
+	pthread_mutex_destroy(&cache->lock);
+}
+static void BuildEntryName(uint64_t key, char *name, size_t size) {
+	snprintf(name, size, "%016llx.czyc", (unsigned long long) key);
+}
+
+// Key of the C for a file: the compiler, its source, where it is (imports
+// resolve next to it) and the options that change the C. 0 for files that
+// cannot be cached, such as standard input.
+uint64_t BuildCacheKey(BuildCache *cache, const char *path, const char *source, size_t length, bool fold, long evalSteps) {
+	char canonical[PATH_MAX];
+	uint32_t version = BUILD_VERSION;
+	if (strcmp(path, "-") == 0 || realpath(path, canonical) == NULL) return 0;
+	uint64_t key = ModuleHashUpdate(MODULE_HASH_SEED, &cache->modules->compiler, sizeof(cache->modules->compiler));
+	key = ModuleHashUpdate(key, &version, sizeof(version));
+	key = ModuleHashUpdate(key, &fold, sizeof(fold));
+	key = ModuleHashUpdate(key, &evalSteps, sizeof(evalSteps));
+	key = ModuleHashUpdate(key, canonical, strlen(canonical) + 1);
+	key = ModuleHashUpdate(key, source, length);
+	return key ? key : 1;
+}
+// Whether the entry mapped at data is whole and every module it was
+// translated against still has the same source
+static bool BuildEntryCurrent(BuildCache *cache, const char *data, size_t length, uint64_t key) {
+	const BuildEntry *entry = (const BuildEntry *) data;
+	if (length < sizeof(BuildEntry) || memcmp(entry->magic, "CZYC", 4) != 0 || entry->version != BUILD_VERSION || entry->key != key) return false;
+	size_t hashBytes = (size_t) entry->dependencyCount * sizeof(uint64_t);
+	size_t rest = length - sizeof(BuildEntry);
+	if (rest < hashBytes || rest - hashBytes < entry->pathBytes || rest - hashBytes - entry->pathBytes != entry->outputLength) return false;
+
+	const uint64_t *hashes = (const uint64_t *) (data + sizeof(BuildEntry));
+	const char *paths = data + sizeof(BuildEntry) + hashBytes;
+	const char *end = paths + entry->pathBytes;
+	uint32_t i;
+	for (i = 0; i < entry->dependencyCount; i++) {
+		const char *terminator = (const char *) memchr(paths, '\0', (size_t) (end - paths));
+		uint64_t hash;
+		if (terminator == NULL || !ModuleSourceHash(cache->modules, paths, &hash) || hash != hashes[i]) return false;
+		paths = terminator + 1;
+	}
+	return true;
+}
+// Appends the C cached for key to out when nothing it depends on changed
+bool BuildCacheLookup(BuildCache *cache, uint64_t key, Buffer *out) {
+	char name[32], path[MODULE_MAX_PATH];
+	size_t length = 0;
+	bool hit = false;
+	if (key == 0 || cache->modules->directory == NULL) return false;
+	BuildEntryName(key, name, sizeof(name));
+	snprintf(path, sizeof(path), "%s/%s", cache->modules->directory, name);
+	const char *data = (const char *) ModuleMapFile(path, &length);
+	if (data && BuildEntryCurrent(cache, data, length, key)) {
+		const BuildEntry *entry = (const BuildEntry *) data;
+		BufferAppend(out, data + length - entry->outputLength, (size_t) entry->outputLength);
+		hit = true;
+	}
+	if (data) munmap((void *) data, length);
+
+	pthread_mutex_lock(&cache->lock);
+	if (hit) cache->hits++;
+	else cache->misses++;
+	pthread_mutex_unlock(&cache->lock);
+	return hit;
+}
+// Keeps c, translated by state, for key. Only files that reported nothing
+// are kept, so warnings are shown again on every run until fixed.
+void BuildCacheStore(BuildCache *cache, uint64_t key, CompilerState *state, Buffer *c) {
+	char name[32];
+	Buffer entry;
+	int i;
+	if (key == 0 || cache->modules->directory == NULL || state->hadError || state->diagnostics.count) return;
+
+	BuildEntry header = { { 'C', 'Z', 'Y', 'C' }, BUILD_VERSION, key, (uint32_t) state->importCount, 0, c->length };
+	for (i = 0; i < state->importCount; i++) header.pathBytes += (uint32_t) strlen(state->imports[i]) + 1;
+	BufferInit(&entry, sizeof(header) + header.dependencyCount * sizeof(uint64_t) + header.pathBytes + c->length);
+	BufferAppend(&entry, (const char *) &header, sizeof(header));
+	BufferAppend(&entry, (const char *) state->importHashes, header.dependencyCount * sizeof(uint64_t));
+	for (i = 0; i < state->importCount; i++) BufferAppend(&entry, state->imports[i], strlen(state->imports[i]) + 1);
+	BufferAppend(&entry, c->data, c->length);
+
+	BuildEntryName(key, name, sizeof(name));
+	ModuleCacheWrite(cache->modules, name, &entry);
+	BufferFree(&entry);
+}
+void BuildCachePrintStats(BuildCache *cache, FILE *stream) {
+	fprintf(stream, "Build cache: %ld hits, %ld misses\n", cache->hits, cache->misses);
+}
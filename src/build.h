@@ -0,0 +1,41 @@
+#ifndef BUILD_H
+#define BUILD_H
+
+#include "module.h"
+
+// Bumped whenever the layout of an entry changes
+#define BUILD_VERSION 1
+
+typedef struct BuildEntry BuildEntry;
+typedef struct BuildCache BuildCache;
+
+// Start of a cached translation, kept next to the module interfaces as
+// <key>.czyc. After it come the source hash of every module the file
+// imported, directly or through other modules (uint64_t each), their
+// canonical paths, each '\0' terminated, then the C.
+struct BuildEntry {
+	char magic[4];		// "CZYC"
+	uint32_t version;
+	uint64_t key;		// Of the compiler, the file's source, path and options
+	uint32_t dependencyCount;
+	uint32_t pathBytes;
+	uint64_t outputLength;
+};
+// Reuses the C of files whose source, and the sources of the modules they
+// import, have not changed since it was emitted. A module's interface is
+// named by the hash of its source, so comparing sources covers interfaces.
+struct BuildCache {
+	ModuleCache *modules;	// Whose directory the entries go in, and source hashes
+	pthread_mutex_t lock;	// Guards everything below
+	long hits;		// Files whose C was reused
+	long misses;		// Files translated again
+};
+
+void BuildCacheInit(BuildCache *cache, ModuleCache *modules);
+void BuildCacheFree(BuildCache *cache);
+uint64_t BuildCacheKey(BuildCache *cache, const char *path, const char *source, size_t length, bool fold, long evalSteps);
+bool BuildCacheLookup(BuildCache *cache, uint64_t key, Buffer *out);
+void BuildCacheStore(BuildCache *cache, uint64_t key, CompilerState *state, Buffer *c);
+void BuildCachePrintStats(BuildCache *cache, FILE *stream);
+
+#endif
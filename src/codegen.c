@@ -0,0 +1,775 @@
+#include "codegen.h"
+#include "module.h"
+
+static void CodegenStatement(Codegen *gen, ASTNode *node);
+static void CodegenExpression(Codegen *gen, ASTNode *node, Precedence minimum);
+
+static void CodegenError(Codegen *gen, ASTNode *node, const char *message) {
+	ERROR_AT(gen->state, node->token.line, node->token.column, message);
+	// Each error here stands alone, there is nothing to resynchronize
+	ExitPanicMode(gen->state);
+	gen->failed = true;
+}
+static void CodegenIndent(Codegen *gen) {
+	int i;
+	BufferReserve(gen->out, gen->depth);
+	for (i = 0; i < gen->depth; i++) gen->out->data[gen->out->length++] = '\t';
+	gen->out->data[gen->out->length] = '\0';
+}
+static void CodegenTokenText(Codegen *gen, Token token) {
+	BufferAppend(gen->out, gen->state->source + token.offset, token.length);
+}
+// A literal as written; one imported from a module has no source text here,
+// so its value is printed instead
+static void CodegenLiteral(Codegen *gen, ASTNode *node) {
+	EvalValue value;
+	if (node->token.length) CodegenTokenText(gen, node->token);
+	else if (!EvalLiteral(&gen->eval, node, &value) || !EvalFormat(value, gen->out)) CodegenError(gen, node, "The value has no C literal");
+}
+
+// A declared type as it is inside the current instance
+static const Type *CodegenResolve(Codegen *gen, const Type *type) {
+	return TypeSubstitute(&gen->state->types, type, gen->typeParameter, gen->typeArgument);
+}
+// Czy type names are C's, except string and bool, and T inside a generic
+static void CodegenType(Codegen *gen, const Type *resolved) {
+	const char *type = CodegenResolve(gen, resolved)->name;
+	bool first = true;
+	while (*type) {
+		const char *end = strchr(type, ' ');
+		size_t length = end ? (size_t) (end - type) : strlen(type);
+		// char * * reads as char **
+		if (!first && !(type[0] == '*' && gen->out->data[gen->out->length - 1] == '*')) BufferAppendChar(gen->out, ' ');
+		first = false;
+
+		if (length == 6 && memcmp(type, "string", 6) == 0) BufferAppendString(gen->out, "char *");
+		else if (length == 4 && memcmp(type, "bool", 4) == 0) BufferAppendString(gen->out, "_Bool");
+		else BufferAppend(gen->out, type, length);
+		type += length;
+		while (*type == ' ') type++;
+	}
+}
+// type name, with the name right after a trailing '*'
+static void CodegenDeclarator(Codegen *gen, const Type *type, const char *name) {
+	CodegenType(gen, type);
+	if (gen->out->length && gen->out->data[gen->out->length - 1] != '*') BufferAppendChar(gen->out, ' ');
+	BufferAppendString(gen->out, name);
+}
+
+static CodegenBinding *CodegenBind(Codegen *gen, const char *name, const Type *type, ASTNode *node) {
+	if (gen->bindingCount == gen->bindingCapacity) {
+		int capacity = gen->bindingCapacity ? gen->bindingCapacity * 2 : 64;
+		CodegenBinding *bindings = (CodegenBinding *) realloc(gen->bindings, capacity * sizeof(CodegenBinding));
+		if (bindings == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		gen->bindings = bindings;
+		gen->bindingCapacity = capacity;
+	}
+	gen->bindings[gen->bindingCount] = (CodegenBinding) { .name = name, .type = CodegenResolve(gen, type), .node = node };
+	SymbolDeclare(&gen->locals, name, node, gen->bindingCount);
+	return &gen->bindings[gen->bindingCount++];
+}
+// Locals bound until the matching CodegenScopeClose go out of scope there
+static int CodegenScopeOpen(Codegen *gen) {
+	SymbolScopePush(&gen->locals);
+	return gen->bindingCount;
+}
+static void CodegenScopeClose(Codegen *gen, int scope) {
+	SymbolScopePop(&gen->locals);
+	gen->bindingCount = scope;
+}
+// File scope names go in a table keyed by the interned name's address, a
+// file can have far more of them than a function has locals
+static unsigned int CodegenNameHash(const char *name) {
+	uintptr_t key = (uintptr_t) name;
+	key ^= key >> 17;
+	key *= 0xed5ad4bbu;
+	key ^= key >> 11;
+	return (unsigned int) key;
+}
+static CodegenBinding *CodegenBindGlobal(Codegen *gen, const char *name, const Type *type, ASTNode *node) {
+	unsigned int i, mask;
+	if ((gen->globalCount + 1) * 2 > gen->globalCapacity) {
+		int capacity = gen->globalCapacity ? gen->globalCapacity * 2 : 256;
+		CodegenBinding *globals = (CodegenBinding *) calloc(capacity, sizeof(CodegenBinding));
+		if (globals == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		int j;
+		for (j = 0; j < gen->globalCapacity; j++) {
+			if (gen->globals[j].name == NULL) continue;
+			i = CodegenNameHash(gen->globals[j].name) & (capacity - 1);
+			while (globals[i].name) i = (i + 1) & (capacity - 1);
+			globals[i] = gen->globals[j];
+		}
+		free(gen->globals);
+		gen->globals = globals;
+		gen->globalCapacity = capacity;
+	}
+	mask = gen->globalCapacity - 1;
+	i = CodegenNameHash(name) & mask;
+	while (gen->globals[i].name && gen->globals[i].name != name) i = (i + 1) & mask;
+	if (gen->globals[i].name == NULL) gen->globalCount++;
+	gen->globals[i] = (CodegenBinding) { .name = name, .type = type, .node = node };
+	return &gen->globals[i];
+}
+static CodegenBinding *CodegenLookupGlobal(Codegen *gen, const char *name) {
+	if (gen->globalCapacity == 0) return NULL;
+	unsigned int mask = gen->globalCapacity - 1, j = CodegenNameHash(name) & mask;
+	while (gen->globals[j].name) {
+		if (gen->globals[j].name == name) return &gen->globals[j];
+		j = (j + 1) & mask;
+	}
+	return NULL;
+}
+static CodegenBinding *CodegenLookup(Codegen *gen, const char *name) {
+	Symbol *local = SymbolFind(&gen->locals, name);
+	return local ? &gen->bindings[local->index] : CodegenLookupGlobal(gen, name);
+}
+static ASTNode *CodegenGenericOf(CodegenBinding *binding) {
+	return binding && binding->node && binding->node->type == AST_GENERIC ? binding->node : NULL;
+}
+static bool CodegenIsFunction(ASTNode *node) {
+	return node->type == AST_EXPRESSION && node->expression.body && node->expression.body->type == AST_FUNCTION;
+}
+// Names for the compile-time evaluator, which sees constants and functions
+static bool CodegenResolveName(void *context, const char *name, bool globalOnly, EvalName *result) {
+	Codegen *gen = (Codegen *) context;
+	CodegenBinding *binding = globalOnly ? CodegenLookupGlobal(gen, name) : CodegenLookup(gen, name);
+	if (binding == NULL) return false;
+	result->constant = binding->constant;
+	result->value = binding->value;
+	result->function = binding->node && CodegenIsFunction(binding->node) ? binding->node : NULL;
+	return true;
+}
+
+static const Type *CodegenBuiltin(Codegen *gen, TypeBuiltin builtin) {
+	return gen->state->types.builtins[builtin];
+}
+// Type of a + b: pointer arithmetic keeps the pointer, numbers convert to
+// the wider operand and nothing is narrower than int
+static const Type *CodegenCommonType(Codegen *gen, const Type *a, const Type *b) {
+	if (a == NULL || b == NULL) return NULL;
+	if (a->kind == TYPE_POINTER) return a;
+	if (b->kind == TYPE_POINTER) return b;
+	if (a->rank == 0 || b->rank == 0) return a == b ? a : NULL;
+	if (a->rank <= 1 && b->rank <= 1) return CodegenBuiltin(gen, TYPE_INT);
+	return a->rank >= b->rank ? a : b;
+}
+// What a pointer or string points to
+static const Type *CodegenPointee(const Type *type) {
+	return type ? type->base : NULL;
+}
+
+static MonoInstance *CodegenInstantiate(Codegen *gen, ASTNode *call, ASTNode *generic);
+// Static type of an expression as far as generic calls need it, NULL when
+// it can't be told without a full type checker
+static const Type *CodegenTypeOf(Codegen *gen, ASTNode *node) {
+	CodegenBinding *binding;
+	switch (node->type) {
+		case AST_INTLIT:
+			switch (node->token.type) {
+				case TOK_LONGLIT: return CodegenBuiltin(gen, TYPE_LONG);
+				case TOK_LONGLONGLIT: return CodegenBuiltin(gen, TYPE_LONG_LONG);
+				case TOK_UNSIGNEDLIT: return CodegenBuiltin(gen, TYPE_UNSIGNED_INT);
+				case TOK_UNSIGNEDLONGLIT: return CodegenBuiltin(gen, TYPE_UNSIGNED_LONG);
+				case TOK_UNSIGNEDLONGLONGLIT: return CodegenBuiltin(gen, TYPE_UNSIGNED_LONG_LONG);
+				case TOK_TRUE: case TOK_FALSE: return CodegenBuiltin(gen, TYPE_BOOL);
+				case TOK_NULLPTR: return TypePointer(&gen->state->types, CodegenBuiltin(gen, TYPE_VOID));
+				default: return CodegenBuiltin(gen, TYPE_INT);
+			}
+		case AST_FLOATLIT:
+			if (node->token.type == TOK_FLOATLIT) return CodegenBuiltin(gen, TYPE_FLOAT);
+			return CodegenBuiltin(gen, node->token.type == TOK_LONGDOUBLELIT ? TYPE_LONG_DOUBLE : TYPE_DOUBLE);
+		case AST_CHARLIT:
+			return CodegenBuiltin(gen, TYPE_CHAR);
+		case AST_CONSTANT:
+			return TypeFromText(&gen->state->types, node->constant->type->name);
+		case AST_STRINGLIT:
+			return CodegenBuiltin(gen, TYPE_STRING);
+		case AST_IDENTIFIER:
+			binding = CodegenLookup(gen, node->identifier);
+			return binding && CodegenGenericOf(binding) == NULL ? binding->type : NULL;
+		case AST_CAST:
+			return CodegenResolve(gen, node->cast.type);
+		case AST_CALL:
+			if (node->call.callee->type != AST_IDENTIFIER) return NULL;
+			binding = CodegenLookup(gen, node->call.callee->identifier);
+			if (binding == NULL) return NULL;
+			if (CodegenGenericOf(binding)) {
+				ASTNode *generic = binding->node;
+				MonoInstance *instance = CodegenInstantiate(gen, node, generic);
+				if (instance == NULL) return NULL;
+				return TypeSubstitute(&gen->state->types, generic->generic.returnType, generic->generic.typeParameter, instance->type);
+			}
+			return binding->type;
+		case AST_TERNARYOP:
+			return CodegenCommonType(gen, CodegenTypeOf(gen, node->ternaryOp.trueValue), CodegenTypeOf(gen, node->ternaryOp.falseValue));
+		case AST_UNARYOP:
+			switch (node->unaryOp.op) {
+				case TOK_NOT: return CodegenBuiltin(gen, TYPE_INT);
+				case TOK_SIZEOF: return CodegenBuiltin(gen, TYPE_UNSIGNED_LONG);
+				case TOK_STAR: return CodegenPointee(CodegenTypeOf(gen, node->unaryOp.value));
+				case TOK_BITAND: return TypePointer(&gen->state->types, CodegenTypeOf(gen, node->unaryOp.value));
+				case TOK_PLUSPLUS: case TOK_MINUSMINUS: return CodegenTypeOf(gen, node->unaryOp.value);
+				default: return CodegenCommonType(gen, CodegenTypeOf(gen, node->unaryOp.value), CodegenBuiltin(gen, TYPE_INT));
+			}
+		case AST_BINARYOP:
+			switch (node->binaryOp.op) {
+				case TOK_OPENBRACKET:
+					return CodegenPointee(CodegenTypeOf(gen, node->binaryOp.left));
+				case TOK_DOT: case TOK_ARROW:
+					return NULL;
+				case TOK_EQUAL: case TOK_NOTEQUAL: case TOK_LESSERTHAN: case TOK_GREATERTHAN:
+				case TOK_LESSEROREQUAL: case TOK_GREATEROREQUAL: case TOK_AND: case TOK_OR:
+					return CodegenBuiltin(gen, TYPE_INT);
+				case TOK_LSHIFT: case TOK_RSHIFT:
+					return CodegenCommonType(gen, CodegenTypeOf(gen, node->binaryOp.left), CodegenBuiltin(gen, TYPE_INT));
+				default:
+					if (ASTInfixPrecedence(node->binaryOp.op) == PREC_ASSIGNMENT) return CodegenTypeOf(gen, node->binaryOp.left);
+					return CodegenCommonType(gen, CodegenTypeOf(gen, node->binaryOp.left), CodegenTypeOf(gen, node->binaryOp.right));
+			}
+		default:
+			return NULL;
+	}
+}
+// The instance a call to a generic needs: the type argument is the type of
+// the argument passed for the first parameter declared as T
+static MonoInstance *CodegenInstantiate(Codegen *gen, ASTNode *call, ASTNode *generic) {
+	ASTNodeNode *parameter, *argument = call->call.arguments->first;
+	char message[256];
+	if (call->call.arguments->length != generic->generic.parameters->length) {
+		snprintf(message, sizeof(message), "%s takes %d arguments, %d given", generic->generic.name, generic->generic.parameters->length, call->call.arguments->length);
+		CodegenError(gen, call->call.callee, message);
+		return NULL;
+	}
+	for (parameter = generic->generic.parameters->first; parameter; parameter = parameter->prev, argument = argument->prev) {
+		if (parameter->node->type == AST_EXPRESSION && parameter->node->expression.type == generic->generic.typeParameter) break;
+	}
+	if (parameter == NULL) {
+		CodegenError(gen, call, "No parameter of the generic function has its type parameter's type");
+		return NULL;
+	}
+
+	const Type *type = CodegenTypeOf(gen, argument->node);
+	if (type == NULL) {
+		snprintf(message, sizeof(message), "Cannot tell the type %s stands for in this call to %s", generic->generic.typeParameter->name, generic->generic.name);
+		CodegenError(gen, argument->node, message);
+		return NULL;
+	}
+	MonoInstance *instance = MonoInstantiate(&gen->instances, &gen->state->strings, &gen->state->symbols, generic, type);
+	if (instance == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	if (instance->arm == NULL) {
+		snprintf(message, sizeof(message), "%s has no arm for %s and no default", generic->generic.name, type->name);
+		CodegenError(gen, call->call.callee, message);
+		return NULL;
+	}
+	return instance;
+}
+
+static Precedence CodegenPrecedence(ASTNode *node) {
+	switch (node->type) {
+		case AST_BINARYOP:
+			if (node->binaryOp.op == TOK_OPENBRACKET || node->binaryOp.op == TOK_DOT || node->binaryOp.op == TOK_ARROW) return PREC_POSTFIX;
+			return ASTInfixPrecedence(node->binaryOp.op);
+		case AST_TERNARYOP:
+			return PREC_TERNARY;
+		case AST_UNARYOP:
+			return node->unaryOp.postfix ? PREC_POSTFIX : PREC_UNARY;
+		case AST_CALL:
+			return PREC_POSTFIX;
+		case AST_CAST:
+			return PREC_UNARY;
+		default:
+			return PREC_PRIMARY;
+	}
+}
+// Operands of || and the bit and shift operators that are themselves a
+// different binary operator get parentheses C doesn't need but -Wall wants
+static Precedence CodegenOperandMinimum(ASTNode *operand, Precedence parent, Precedence minimum) {
+	Precedence precedence = CodegenPrecedence(operand);
+	if (operand->type != AST_BINARYOP || parent < PREC_OR || parent > PREC_SHIFT || parent == PREC_EQUALITY || parent == PREC_COMPARISON) return minimum;
+	if (precedence == parent || precedence >= PREC_POSTFIX) return minimum;
+	return PREC_PRIMARY;
+}
+static void CodegenList(Codegen *gen, ASTQueue *items) {
+	ASTNodeNode *item;
+	for (item = items->first; item; item = item->prev) {
+		CodegenExpression(gen, item->node, PREC_ASSIGNMENT);
+		if (item->prev) BufferAppend(gen->out, ", ", 2);
+	}
+}
+static void CodegenEvalError(Codegen *gen, ASTNode *node) {
+	CodegenError(gen, gen->eval.errorNode ? gen->eval.errorNode : node, gen->eval.error ? gen->eval.error : "Cannot be evaluated at compile time");
+}
+// A call to a constexpr function becomes its result when its arguments are
+// constants, a call to a compiletime one always does. False when the call
+// is left to run time. Running out of time is an error instead, since how
+// long it took depends on the machine and must not decide the C.
+static bool CodegenFold(Codegen *gen, ASTNode *call, ASTNode *function) {
+	EvalValue value;
+	if (!function->expression.isConstexpr && !function->expression.isCompiletime) return false;
+	if (EvalExpression(&gen->eval, call, &value)) {
+		if (EvalFormat(value, gen->out)) return true;
+		gen->eval.errorNode = call;
+		gen->eval.error = "The result has no C literal";
+	}
+	if (function->expression.isCompiletime || gen->eval.timedOut) {
+		CodegenEvalError(gen, call);
+		BufferAppendChar(gen->out, '0');
+		return true;
+	}
+	if (gen->eval.exhausted) {
+		char message[256];
+		snprintf(message, sizeof(message), "%s, %s is called at run time instead", gen->eval.error, function->expression.name);
+		WARNING_AT(gen->state, call->token.line, call->token.column, message);
+	}
+	return false;
+}
+// Parenthesizes only where the tree binds tighter than C would read it
+static void CodegenExpression(Codegen *gen, ASTNode *node, Precedence minimum) {
+	Precedence precedence = CodegenPrecedence(node);
+	bool parenthesize = precedence < minimum;
+	if (parenthesize) BufferAppendChar(gen->out, '(');
+
+	switch (node->type) {
+		case AST_INTLIT:
+			if (node->token.type == TOK_TRUE) BufferAppendChar(gen->out, '1');
+			else if (node->token.type == TOK_FALSE) BufferAppendChar(gen->out, '0');
+			else if (node->token.type == TOK_NULLPTR) BufferAppendString(gen->out, "((void *) 0)");
+			else CodegenLiteral(gen, node);
+			break;
+		case AST_CHARLIT:
+		case AST_FLOATLIT:
+			CodegenLiteral(gen, node);
+			break;
+		case AST_STRINGLIT:
+			BufferAppendString(gen->out, node->stringLit);
+			break;
+		case AST_CONSTANT:
+			if (!EvalFormat(*node->constant, gen->out)) CodegenError(gen, node, "The value has no C literal");
+			break;
+		case AST_IDENTIFIER: {
+			// compiletime constants exist only as their value
+			CodegenBinding *binding = CodegenLookup(gen, node->identifier);
+			if (binding && binding->constant && binding->node->expression.isCompiletime) EvalFormat(binding->value, gen->out);
+			else BufferAppendString(gen->out, node->identifier);
+			break;
+		}
+		case AST_BINARYOP:
+			if (node->binaryOp.op == TOK_OPENBRACKET) {
+				CodegenExpression(gen, node->binaryOp.left, PREC_POSTFIX);
+				BufferAppendChar(gen->out, '[');
+				CodegenExpression(gen, node->binaryOp.right, PREC_ASSIGNMENT);
+				BufferAppendChar(gen->out, ']');
+			}
+			else if (precedence == PREC_POSTFIX) {
+				CodegenExpression(gen, node->binaryOp.left, PREC_POSTFIX);
+				BufferAppendString(gen->out, ASTOperatorText(node->binaryOp.op));
+				CodegenExpression(gen, node->binaryOp.right, PREC_PRIMARY);
+			}
+			else {
+				// Assignments group to the right, everything else to the left
+				bool right = precedence == PREC_ASSIGNMENT;
+				ASTNode *left = node->binaryOp.left, *rhs = node->binaryOp.right;
+				CodegenExpression(gen, left, right ? PREC_UNARY : CodegenOperandMinimum(left, precedence, precedence));
+				BufferAppendChar(gen->out, ' ');
+				BufferAppendString(gen->out, ASTOperatorText(node->binaryOp.op));
+				BufferAppendChar(gen->out, ' ');
+				CodegenExpression(gen, rhs, right ? precedence : CodegenOperandMinimum(rhs, precedence, (Precedence) (precedence + 1)));
+			}
+			break;
+		case AST_TERNARYOP:
+			CodegenExpression(gen, node->ternaryOp.condition, PREC_OR);
+			BufferAppend(gen->out, " ? ", 3);
+			CodegenExpression(gen, node->ternaryOp.trueValue, PREC_ASSIGNMENT);
+			BufferAppend(gen->out, " : ", 3);
+			CodegenExpression(gen, node->ternaryOp.falseValue, PREC_TERNARY);
+			break;
+		case AST_UNARYOP:
+			if (node->unaryOp.postfix) {
+				CodegenExpression(gen, node->unaryOp.value, PREC_POSTFIX);
+				BufferAppendString(gen->out, ASTOperatorText(node->unaryOp.op));
+			}
+			else if (node->unaryOp.op == TOK_SIZEOF) {
+				BufferAppendString(gen->out, "sizeof(");
+				if (node->unaryOp.value->type == AST_TYPENAME) CodegenType(gen, node->unaryOp.value->cast.type);
+				else CodegenExpression(gen, node->unaryOp.value, PREC_ASSIGNMENT);
+				BufferAppendChar(gen->out, ')');
+			}
+			else {
+				const char *op = ASTOperatorText(node->unaryOp.op);
+				ASTNode *value = node->unaryOp.value;
+				BufferAppendString(gen->out, op);
+				// - -x and + +x must not run together into -- and ++
+				if (value->type == AST_UNARYOP && !value->unaryOp.postfix && ASTOperatorText(value->unaryOp.op)[0] == op[0]) BufferAppendChar(gen->out, ' ');
+				CodegenExpression(gen, value, PREC_UNARY);
+			}
+			break;
+		case AST_CALL:
+			// Calls to a generic go straight to the instance for their type
+			if (node->call.callee->type == AST_IDENTIFIER) {
+				CodegenBinding *binding = CodegenLookup(gen, node->call.callee->identifier);
+				if (CodegenGenericOf(binding)) {
+					MonoInstance *instance = CodegenInstantiate(gen, node, binding->node);
+					BufferAppendString(gen->out, instance ? instance->name : binding->node->generic.name);
+				}
+				else if (binding && binding->node && CodegenIsFunction(binding->node) && CodegenFold(gen, node, binding->node)) break;
+				else CodegenExpression(gen, node->call.callee, PREC_POSTFIX);
+			}
+			else CodegenExpression(gen, node->call.callee, PREC_POSTFIX);
+			BufferAppendChar(gen->out, '(');
+			CodegenList(gen, node->call.arguments);
+			BufferAppendChar(gen->out, ')');
+			break;
+		case AST_CAST:
+			BufferAppendChar(gen->out, '(');
+			CodegenType(gen, node->cast.type);
+			BufferAppend(gen->out, ") ", 2);
+			CodegenExpression(gen, node->cast.value, PREC_UNARY);
+			break;
+		default:
+			CodegenError(gen, node, "Expression cannot be translated to C");
+			break;
+	}
+
+	if (parenthesize) BufferAppendChar(gen->out, ')');
+}
+
+static bool CodegenIsCompiletime(ASTNode *node) {
+	return node->type == AST_EXPRESSION && node->expression.isCompiletime;
+}
+// Evaluates the initializer of a constexpr or compiletime variable
+static bool CodegenConstant(Codegen *gen, ASTNode *node, EvalValue *value) {
+	const EvalType *type = EvalTypeNamed(CodegenResolve(gen, node->expression.type)->name);
+	if (type == NULL) {
+		CodegenError(gen, node, "Only arithmetic types can be evaluated at compile time");
+		return false;
+	}
+	if (node->expression.body == NULL) {
+		CodegenError(gen, node, "A compile-time constant needs an initializer");
+		return false;
+	}
+	if (!EvalExpression(&gen->eval, node->expression.body, value) || !EvalConvert(&gen->eval, node, value, type)) {
+		CodegenEvalError(gen, node);
+		return false;
+	}
+	return true;
+}
+// type name [= value], without the semicolon. A constexpr variable becomes
+// const with its value as initializer, a compiletime one emits nothing.
+static void CodegenDeclaration(Codegen *gen, ASTNode *node, bool global) {
+	EvalValue value;
+	bool constant = (node->expression.isConstexpr || node->expression.isCompiletime) && CodegenConstant(gen, node, &value);
+	if (!node->expression.isCompiletime) {
+		if (node->expression.isConstexpr && strncmp(node->expression.type->name, "const ", 6) != 0) BufferAppendString(gen->out, "const ");
+		CodegenDeclarator(gen, node->expression.type, node->expression.name);
+		if (constant) {
+			BufferAppend(gen->out, " = ", 3);
+			if (!EvalFormat(value, gen->out)) CodegenError(gen, node, "The value has no C literal");
+		}
+		else if (node->expression.body) {
+			BufferAppend(gen->out, " = ", 3);
+			CodegenExpression(gen, node->expression.body, PREC_ASSIGNMENT);
+		}
+	}
+	CodegenBinding *binding = global ? CodegenBindGlobal(gen, node->expression.name, node->expression.type, node) : CodegenBind(gen, node->expression.name, node->expression.type, node);
+	binding->constant = constant;
+	if (constant) binding->value = value;
+}
+static void CodegenStatements(Codegen *gen, ASTQueue *body) {
+	ASTNodeNode *item;
+	for (item = body->first; item; item = item->prev) CodegenStatement(gen, item->node);
+}
+// { statements } on the current line, a single statement gets braces too
+static void CodegenBlock(Codegen *gen, ASTNode *node) {
+	int scope = CodegenScopeOpen(gen);
+	BufferAppend(gen->out, "{\n", 2);
+	gen->depth++;
+	if (node && node->type == AST_SCOPE) CodegenStatements(gen, node->scope.body);
+	else if (node) CodegenStatement(gen, node);
+	gen->depth--;
+	CodegenScopeClose(gen, scope);
+	CodegenIndent(gen);
+	BufferAppendChar(gen->out, '}');
+}
+static void CodegenStatement(Codegen *gen, ASTNode *node) {
+	int scope;
+	if (CodegenIsCompiletime(node) && !CodegenIsFunction(node)) {
+		CodegenDeclaration(gen, node, false);
+		return;
+	}
+	CodegenIndent(gen);
+	switch (node->type) {
+		case AST_EXPRESSION:
+			if (node->expression.body && node->expression.body->type == AST_FUNCTION) {
+				CodegenError(gen, node, "Functions cannot be defined inside other functions");
+				break;
+			}
+			CodegenDeclaration(gen, node, false);
+			BufferAppend(gen->out, ";\n", 2);
+			break;
+		case AST_SCOPE:
+			CodegenBlock(gen, node);
+			BufferAppendChar(gen->out, '\n');
+			break;
+		case AST_RETURN:
+			BufferAppendString(gen->out, "return");
+			if (node->returnStatement.expression) {
+				BufferAppendChar(gen->out, ' ');
+				CodegenExpression(gen, node->returnStatement.expression, PREC_NONE);
+			}
+			BufferAppend(gen->out, ";\n", 2);
+			break;
+		case AST_IF:
+			// else if chains stay flat
+			while (1) {
+				BufferAppendString(gen->out, "if (");
+				CodegenExpression(gen, node->ifStatement.condition, PREC_NONE);
+				BufferAppend(gen->out, ") ", 2);
+				CodegenBlock(gen, node->ifStatement.then);
+				if (node->ifStatement.otherwise == NULL) break;
+				BufferAppendString(gen->out, " else ");
+				if (node->ifStatement.otherwise->type != AST_IF) {
+					CodegenBlock(gen, node->ifStatement.otherwise);
+					break;
+				}
+				node = node->ifStatement.otherwise;
+			}
+			BufferAppendChar(gen->out, '\n');
+			break;
+		case AST_WHILE:
+			BufferAppendString(gen->out, "while (");
+			CodegenExpression(gen, node->loop.condition, PREC_NONE);
+			BufferAppend(gen->out, ") ", 2);
+			gen->loops++;
+			CodegenBlock(gen, node->loop.body);
+			gen->loops--;
+			BufferAppendChar(gen->out, '\n');
+			break;
+		case AST_FOR:
+			scope = CodegenScopeOpen(gen);
+			BufferAppendString(gen->out, "for (");
+			if (node->loop.init && node->loop.init->type == AST_EXPRESSION) CodegenDeclaration(gen, node->loop.init, false);
+			else if (node->loop.init) CodegenExpression(gen, node->loop.init, PREC_NONE);
+			BufferAppend(gen->out, "; ", 2);
+			if (node->loop.condition) CodegenExpression(gen, node->loop.condition, PREC_NONE);
+			BufferAppend(gen->out, "; ", 2);
+			if (node->loop.step) CodegenExpression(gen, node->loop.step, PREC_NONE);
+			BufferAppend(gen->out, ") ", 2);
+			gen->loops++;
+			CodegenBlock(gen, node->loop.body);
+			gen->loops--;
+			BufferAppendChar(gen->out, '\n');
+			CodegenScopeClose(gen, scope);
+			break;
+		// Outside a loop the C would not compile
+		case AST_BREAK:
+			if (gen->loops == 0) CodegenError(gen, node, gen->typeArgument ? "A 'break' outside a loop can only end a generic arm, as its last statement" : "A 'break' must be inside a loop");
+			else BufferAppendString(gen->out, "break;\n");
+			break;
+		case AST_CONTINUE:
+			if (gen->loops == 0) CodegenError(gen, node, "A 'continue' must be inside a loop");
+			else BufferAppendString(gen->out, "continue;\n");
+			break;
+		case AST_IMPORT:
+		case AST_GENERIC:
+			CodegenError(gen, node, "Only allowed at the top level");
+			break;
+		default:
+			// Expression statement
+			CodegenExpression(gen, node, PREC_NONE);
+			BufferAppend(gen->out, ";\n", 2);
+			break;
+	}
+}
+
+static void CodegenParameters(Codegen *gen, ASTQueue *parameters) {
+	ASTNodeNode *item;
+	BufferAppendChar(gen->out, '(');
+	if (parameters->length == 0) BufferAppendString(gen->out, "void");
+	for (item = parameters->first; item; item = item->prev) {
+		if (item->node->type != AST_EXPRESSION) {
+			CodegenError(gen, item->node, "Expected a parameter declaration");
+			continue;
+		}
+		CodegenDeclarator(gen, item->node->expression.type, item->node->expression.name);
+		if (item->prev) BufferAppend(gen->out, ", ", 2);
+	}
+	BufferAppendChar(gen->out, ')');
+}
+static void CodegenBindParameters(Codegen *gen, ASTQueue *parameters) {
+	ASTNodeNode *item;
+	for (item = parameters->first; item; item = item->prev) {
+		if (item->node->type == AST_EXPRESSION) CodegenBind(gen, item->node->expression.name, item->node->expression.type, item->node);
+	}
+}
+static void CodegenFunction(Codegen *gen, ASTNode *node, bool prototype) {
+	ASTNode *function = node->expression.body;
+	CodegenDeclarator(gen, node->expression.type, node->expression.name);
+	CodegenParameters(gen, function->function.parameters);
+	if (prototype) {
+		BufferAppend(gen->out, ";\n", 2);
+		return;
+	}
+	int scope = CodegenScopeOpen(gen);
+	CodegenBindParameters(gen, function->function.parameters);
+	BufferAppendChar(gen->out, ' ');
+	CodegenBlock(gen, function->function.body);
+	BufferAppend(gen->out, "\n\n", 2);
+	CodegenScopeClose(gen, scope);
+}
+// A constexpr variable of another module is defined by that module's C, a
+// compiletime one only has its value
+static void CodegenImportConstant(Codegen *gen, ASTNode *node) {
+	EvalValue value;
+	bool constant = CodegenConstant(gen, node, &value);
+	if (node->expression.isConstexpr) {
+		BufferAppendString(gen->out, "extern ");
+		if (strncmp(node->expression.type->name, "const ", 6) != 0) BufferAppendString(gen->out, "const ");
+		CodegenDeclarator(gen, node->expression.type, node->expression.name);
+		BufferAppend(gen->out, ";\n", 2);
+	}
+	CodegenBinding *binding = CodegenBindGlobal(gen, node->expression.name, node->expression.type, node);
+	binding->constant = constant;
+	if (constant) binding->value = value;
+}
+// C headers are included as they are. A Czy module's functions are declared
+// and its generics instantiated here like local ones; without the module
+// interfaces, its header is included.
+static void CodegenImport(Codegen *gen, ASTNode *node) {
+	ASTNodeNode *item;
+	if (ModuleIsHeader(node->import)) {
+		BufferAppendf(gen->out, "#include <%s>\n", node->import);
+		return;
+	}
+	if (node->exports == NULL) {
+		BufferAppendf(gen->out, "#include \"%s.h\"\n", node->import);
+		return;
+	}
+	for (item = node->exports->first; item; item = item->prev) {
+		ASTNode *export = item->node;
+		if (export->type == AST_IMPORT) CodegenImport(gen, export);
+		else if (export->type == AST_GENERIC) CodegenBindGlobal(gen, export->generic.name, export->generic.returnType, export);
+		else if (CodegenIsFunction(export)) {
+			CodegenBindGlobal(gen, export->expression.name, export->expression.type, export);
+			if (!CodegenIsCompiletime(export)) CodegenFunction(gen, export, true);
+		}
+		else CodegenImportConstant(gen, export);
+	}
+}
+// One instance is the generic with T replaced by the type argument and only
+// the arm for that type as its body, so nothing is left to pick at runtime
+static void CodegenInstance(Codegen *gen, MonoInstance instance, Buffer *prototypes, Buffer *definitions) {
+	ASTNode *generic = instance.generic;
+	ASTNodeNode *item;
+	int scope = CodegenScopeOpen(gen);
+	gen->typeParameter = generic->generic.typeParameter;
+	gen->typeArgument = instance.type;
+
+	gen->out = prototypes;
+	BufferAppendString(gen->out, "static ");
+	CodegenDeclarator(gen, generic->generic.returnType, instance.name);
+	CodegenParameters(gen, generic->generic.parameters);
+	BufferAppend(gen->out, ";\n", 2);
+
+	gen->out = definitions;
+	BufferAppendString(gen->out, "static ");
+	CodegenDeclarator(gen, generic->generic.returnType, instance.name);
+	CodegenParameters(gen, generic->generic.parameters);
+	BufferAppend(gen->out, " {\n", 3);
+	CodegenBindParameters(gen, generic->generic.parameters);
+	gen->depth++;
+	// An arm ends like a switch case, the break has nothing to leave
+	for (item = instance.arm->arm.body->first; item; item = item->prev) {
+		if (item->prev == NULL && item->node->type == AST_BREAK) break;
+		CodegenStatement(gen, item->node);
+	}
+	gen->depth--;
+	BufferAppend(gen->out, "}\n\n", 3);
+
+	CodegenScopeClose(gen, scope);
+	gen->typeParameter = NULL;
+	gen->typeArgument = NULL;
+}
+// Emits C for a file parsed by ASTParseNode: includes, prototypes for every
+// function and generic instance so they can be called before their
+// definition, everything else in source order, then the instances.
+// Generics only produce the instances their calls ask for.
+bool CodegenEmit(CompilerState *state, ASTNode *root, Buffer *out) {
+	Codegen gen = { 0 };
+	Buffer prototypes, instances, definitions;
+	ASTNodeNode *item;
+	int i;
+	if (root == NULL || root->type != AST_SCOPE) return false;
+	gen.state = state;
+	if (!MonoInit(&gen.instances)) return false;
+	SymbolTableInit(&gen.locals);
+	EvalInit(&gen.eval, state, CodegenResolveName, &gen);
+	BufferInit(&prototypes, 1024);
+	BufferInit(&instances, 1024);
+	BufferInit(&definitions, state->sourceLength * 2);
+
+	BufferAppendString(out, "// Generated by czy, do not edit\n");
+	gen.out = out;
+	for (item = root->scope.body->first; item; item = item->prev) {
+		ASTNode *node = item->node;
+		if (node->type == AST_IMPORT) CodegenImport(&gen, node);
+		else if (node->type == AST_GENERIC) CodegenBindGlobal(&gen, node->generic.name, node->generic.returnType, node);
+		else if (CodegenIsFunction(node)) CodegenBindGlobal(&gen, node->expression.name, node->expression.type, node);
+	}
+	BufferAppendChar(out, '\n');
+	gen.out = &prototypes;
+	for (item = root->scope.body->first; item; item = item->prev) {
+		if (CodegenIsFunction(item->node) && !CodegenIsCompiletime(item->node) && strcmp(item->node->expression.name, "main") != 0) CodegenFunction(&gen, item->node, true);
+	}
+
+	gen.out = &definitions;
+	for (item = root->scope.body->first; item; item = item->prev) {
+		ASTNode *node = item->node;
+		switch (node->type) {
+			case AST_IMPORT:
+			case AST_GENERIC:
+				break;
+			case AST_EXPRESSION:
+				// compiletime functions only run inside the compiler
+				if (CodegenIsFunction(node)) {
+					if (!CodegenIsCompiletime(node)) CodegenFunction(&gen, node, false);
+				}
+				else if (CodegenIsCompiletime(node)) CodegenDeclaration(&gen, node, true);
+				else {
+					CodegenDeclaration(&gen, node, true);
+					BufferAppend(gen.out, ";\n\n", 3);
+				}
+				break;
+			default:
+				CodegenError(&gen, node, "Statements must be inside a function");
+				break;
+		}
+	}
+	// Instances can call generics too, so the list grows while it is emitted
+	for (i = 0; i < gen.instances.count; i++) {
+		if (gen.instances.instances[i].arm) CodegenInstance(&gen, gen.instances.instances[i], &prototypes, &instances);
+	}
+
+	BufferAppend(out, prototypes.data, prototypes.length);
+	BufferAppendChar(out, '\n');
+	BufferAppend(out, definitions.data, definitions.length);
+	BufferAppend(out, instances.data, instances.length);
+
+	BufferFree(&prototypes);
+	BufferFree(&instances);
+	BufferFree(&definitions);
+	MonoFree(&gen.instances);
+	EvalFree(&gen.eval);
+	free(gen.bindings);
+	SymbolTableFree(&gen.locals);
+	free(gen.globals);
+	return !gen.failed;
+}
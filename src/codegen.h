@@ -0,0 +1,42 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "parser.h"
+#include "buffer.h"
+#include "mono.h"
+#include "eval.h"
+
+typedef struct Codegen Codegen;
+typedef struct CodegenBinding CodegenBinding;
+
+// A name in scope and its type
+struct CodegenBinding {
+	const char *name;	// Interned
+	const Type *type;	// The return type for functions
+	ASTNode *node;		// The AST_GENERIC or the declaration, NULL for parameters
+	bool constant;		// A constexpr or compiletime variable with its value
+	EvalValue value;
+};
+// State of one pass emitting C for a parsed file
+struct Codegen {
+	CompilerState *state;
+	Buffer *out;
+	int depth;			// Indentation in tabs
+	int loops;			// Loops around the statement being emitted
+	const Type *typeParameter;	// Inside a generic instance: T and what it stands for
+	const Type *typeArgument;
+	CodegenBinding *bindings;	// Locals and parameters, innermost last
+	int bindingCount;
+	int bindingCapacity;
+	SymbolTable locals;		// Index in bindings of each visible local
+	CodegenBinding *globals;	// Open addressing table of file scope names
+	int globalCount;
+	int globalCapacity;
+	MonoTable instances;
+	Evaluator eval;			// For constexpr and compiletime declarations
+	bool failed;
+};
+
+bool CodegenEmit(CompilerState *state, ASTNode *root, Buffer *out);
+
+#endif
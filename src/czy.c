@@ -4,41 +4,71 @@ void InitCompiler(CompilerState* state, FILE* errorSteam) {
     state->outputStream = errorSteam;
     state->hadError = false;
     state->panicMode = false;
+    state->errorCount = 0;
+    state->maxErrors = CZY_DEFAULT_MAX_ERRORS;
+    state->evalSteps = CZY_DEFAULT_EVAL_STEPS;
+    state->source = NULL;
+    state->sourceLength = 0;
+    state->modules = NULL;
+    state->importer = NULL;
+    state->imports = NULL;
+    state->importHashes = NULL;
+    state->importCount = 0;
+    state->importCapacity = 0;
+    ArenaInit(&state->arena, 0);
+    DiagnosticInit(&state->diagnostics, &state->arena);
+    if (!InternTableInit(&state->strings, &state->arena) || !TypeTableInit(&state->types, &state->arena, &state->strings)) {
+        fprintf(stderr, "Out of memory initializing the compiler.\n");
+        exit(1);
+    }
+    SymbolTableInit(&state->symbols);
+}
+
+void FreeCompiler(CompilerState* state) {
+    CompilerFlushDiagnostics(state);
+    DiagnosticFree(&state->diagnostics);
+    TypeTableFree(&state->types);
+    InternTableFree(&state->strings);
+    SymbolTableFree(&state->symbols);
+    free(state->imports);
+    free(state->importHashes);
+    ArenaRelease(&state->arena);
 }
 
-void CompilerError(CompilerState* state, int line, int column, const char* where, const char* message, const char* lineText) {
+void CompilerSetSource(CompilerState* state, const char* source, size_t length) {
+    state->source = source;
+    state->sourceLength = length;
+    DiagnosticSetSource(&state->diagnostics, source, length);
+}
+
+void CompilerError(CompilerState* state, DiagnosticSeverity severity, int line, int column, const char* message) {
+    if (severity == DIAG_WARNING) {
+        DiagnosticAdd(&state->diagnostics, severity, line, column, message);
+        return;
+    }
+
     // Set the global error flag
     state->hadError = true;
 
     // Don't report cascading errors while in panic mode
     if (state->panicMode) return;
+    state->panicMode = true;
 
-    fprintf(state->outputStream, "\033[1;31m%s\033[0m at line %d, column %d:\n", where, line, column);
-    fprintf(state->outputStream, "  %s\n", message);
-
-    if (lineText) {
-        // Print the problematic line
-        fprintf(state->outputStream, "  \033[1;37m%.*s\033[0m\n", (int)strlen(lineText), lineText);
-
-        // Print the caret pointing to the exact column
-        fprintf(state->outputStream, "  \033[1;32m"); // Green color
-        for (int i = 0; i < column; i++) {
-            if (i < (int)strlen(lineText) && lineText[i] == '\t') {
-                fprintf(state->outputStream, "    "); // Tabs are 4 spaces
-            } else {
-                fprintf(state->outputStream, " ");
-            }
-        }
-        fprintf(state->outputStream, "^\033[0m\n");
-    }
-
-    fprintf(state->outputStream, "\n");
+    if (CompilerErrorLimitReached(state)) return;
+    state->errorCount++;
+    DiagnosticAdd(&state->diagnostics, severity, line, column, message);
+    if (CompilerErrorLimitReached(state)) state->diagnostics.limitReached = true;
+}
 
-    // Optional: Enter panic mode for error recovery
-    state->panicMode = true;
+bool CompilerFlushDiagnostics(CompilerState* state) {
+    return DiagnosticFlush(&state->diagnostics, state->outputStream);
 }
 
 // Call this when you've recovered from an error (e.g., after synchronizing)
 void ExitPanicMode(CompilerState* state) {
     state->panicMode = false;
 }
+
+bool CompilerErrorLimitReached(CompilerState* state) {
+    return state->maxErrors > 0 && state->errorCount >= state->maxErrors;
+}
@@ -3,24 +3,67 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include "arena.h"
+#include "intern.h"
+#include "diagnostic.h"
+#include "symbol.h"
+#include "type.h"
 
-typedef struct {
+// Errors reported per file before the rest are suppressed
+#define CZY_DEFAULT_MAX_ERRORS 20
+#define CZY_DEFAULT_EVAL_STEPS 10000000
+
+typedef struct ModuleCache ModuleCache;
+
+typedef struct CompilerState {
     FILE* outputStream;   // Where to send errors (default: stderr)
     bool hadError;        // Global error flag
     bool panicMode;       // For error recovery/synchronization
+    int errorCount;       // Errors reported so far
+    int maxErrors;        // Stop reporting after this many, 0 for no limit
+    long evalSteps;       // Budget of each compile-time evaluation
+    const char* source;   // Source being compiled; tokens are offsets into it
+    size_t sourceLength;
+    Arena arena;          // AST nodes and interned text for this compilation unit
+    InternTable strings;  // Identifiers and type names, compare by pointer
+    SymbolTable symbols;  // Declarations in scope while parsing, file scope ones after
+    TypeTable types;      // Canonical types, compare by pointer
+    DiagnosticEngine diagnostics; // Errors and warnings until they are flushed
+    ModuleCache* modules; // Interfaces of imported modules, NULL to #include them instead
+    struct CompilerState* importer; // The file whose import is being compiled, if any
+    const char** imports; // Resolved paths of the modules imported so far
+    uint64_t* importHashes; // Hash of the source each was compiled from
+    int importCount;
+    int importCapacity;
 } CompilerState;
 
 // Initialize the compiler state (call this at startup)
 void InitCompiler(CompilerState* state, FILE* errorSteam);
 
-// Main error reporting function
-void CompilerError(CompilerState* state, int line, int column, const char* where, const char* message, const char* lineText);
+// Release everything the compiler state owns
+void FreeCompiler(CompilerState* state);
+
+// Set the source buffer; it must stay alive until compilation finishes
+void CompilerSetSource(CompilerState* state, const char* source, size_t length);
+
+// Main error reporting function; diagnostics are kept until CompilerFlushDiagnostics
+void CompilerError(CompilerState* state, DiagnosticSeverity severity, int line, int column, const char* message);
+
+// Write the pending diagnostics to the output stream, sorted and deduplicated
+bool CompilerFlushDiagnostics(CompilerState* state);
+
+// Call this when you've recovered from an error (e.g., after synchronizing)
+void ExitPanicMode(CompilerState* state);
+
+// Whether the error cap was hit and parsing should give up
+bool CompilerErrorLimitReached(CompilerState* state);
 
 // Macro for convenience
-#define ERROR_AT(state, line, col, expr, msg) CompilerError(state, line, col, "Error", msg, expr)
-#define WARNING_AT(state, line, col, expr, msg) CompilerError(state, line, col, "Warning", msg, expr)
+#define ERROR_AT(state, line, col, msg) CompilerError(state, DIAG_ERROR, line, col, msg)
+#define WARNING_AT(state, line, col, msg) CompilerError(state, DIAG_WARNING, line, col, msg)
 
 #endif
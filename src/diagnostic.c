@@ -0,0 +1,152 @@
+#include "diagnostic.h"
+
+void DiagnosticInit(DiagnosticEngine *d, Arena *arena) {
+	d->items = NULL;
+	d->count = 0;
+	d->capacity = 0;
+	d->limitReached = false;
+	d->path = NULL;
+	d->json = false;
+	d->source = NULL;
+	d->sourceLength = 0;
+	d->lineStarts = NULL;
+	d->lineCount = 0;
+	d->arena = arena;
+}
+void DiagnosticSetSource(DiagnosticEngine *d, const char *source, size_t length) {
+	d->source = source;
+	d->sourceLength = length;
+	free(d->lineStarts);
+	d->lineStarts = NULL;
+	d->lineCount = 0;
+}
+void DiagnosticAdd(DiagnosticEngine *d, DiagnosticSeverity severity, int line, int column, const char *message) {
+	if (d->arena == NULL) return;
+
+	if (d->count == d->capacity) {
+		int capacity = d->capacity ? d->capacity * 2 : 16;
+		Diagnostic *items = (Diagnostic *) realloc(d->items, capacity * sizeof(Diagnostic));
+		if (items == NULL) {
+			fprintf(stderr, "Out of memory for diagnostics.\n");
+			exit(1);
+		}
+		d->items = items;
+		d->capacity = capacity;
+	}
+	d->items[d->count] = (Diagnostic) { line, column, d->count, severity, ArenaStrndup(d->arena, message, strlen(message)) };
+	d->count++;
+}
+static void DiagnosticIndexLines(DiagnosticEngine *d) {
+	int capacity = 256;
+	d->lineStarts = (int *) malloc(capacity * sizeof(int));
+	d->lineCount = 0;
+	const char *p = d->source;
+	const char *end = d->source + d->sourceLength;
+	while (d->lineStarts) {
+		if (d->lineCount == capacity) {
+			capacity *= 2;
+			int *lineStarts = (int *) realloc(d->lineStarts, capacity * sizeof(int));
+			if (lineStarts == NULL) break;
+			d->lineStarts = lineStarts;
+		}
+		d->lineStarts[d->lineCount++] = (int) (p - d->source);
+		p = (const char *) memchr(p, '\n', end - p);
+		if (p == NULL) break;
+		p++;
+	}
+}
+// Text of a 1-based line, without its line break
+static const char *DiagnosticLine(DiagnosticEngine *d, int line, int *length) {
+	if (d->source == NULL || line < 1) return NULL;
+	if (d->lineStarts == NULL) DiagnosticIndexLines(d);
+	if (line > d->lineCount) return NULL;
+
+	const char *start = d->source + d->lineStarts[line - 1];
+	const char *end = line < d->lineCount ? d->source + d->lineStarts[line] - 1 : d->source + d->sourceLength;
+	if (end > start && end[-1] == '\r') end--;
+	*length = (int) (end - start);
+	return start;
+}
+static int DiagnosticCompare(const void *a, const void *b) {
+	const Diagnostic *x = (const Diagnostic *) a, *y = (const Diagnostic *) b;
+	if (x->line != y->line) return x->line < y->line ? -1 : 1;
+	if (x->column != y->column) return x->column < y->column ? -1 : 1;
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+// Whether an earlier diagnostic at the same position says the same thing
+static bool DiagnosticIsDuplicate(DiagnosticEngine *d, int i) {
+	int j;
+	for (j = i - 1; j >= 0 && d->items[j].line == d->items[i].line && d->items[j].column == d->items[i].column; j--) {
+		if (d->items[j].severity == d->items[i].severity && strcmp(d->items[j].message, d->items[i].message) == 0) return true;
+	}
+	return false;
+}
+static void DiagnosticJSONString(Buffer *out, const char *str) {
+	BufferAppendChar(out, '"');
+	for (; *str; str++) {
+		unsigned char c = (unsigned char) *str;
+		if (c == '"' || c == '\\') {
+			BufferAppendChar(out, '\\');
+			BufferAppendChar(out, (char) c);
+		}
+		else if (c == '\n') BufferAppend(out, "\\n", 2);
+		else if (c == '\t') BufferAppend(out, "\\t", 2);
+		else if (c < 0x20) BufferAppendf(out, "\\u%04x", c);
+		else BufferAppendChar(out, (char) c);
+	}
+	BufferAppendChar(out, '"');
+}
+static void DiagnosticRenderJSON(DiagnosticEngine *d, Buffer *out, Diagnostic *diagnostic) {
+	BufferAppendString(out, "{\"file\":");
+	DiagnosticJSONString(out, d->path ? d->path : "");
+	BufferAppendf(out, ",\"line\":%d,\"column\":%d,\"severity\":\"%s\",\"message\":",
+		diagnostic->line, diagnostic->column, diagnostic->severity == DIAG_ERROR ? "error" : "warning");
+	DiagnosticJSONString(out, diagnostic->message);
+	BufferAppend(out, "}\n", 2);
+}
+static void DiagnosticRenderText(DiagnosticEngine *d, Buffer *out, Diagnostic *diagnostic) {
+	int length = 0, i;
+	const char *text = DiagnosticLine(d, diagnostic->line, &length);
+
+	BufferAppendString(out, diagnostic->severity == DIAG_ERROR ? "\033[1;31mError\033[0m" : "\033[1;33mWarning\033[0m");
+	if (d->path) BufferAppendf(out, " in %s", d->path);
+	BufferAppendf(out, " at line %d, column %d:\n  %s\n", diagnostic->line, diagnostic->column, diagnostic->message);
+	if (text) {
+		// The problematic line and a caret under the column; tabs are
+		// copied so the caret lines up however the terminal shows them
+		BufferAppendString(out, "  \033[1;37m");
+		BufferAppend(out, text, length);
+		BufferAppendString(out, "\033[0m\n  \033[1;32m");
+		for (i = 0; i < diagnostic->column - 1 && i < length; i++) BufferAppendChar(out, text[i] == '\t' ? '\t' : ' ');
+		BufferAppendString(out, "^\033[0m\n");
+	}
+	BufferAppendChar(out, '\n');
+}
+// Sorts, deduplicates and writes every pending diagnostic with one write
+bool DiagnosticFlush(DiagnosticEngine *d, FILE *stream) {
+	if (d->count == 0) return true;
+
+	Buffer out;
+	int i;
+	BufferInit(&out, 4096);
+	qsort(d->items, d->count, sizeof(Diagnostic), DiagnosticCompare);
+	for (i = 0; i < d->count; i++) {
+		if (DiagnosticIsDuplicate(d, i)) continue;
+		if (d->json) DiagnosticRenderJSON(d, &out, &d->items[i]);
+		else DiagnosticRenderText(d, &out, &d->items[i]);
+	}
+	if (d->limitReached && !d->json) BufferAppendString(&out, "Too many errors, stopping.\n\n");
+
+	bool ok = BufferWrite(&out, stream);
+	BufferFree(&out);
+	d->count = 0;
+	d->limitReached = false;
+	return ok;
+}
+void DiagnosticFree(DiagnosticEngine *d) {
+	free(d->items);
+	free(d->lineStarts);
+	d->items = NULL;
+	d->lineStarts = NULL;
+	d->count = d->capacity = d->lineCount = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include "arena.h"
+#include "buffer.h"
+
+typedef enum DiagnosticSeverity {
+	DIAG_ERROR = 0,
+	DIAG_WARNING
+} DiagnosticSeverity;
+
+typedef struct {
+	int line;
+	int column;
+	int order;		// Report order, keeps the sort stable
+	DiagnosticSeverity severity;
+	const char *message;	// Copied into the arena
+} Diagnostic;
+
+typedef struct DiagnosticEngine DiagnosticEngine;
+
+// Collects the diagnostics of one source and renders them all at once,
+// sorted by position with duplicates dropped. The source's line starts are
+// indexed on the first flush, so each diagnostic costs only its own line.
+struct DiagnosticEngine {
+	Diagnostic *items;
+	int count;
+	int capacity;
+	bool limitReached;	// The error cap was hit, noted on flush
+	const char *path;	// Shown in the output when set
+	bool json;		// One JSON object per line instead of text
+	const char *source;
+	size_t sourceLength;
+	int *lineStarts;	// Offset of each line, built on demand
+	int lineCount;
+	Arena *arena;		// NULL discards everything, for speculative work
+};
+
+void DiagnosticInit(DiagnosticEngine *d, Arena *arena);
+void DiagnosticSetSource(DiagnosticEngine *d, const char *source, size_t length);
+void DiagnosticAdd(DiagnosticEngine *d, DiagnosticSeverity severity, int line, int column, const char *message);
+bool DiagnosticFlush(DiagnosticEngine *d, FILE *stream);
+void DiagnosticFree(DiagnosticEngine *d);
+
+#endif
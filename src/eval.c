@@ -0,0 +1,661 @@
+#include <time.h>
+#include <stdarg.h>
+#include <math.h>
+#include "eval.h"
+
+typedef enum EvalFlow {
+	EVAL_NEXT,
+	EVAL_BREAK,
+	EVAL_CONTINUE,
+	EVAL_RETURN,
+	EVAL_FAILED
+} EvalFlow;
+
+static const EvalType evalTypes[] = {
+	{ "bool", 1, true, false, "" },
+	{ "char", 8, false, false, "" },
+	{ "signed char", 8, false, false, "" },
+	{ "unsigned char", 8, true, false, "" },
+	{ "short", 16, false, false, "" },
+	{ "unsigned short", 16, true, false, "" },
+	{ "int", 32, false, false, "" },
+	{ "signed", 32, false, false, "" },
+	{ "unsigned", 32, true, false, "u" },
+	{ "unsigned int", 32, true, false, "u" },
+	{ "long", 64, false, false, "L" },
+	{ "unsigned long", 64, true, false, "UL" },
+	{ "long long", 64, false, false, "LL" },
+	{ "unsigned long long", 64, true, false, "ULL" },
+	{ "float", 32, false, true, "f" },
+	{ "double", 64, false, true, "" },
+	{ "long double", 128, false, true, "L" },
+};
+#define EVAL_INT (&evalTypes[6])
+#define EVAL_LONG (&evalTypes[10])
+#define EVAL_UNSIGNED_LONG (&evalTypes[11])
+
+static bool EvalStatementList(Evaluator *e, ASTQueue *body, EvalFlow *flow);
+static EvalFlow EvalStatement(Evaluator *e, ASTNode *node);
+static bool EvalNode(Evaluator *e, ASTNode *node, EvalValue *out);
+
+static double EvalNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+static bool EvalFail(Evaluator *e, ASTNode *node, const char *format, ...) __attribute__((format(printf, 3, 4)));
+static bool EvalFail(Evaluator *e, ASTNode *node, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	vsnprintf(e->message, sizeof(e->message), format, args);
+	va_end(args);
+	e->error = e->message;
+	e->errorNode = node;
+	return false;
+}
+// Every node and statement costs a step; the clock is read now and then
+static bool EvalStep(Evaluator *e, ASTNode *node) {
+	e->steps++;
+	if (e->state->evalSteps > 0 && e->steps > e->state->evalSteps) {
+		e->exhausted = true;
+		return EvalFail(e, node, "Compile-time evaluation exceeded its budget of %ld steps", e->state->evalSteps);
+	}
+	if ((e->steps & 0xFFFF) == 0 && EvalNow() > e->deadline) {
+		e->timedOut = true;
+		return EvalFail(e, node, "Compile-time evaluation took longer than %g seconds, a smaller --eval-steps leaves it to run time", EVAL_TIME_LIMIT);
+	}
+	return true;
+}
+
+// The arithmetic type a type name stands for, NULL for any other type
+const EvalType *EvalTypeNamed(const char *name) {
+	size_t i;
+	if (name == NULL) return NULL;
+	if (strncmp(name, "const ", 6) == 0) name += 6;
+	for (i = 0; i < sizeof(evalTypes) / sizeof(evalTypes[0]); i++) {
+		if (strcmp(name, evalTypes[i].name) == 0) return &evalTypes[i];
+	}
+	return NULL;
+}
+// Integer promotion: everything narrower than int computes as int
+const EvalType *EvalPromote(const EvalType *type) {
+	return !type->isFloat && type->bits < 32 ? EVAL_INT : type;
+}
+// The usual arithmetic conversions
+const EvalType *EvalCommonType(const EvalType *a, const EvalType *b) {
+	a = EvalPromote(a);
+	b = EvalPromote(b);
+	if (a->isFloat || b->isFloat) {
+		if (!b->isFloat) return a;
+		if (!a->isFloat) return b;
+		return a->bits >= b->bits ? a : b;
+	}
+	if (a->bits != b->bits) return a->bits > b->bits ? a : b;
+	return a->isUnsigned ? a : b;
+}
+// Truncates to the type's width, sign-extending signed types
+static long long EvalWrap(const EvalType *type, unsigned long long bits) {
+	if (type->bits == 1) return bits != 0;
+	if (type->bits >= 64) return (long long) bits;
+	bits &= (1ULL << type->bits) - 1;
+	if (!type->isUnsigned && (bits >> (type->bits - 1))) bits |= ~0ULL << type->bits;
+	return (long long) bits;
+}
+static bool EvalFits(const EvalType *type, long long value) {
+	return type->bits >= 64 || EvalWrap(type, (unsigned long long) value) == value;
+}
+static double EvalToDouble(EvalValue value) {
+	if (value.type->isFloat) return value.f;
+	return value.type->isUnsigned ? (double) (unsigned long long) value.i : (double) value.i;
+}
+static bool EvalIsTrue(EvalValue value) {
+	return value.type->isFloat ? value.f != 0 : value.i != 0;
+}
+static EvalValue EvalInteger(const EvalType *type, long long i) {
+	EvalValue value;
+	value.type = type;
+	value.i = i;
+	return value;
+}
+
+// Conversion as by assignment or a cast
+bool EvalConvert(Evaluator *e, ASTNode *node, EvalValue *value, const EvalType *type) {
+	if (type->isFloat) {
+		double f = EvalToDouble(*value);
+		value->f = type->bits == 32 ? (double) (float) f : f;
+	}
+	else if (type->bits == 1) value->i = EvalIsTrue(*value);
+	else if (value->type->isFloat) {
+		// Out of range float to integer is undefined in C, so it is an error here
+		double f = trunc(value->f);
+		double limit = ldexp(1.0, type->bits - (type->isUnsigned ? 0 : 1));
+		if (!(f < limit && f >= (type->isUnsigned ? 0 : -limit))) return EvalFail(e, node, "%g does not fit in %s", value->f, type->name);
+		value->i = type->isUnsigned ? (long long) (unsigned long long) f : (long long) f;
+	}
+	else value->i = EvalWrap(type, (unsigned long long) value->i);
+	value->type = type;
+	return true;
+}
+
+// Literals carry the value the lexer decoded, the token gives its type
+bool EvalLiteral(Evaluator *e, ASTNode *node, EvalValue *out) {
+	switch (node->type) {
+		case AST_INTLIT: {
+			if (node->token.type == TOK_TRUE || node->token.type == TOK_FALSE) {
+				*out = EvalInteger(EVAL_INT, node->token.type == TOK_TRUE);
+				return true;
+			}
+			if (node->token.type == TOK_NULLPTR) return EvalFail(e, node, "Pointers cannot be evaluated at compile time");
+			unsigned long long bits = node->intLit;
+			const EvalType *type = EVAL_INT;
+			switch (node->token.type) {
+				case TOK_LONGLIT: type = EVAL_LONG; break;
+				case TOK_LONGLONGLIT: type = EvalTypeNamed("long long"); break;
+				case TOK_UNSIGNEDLIT: type = EvalTypeNamed("unsigned int"); break;
+				case TOK_UNSIGNEDLONGLIT: type = EVAL_UNSIGNED_LONG; break;
+				case TOK_UNSIGNEDLONGLONGLIT: type = EvalTypeNamed("unsigned long long"); break;
+				default: break;
+			}
+			// A literal too large for its type gets the next one that holds it
+			if (!type->isUnsigned && bits > (type->bits >= 64 ? 0x7FFFFFFFFFFFFFFFULL : 0x7FFFFFFFULL)) type = bits > 0x7FFFFFFFFFFFFFFFULL ? EVAL_UNSIGNED_LONG : EVAL_LONG;
+			else if (type->isUnsigned && type->bits == 32 && bits > 0xFFFFFFFFULL) type = EVAL_UNSIGNED_LONG;
+			*out = EvalInteger(type, (long long) bits);
+			return true;
+		}
+		case AST_CHARLIT:
+			*out = EvalInteger(EVAL_INT, node->charLit);
+			return true;
+		case AST_FLOATLIT:
+			out->type = EvalTypeNamed(node->token.type == TOK_FLOATLIT ? "float" : node->token.type == TOK_LONGDOUBLELIT ? "long double" : "double");
+			out->f = node->floatLit;
+			return true;
+		default:
+			return EvalFail(e, node, "Strings cannot be evaluated at compile time");
+	}
+}
+
+static EvalLocal *EvalFindLocal(Evaluator *e, const char *name) {
+	int i;
+	for (i = e->localCount - 1; i >= e->frame; i--) {
+		if (e->locals[i].name == name) return &e->locals[i];
+	}
+	return NULL;
+}
+static void EvalPushLocal(Evaluator *e, const char *name, EvalValue value) {
+	if (e->localCount == e->localCapacity) {
+		int capacity = e->localCapacity ? e->localCapacity * 2 : 64;
+		EvalLocal *locals = (EvalLocal *) realloc(e->locals, capacity * sizeof(EvalLocal));
+		if (locals == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		e->locals = locals;
+		e->localCapacity = capacity;
+	}
+	e->locals[e->localCount].name = name;
+	e->locals[e->localCount].value = value;
+	e->localCount++;
+}
+static bool EvalIdentifier(Evaluator *e, ASTNode *node, EvalValue *out) {
+	EvalLocal *local = EvalFindLocal(e, node->identifier);
+	EvalName name;
+	if (local) {
+		*out = local->value;
+		return true;
+	}
+	if (e->resolve && e->resolve(e->context, node->identifier, e->depth > 0, &name) && name.constant) {
+		*out = name.value;
+		return true;
+	}
+	return EvalFail(e, node, "%s is not a compile-time constant", node->identifier);
+}
+
+// a op b on values already converted to their common type
+static bool EvalArithmetic(Evaluator *e, ASTNode *node, TokenType op, EvalValue a, EvalValue b, EvalValue *out) {
+	const EvalType *type = a.type;
+	out->type = type;
+	if (type->isFloat) {
+		switch (op) {
+			case TOK_PLUS: out->f = a.f + b.f; break;
+			case TOK_MINUS: out->f = a.f - b.f; break;
+			case TOK_STAR: out->f = a.f * b.f; break;
+			case TOK_SLASH: out->f = a.f / b.f; break;
+			default: return EvalFail(e, node, "Invalid operands to %s", ASTOperatorText(op));
+		}
+		if (type->bits == 32) out->f = (double) (float) out->f;
+		return true;
+	}
+
+	unsigned long long x = (unsigned long long) a.i, y = (unsigned long long) b.i;
+	if ((op == TOK_SLASH || op == TOK_PERCENT) && y == 0) return EvalFail(e, node, "Division by zero in compile-time evaluation");
+	if (type->isUnsigned) {
+		// Unsigned arithmetic wraps
+		unsigned long long mask = type->bits >= 64 ? ~0ULL : (1ULL << type->bits) - 1;
+		x &= mask;
+		y &= mask;
+		switch (op) {
+			case TOK_PLUS: x += y; break;
+			case TOK_MINUS: x -= y; break;
+			case TOK_STAR: x *= y; break;
+			case TOK_SLASH: x /= y; break;
+			case TOK_PERCENT: x %= y; break;
+			case TOK_BITAND: x &= y; break;
+			case TOK_BITOR: x |= y; break;
+			case TOK_BITXOR: x ^= y; break;
+			default: return EvalFail(e, node, "Invalid operands to %s", ASTOperatorText(op));
+		}
+		out->i = EvalWrap(type, x);
+		return true;
+	}
+
+	// Signed overflow is undefined in C, so it is an error here
+	long long result = 0;
+	bool overflow = false;
+	switch (op) {
+		case TOK_PLUS: overflow = __builtin_add_overflow(a.i, b.i, &result); break;
+		case TOK_MINUS: overflow = __builtin_sub_overflow(a.i, b.i, &result); break;
+		case TOK_STAR: overflow = __builtin_mul_overflow(a.i, b.i, &result); break;
+		case TOK_SLASH:
+		case TOK_PERCENT:
+			if (b.i == -1) {
+				overflow = __builtin_sub_overflow(0, a.i, &result);
+				if (op == TOK_PERCENT) result = 0;
+			}
+			else result = op == TOK_SLASH ? a.i / b.i : a.i % b.i;
+			break;
+		case TOK_BITAND: result = a.i & b.i; break;
+		case TOK_BITOR: result = a.i | b.i; break;
+		case TOK_BITXOR: result = a.i ^ b.i; break;
+		default: return EvalFail(e, node, "Invalid operands to %s", ASTOperatorText(op));
+	}
+	if (overflow || !EvalFits(type, result)) return EvalFail(e, node, "Signed overflow of %s in compile-time evaluation", type->name);
+	out->i = result;
+	return true;
+}
+static bool EvalShift(Evaluator *e, ASTNode *node, TokenType op, EvalValue a, EvalValue b, EvalValue *out) {
+	const EvalType *type = EvalPromote(a.type);
+	long long count = b.i;
+	if (type->isFloat || b.type->isFloat) return EvalFail(e, node, "Invalid operands to %s", ASTOperatorText(op));
+	if (!EvalConvert(e, node, &a, type)) return false;
+	if (count < 0 || count >= type->bits || (b.type->isUnsigned && b.type->bits == 64 && b.i < 0)) return EvalFail(e, node, "Shift by %lld is out of range for %s", count, type->name);
+	out->type = type;
+	if (op == TOK_RSHIFT) {
+		out->i = type->isUnsigned ? EvalWrap(type, (unsigned long long) EvalWrap(type, (unsigned long long) a.i) >> count) : a.i >> count;
+		return true;
+	}
+	if (!type->isUnsigned && (a.i < 0 || !EvalFits(type, (long long) ((unsigned long long) a.i << count)) || (a.i && count && ((unsigned long long) a.i << count) >> count != (unsigned long long) a.i))) {
+		return EvalFail(e, node, "Signed overflow of %s in compile-time evaluation", type->name);
+	}
+	out->i = EvalWrap(type, (unsigned long long) a.i << count);
+	return true;
+}
+static bool EvalCompare(TokenType op, EvalValue a, EvalValue b) {
+	if (a.type->isFloat) {
+		switch (op) {
+			case TOK_EQUAL: return a.f == b.f;
+			case TOK_NOTEQUAL: return a.f != b.f;
+			case TOK_LESSERTHAN: return a.f < b.f;
+			case TOK_GREATERTHAN: return a.f > b.f;
+			case TOK_LESSEROREQUAL: return a.f <= b.f;
+			default: return a.f >= b.f;
+		}
+	}
+	if (a.type->isUnsigned) {
+		unsigned long long x = (unsigned long long) a.i, y = (unsigned long long) b.i;
+		switch (op) {
+			case TOK_EQUAL: return x == y;
+			case TOK_NOTEQUAL: return x != y;
+			case TOK_LESSERTHAN: return x < y;
+			case TOK_GREATERTHAN: return x > y;
+			case TOK_LESSEROREQUAL: return x <= y;
+			default: return x >= y;
+		}
+	}
+	switch (op) {
+		case TOK_EQUAL: return a.i == b.i;
+		case TOK_NOTEQUAL: return a.i != b.i;
+		case TOK_LESSERTHAN: return a.i < b.i;
+		case TOK_GREATERTHAN: return a.i > b.i;
+		case TOK_LESSEROREQUAL: return a.i <= b.i;
+		default: return a.i >= b.i;
+	}
+}
+// Any binary operator that is not an assignment or a logical one
+bool EvalBinary(Evaluator *e, ASTNode *node, TokenType op, EvalValue a, EvalValue b, EvalValue *out) {
+	if (op == TOK_LSHIFT || op == TOK_RSHIFT) return EvalShift(e, node, op, a, b, out);
+	const EvalType *type = EvalCommonType(a.type, b.type);
+	if (!EvalConvert(e, node, &a, type) || !EvalConvert(e, node, &b, type)) return false;
+	switch (op) {
+		case TOK_EQUAL:
+		case TOK_NOTEQUAL:
+		case TOK_LESSERTHAN:
+		case TOK_GREATERTHAN:
+		case TOK_LESSEROREQUAL:
+		case TOK_GREATEROREQUAL:
+			*out = EvalInteger(EVAL_INT, EvalCompare(op, a, b));
+			return true;
+		default:
+			return EvalArithmetic(e, node, op, a, b, out);
+	}
+}
+// The operator an assignment applies before storing, TOK_ASSIGN for plain =
+static TokenType EvalAssignmentOperator(TokenType op) {
+	switch (op) {
+		case TOK_PLUSASSIGN: return TOK_PLUS;
+		case TOK_MINUSASSIGN: return TOK_MINUS;
+		case TOK_STARASSIGN: return TOK_STAR;
+		case TOK_SLASHASSIGN: return TOK_SLASH;
+		case TOK_PERCENTASSIGN: return TOK_PERCENT;
+		case TOK_BITANDASSIGN: return TOK_BITAND;
+		case TOK_BITORASSIGN: return TOK_BITOR;
+		case TOK_BITXORASSIGN: return TOK_BITXOR;
+		case TOK_LSHIFTASSIGN: return TOK_LSHIFT;
+		case TOK_RSHIFTASSIGN: return TOK_RSHIFT;
+		default: return TOK_ASSIGN;
+	}
+}
+// Only the evaluated calls' own locals can be assigned
+static EvalLocal *EvalTarget(Evaluator *e, ASTNode *node) {
+	EvalLocal *local;
+	if (node->type != AST_IDENTIFIER) {
+		EvalFail(e, node, "Only local variables can be assigned at compile time");
+		return NULL;
+	}
+	local = EvalFindLocal(e, node->identifier);
+	if (local == NULL) EvalFail(e, node, "%s cannot be assigned at compile time", node->identifier);
+	return local;
+}
+static bool EvalAssignment(Evaluator *e, ASTNode *node, EvalValue *out) {
+	TokenType op = EvalAssignmentOperator(node->binaryOp.op);
+	EvalValue value;
+	if (!EvalNode(e, node->binaryOp.right, &value)) return false;
+	EvalLocal *local = EvalTarget(e, node->binaryOp.left);
+	if (local == NULL) return false;
+	if (op != TOK_ASSIGN && !EvalBinary(e, node, op, local->value, value, &value)) return false;
+	if (!EvalConvert(e, node, &value, local->value.type)) return false;
+	local->value = value;
+	*out = value;
+	return true;
+}
+static bool EvalUnary(Evaluator *e, ASTNode *node, EvalValue *out) {
+	TokenType op = node->unaryOp.op;
+	EvalValue value;
+	if (op == TOK_SIZEOF) {
+		ASTNode *operand = node->unaryOp.value;
+		const EvalType *type = operand->type == AST_TYPENAME ? EvalTypeNamed(operand->cast.type->name) : NULL;
+		if (type == NULL) return EvalFail(e, node, "Only sizeof an arithmetic type can be evaluated at compile time");
+		*out = EvalInteger(EVAL_UNSIGNED_LONG, type->bits == 1 ? 1 : type->bits / 8);
+		return true;
+	}
+	if (op == TOK_PLUSPLUS || op == TOK_MINUSMINUS) {
+		EvalLocal *local = EvalTarget(e, node->unaryOp.value);
+		if (local == NULL) return false;
+		EvalValue before = local->value;
+		if (!EvalBinary(e, node, op == TOK_PLUSPLUS ? TOK_PLUS : TOK_MINUS, before, EvalInteger(EVAL_INT, 1), &value)) return false;
+		if (!EvalConvert(e, node, &value, before.type)) return false;
+		local->value = value;
+		*out = node->unaryOp.postfix ? before : value;
+		return true;
+	}
+
+	if (!EvalNode(e, node->unaryOp.value, &value)) return false;
+	return EvalPrefix(e, node, op, value, out);
+}
+// - + ! ~ applied to a value
+bool EvalPrefix(Evaluator *e, ASTNode *node, TokenType op, EvalValue value, EvalValue *out) {
+	switch (op) {
+		case TOK_NOT:
+			*out = EvalInteger(EVAL_INT, !EvalIsTrue(value));
+			return true;
+		case TOK_PLUS:
+			if (!EvalConvert(e, node, &value, EvalPromote(value.type))) return false;
+			*out = value;
+			return true;
+		case TOK_MINUS:
+			return EvalBinary(e, node, TOK_MINUS, EvalInteger(EVAL_INT, 0), value, out);
+		case TOK_BITNOT:
+			if (value.type->isFloat) return EvalFail(e, node, "Invalid operand to ~");
+			if (!EvalConvert(e, node, &value, EvalPromote(value.type))) return false;
+			*out = EvalInteger(value.type, EvalWrap(value.type, ~(unsigned long long) value.i));
+			return true;
+		default:
+			return EvalFail(e, node, "Pointers cannot be evaluated at compile time");
+	}
+}
+static bool EvalCall(Evaluator *e, ASTNode *node, EvalValue *out) {
+	ASTNode *callee = node->call.callee;
+	EvalName name;
+	if (callee->type != AST_IDENTIFIER || e->resolve == NULL || !e->resolve(e->context, callee->identifier, true, &name) || name.function == NULL) {
+		return EvalFail(e, callee, "Only constexpr and compiletime functions can be called at compile time");
+	}
+	ASTNode *declaration = name.function;
+	ASTNode *function = declaration->expression.body;
+	if (!declaration->expression.isConstexpr && !declaration->expression.isCompiletime) {
+		return EvalFail(e, callee, "%s is not constexpr or compiletime, so it cannot be called at compile time", callee->identifier);
+	}
+	if (node->call.arguments->length != function->function.parameters->length) {
+		return EvalFail(e, callee, "%s takes %d arguments, %d given", callee->identifier, function->function.parameters->length, node->call.arguments->length);
+	}
+	if (e->depth >= EVAL_MAX_DEPTH) return EvalFail(e, node, "Compile-time calls nested deeper than %d", EVAL_MAX_DEPTH);
+
+	// Arguments are evaluated in the caller's frame, then become the callee's first locals
+	int base = e->localCount;
+	ASTNodeNode *argument, *parameter = function->function.parameters->first;
+	for (argument = node->call.arguments->first; argument; argument = argument->prev, parameter = parameter->prev) {
+		const EvalType *type = EvalTypeNamed(parameter->node->expression.type->name);
+		EvalValue value;
+		if (type == NULL) return EvalFail(e, parameter->node, "%s has a type that cannot be evaluated at compile time", parameter->node->expression.name);
+		if (!EvalNode(e, argument->node, &value) || !EvalConvert(e, argument->node, &value, type)) {
+			e->localCount = base;
+			return false;
+		}
+		EvalPushLocal(e, parameter->node->expression.name, value);
+	}
+
+	int frame = e->frame;
+	e->frame = base;
+	e->depth++;
+	e->returned = false;
+	EvalFlow flow;
+	bool ok = EvalStatementList(e, function->function.body->scope.body, &flow);
+	e->depth--;
+	e->frame = frame;
+	e->localCount = base;
+	if (!ok) return false;
+
+	const EvalType *type = EvalTypeNamed(declaration->expression.type->name);
+	if (type == NULL) return EvalFail(e, callee, "%s returns a type that cannot be evaluated at compile time", callee->identifier);
+	if (flow != EVAL_RETURN || !e->returned) return EvalFail(e, callee, "%s did not return a value", callee->identifier);
+	*out = e->returnValue;
+	return EvalConvert(e, node, out, type);
+}
+static bool EvalNode(Evaluator *e, ASTNode *node, EvalValue *out) {
+	if (!EvalStep(e, node)) return false;
+	switch (node->type) {
+		case AST_INTLIT:
+		case AST_CHARLIT:
+		case AST_FLOATLIT:
+		case AST_STRINGLIT:
+			return EvalLiteral(e, node, out);
+		case AST_CONSTANT:
+			*out = *node->constant;
+			return true;
+		case AST_IDENTIFIER:
+			return EvalIdentifier(e, node, out);
+		case AST_BINARYOP: {
+			TokenType op = node->binaryOp.op;
+			EvalValue left, right;
+			if (ASTInfixPrecedence(op) == PREC_ASSIGNMENT) return EvalAssignment(e, node, out);
+			if (op == TOK_OPENBRACKET || op == TOK_DOT || op == TOK_ARROW) return EvalFail(e, node, "Arrays, structs and pointers cannot be evaluated at compile time");
+			if (!EvalNode(e, node->binaryOp.left, &left)) return false;
+			if (op == TOK_AND || op == TOK_OR) {
+				// Short-circuit, the right side may not be evaluable
+				bool result = EvalIsTrue(left);
+				if (result == (op == TOK_AND)) {
+					if (!EvalNode(e, node->binaryOp.right, &right)) return false;
+					result = EvalIsTrue(right);
+				}
+				*out = EvalInteger(EVAL_INT, result);
+				return true;
+			}
+			if (!EvalNode(e, node->binaryOp.right, &right)) return false;
+			return EvalBinary(e, node, op, left, right, out);
+		}
+		case AST_UNARYOP:
+			return EvalUnary(e, node, out);
+		case AST_TERNARYOP: {
+			EvalValue condition;
+			if (!EvalNode(e, node->ternaryOp.condition, &condition)) return false;
+			return EvalNode(e, EvalIsTrue(condition) ? node->ternaryOp.trueValue : node->ternaryOp.falseValue, out);
+		}
+		case AST_CAST: {
+			const EvalType *type = EvalTypeNamed(node->cast.type->name);
+			if (type == NULL) return EvalFail(e, node, "Casts to %s cannot be evaluated at compile time", node->cast.type->name);
+			return EvalNode(e, node->cast.value, out) && EvalConvert(e, node, out, type);
+		}
+		case AST_CALL:
+			return EvalCall(e, node, out);
+		default:
+			return EvalFail(e, node, "This cannot be evaluated at compile time");
+	}
+}
+
+static bool EvalStatementList(Evaluator *e, ASTQueue *body, EvalFlow *flow) {
+	ASTNodeNode *item;
+	int scope = e->localCount;
+	*flow = EVAL_NEXT;
+	for (item = body->first; item && *flow == EVAL_NEXT; item = item->prev) *flow = EvalStatement(e, item->node);
+	e->localCount = scope;
+	return *flow != EVAL_FAILED;
+}
+static EvalFlow EvalLoopBody(Evaluator *e, ASTNode *body) {
+	EvalFlow flow = body ? EvalStatement(e, body) : EVAL_NEXT;
+	return flow == EVAL_CONTINUE ? EVAL_NEXT : flow;
+}
+static bool EvalCondition(Evaluator *e, ASTNode *node, bool *result) {
+	EvalValue value;
+	if (node == NULL) {
+		*result = true;
+		return true;
+	}
+	if (!EvalNode(e, node, &value)) return false;
+	*result = EvalIsTrue(value);
+	return true;
+}
+static EvalFlow EvalStatement(Evaluator *e, ASTNode *node) {
+	EvalValue value;
+	EvalFlow flow;
+	bool condition;
+	int scope;
+	if (!EvalStep(e, node)) return EVAL_FAILED;
+	switch (node->type) {
+		case AST_SCOPE:
+			EvalStatementList(e, node->scope.body, &flow);
+			return flow;
+		case AST_EXPRESSION: {
+			const EvalType *type = EvalTypeNamed(node->expression.type->name);
+			if (node->expression.body && node->expression.body->type == AST_FUNCTION) {
+				EvalFail(e, node, "Functions cannot be defined inside other functions");
+				return EVAL_FAILED;
+			}
+			if (type == NULL) {
+				EvalFail(e, node, "%s has a type that cannot be evaluated at compile time", node->expression.name);
+				return EVAL_FAILED;
+			}
+			if (node->expression.body == NULL) value = EvalInteger(EVAL_INT, 0);
+			else if (!EvalNode(e, node->expression.body, &value)) return EVAL_FAILED;
+			if (!EvalConvert(e, node, &value, type)) return EVAL_FAILED;
+			EvalPushLocal(e, node->expression.name, value);
+			return EVAL_NEXT;
+		}
+		case AST_RETURN:
+			e->returned = node->returnStatement.expression != NULL;
+			if (e->returned && !EvalNode(e, node->returnStatement.expression, &e->returnValue)) return EVAL_FAILED;
+			return EVAL_RETURN;
+		case AST_IF:
+			if (!EvalCondition(e, node->ifStatement.condition, &condition)) return EVAL_FAILED;
+			if (condition) return EvalStatement(e, node->ifStatement.then);
+			return node->ifStatement.otherwise ? EvalStatement(e, node->ifStatement.otherwise) : EVAL_NEXT;
+		case AST_WHILE:
+			while (1) {
+				if (!EvalCondition(e, node->loop.condition, &condition)) return EVAL_FAILED;
+				if (!condition) return EVAL_NEXT;
+				flow = EvalLoopBody(e, node->loop.body);
+				if (flow == EVAL_BREAK) return EVAL_NEXT;
+				if (flow != EVAL_NEXT) return flow;
+			}
+		case AST_FOR:
+			scope = e->localCount;
+			flow = EVAL_NEXT;
+			if (node->loop.init) {
+				if (node->loop.init->type == AST_EXPRESSION) flow = EvalStatement(e, node->loop.init);
+				else if (!EvalNode(e, node->loop.init, &value)) flow = EVAL_FAILED;
+			}
+			while (flow == EVAL_NEXT) {
+				if (!EvalCondition(e, node->loop.condition, &condition)) flow = EVAL_FAILED;
+				else if (!condition) break;
+				else {
+					flow = EvalLoopBody(e, node->loop.body);
+					if (flow == EVAL_NEXT && node->loop.step && !EvalNode(e, node->loop.step, &value)) flow = EVAL_FAILED;
+				}
+			}
+			e->localCount = scope;
+			return flow == EVAL_BREAK ? EVAL_NEXT : flow;
+		case AST_BREAK:
+			return EVAL_BREAK;
+		case AST_CONTINUE:
+			return EVAL_CONTINUE;
+		default:
+			// Expression statement
+			return EvalNode(e, node, &value) ? EVAL_NEXT : EVAL_FAILED;
+	}
+}
+
+void EvalInit(Evaluator *e, CompilerState *state, EvalResolver resolve, void *context) {
+	*e = (Evaluator) { 0 };
+	e->state = state;
+	e->resolve = resolve;
+	e->context = context;
+}
+// Evaluates an expression outside any function; names resolve through the
+// resolver. On failure error and errorNode say why.
+bool EvalExpression(Evaluator *e, ASTNode *node, EvalValue *result) {
+	e->steps = 0;
+	e->deadline = EvalNow() + EVAL_TIME_LIMIT;
+	e->error = NULL;
+	e->errorNode = NULL;
+	e->exhausted = false;
+	e->timedOut = false;
+	e->localCount = e->frame = e->depth = 0;
+	bool ok = EvalNode(e, node, result);
+	e->evaluations++;
+	e->totalSteps += e->steps;
+	return ok;
+}
+// A C literal of the value's type, parenthesized when negative so it can
+// stand for any operand. False for infinities and NaN, C has no literal.
+bool EvalFormat(EvalValue value, Buffer *out) {
+	const EvalType *type = value.type;
+	if (type->isFloat) {
+		char text[64];
+		if (isinf(value.f) || isnan(value.f)) return false;
+		int length = snprintf(text, sizeof(text), "%.*g", type->bits == 32 ? 9 : 17, value.f);
+		if (!strpbrk(text, ".e")) length += snprintf(text + length, sizeof(text) - length, ".0");
+		BufferAppendf(out, value.f < 0 || (value.f == 0 && signbit(value.f)) ? "(%s%s)" : "%s%s", text, type->suffix);
+		return true;
+	}
+	if (type->isUnsigned) {
+		BufferAppendf(out, "%llu%s", (unsigned long long) value.i, type->suffix);
+		return true;
+	}
+	if (type->bits >= 64 && value.i == (-0x7FFFFFFFFFFFFFFFLL - 1)) BufferAppendf(out, "(-0x7FFFFFFFFFFFFFFF%s - 1)", type->suffix);
+	else if (type->bits == 32 && value.i == -0x7FFFFFFFLL - 1) BufferAppendString(out, "(-2147483647 - 1)");
+	else if (value.i < 0) BufferAppendf(out, "(%lld%s)", value.i, type->suffix);
+	else BufferAppendf(out, "%lld%s", value.i, type->suffix);
+	return true;
+}
+void EvalFree(Evaluator *e) {
+	free(e->locals);
+	e->locals = NULL;
+	e->localCount = e->localCapacity = 0;
+}
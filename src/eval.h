@@ -0,0 +1,86 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "parser.h"
+#include "buffer.h"
+
+// Wall-clock limit of each evaluation in seconds, on top of its step budget.
+// Only the step budget may change the C: hitting this limit is an error.
+#define EVAL_TIME_LIMIT 2.0
+// Nested calls, so runaway recursion fails cleanly instead of overflowing
+#define EVAL_MAX_DEPTH 1000
+
+typedef struct EvalType EvalType;
+typedef struct EvalValue EvalValue;
+typedef struct EvalName EvalName;
+typedef struct EvalLocal EvalLocal;
+typedef struct Evaluator Evaluator;
+
+// An arithmetic C type as the evaluator models it
+struct EvalType {
+	const char *name;
+	unsigned char bits;
+	bool isUnsigned;
+	bool isFloat;
+	const char *suffix;	// Of its literals
+};
+struct EvalValue {
+	const EvalType *type;
+	union {
+		long long i;	// Integers, unsigned ones as their bits, wrapped to the type's width
+		double f;	// Floats, rounded to float for float
+	};
+};
+// What a name that is not a local of an evaluated call refers to
+struct EvalName {
+	bool constant;
+	EvalValue value;
+	ASTNode *function;	// Declaration of a function, NULL for anything else
+};
+// Looks a name up for the evaluator; inside a call only file scope names
+// are visible, so globalOnly skips the caller's locals
+typedef bool (*EvalResolver)(void *context, const char *name, bool globalOnly, EvalName *result);
+
+struct EvalLocal {
+	const char *name;
+	EvalValue value;
+};
+// AST interpreter for constexpr and compiletime declarations. Only the
+// arithmetic subset of the language is evaluated: integer and floating
+// types, control flow and calls to constexpr and compiletime functions.
+struct Evaluator {
+	CompilerState *state;
+	EvalResolver resolve;
+	void *context;
+	EvalLocal *locals;	// Of the calls being evaluated, innermost last
+	int localCount;
+	int localCapacity;
+	int frame;		// First local of the innermost call
+	int depth;		// Calls being evaluated
+	EvalValue returnValue;
+	bool returned;		// returnValue holds a value
+	long steps;		// Of the current evaluation
+	double deadline;
+	const char *error;	// Why the last evaluation failed
+	ASTNode *errorNode;
+	bool exhausted;		// It failed by running out of steps
+	bool timedOut;		// It failed by running out of time
+	char message[160];
+	// Statistics
+	long evaluations;
+	long totalSteps;
+};
+
+void EvalInit(Evaluator *e, CompilerState *state, EvalResolver resolve, void *context);
+bool EvalExpression(Evaluator *e, ASTNode *node, EvalValue *result);
+bool EvalLiteral(Evaluator *e, ASTNode *node, EvalValue *out);
+bool EvalBinary(Evaluator *e, ASTNode *node, TokenType op, EvalValue a, EvalValue b, EvalValue *out);
+bool EvalPrefix(Evaluator *e, ASTNode *node, TokenType op, EvalValue value, EvalValue *out);
+const EvalType *EvalTypeNamed(const char *name);
+const EvalType *EvalPromote(const EvalType *type);
+const EvalType *EvalCommonType(const EvalType *a, const EvalType *b);
+bool EvalConvert(Evaluator *e, ASTNode *node, EvalValue *value, const EvalType *type);
+bool EvalFormat(EvalValue value, Buffer *out);
+void EvalFree(Evaluator *e);
+
+#endif
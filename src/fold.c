@@ -0,0 +1,476 @@
+#include <math.h>
+#include "fold.h"
+
+// What folding a node of the flat tree gave
+struct FoldNode {
+	EvalValue value;	// When constant
+	const EvalType *type;	// Its arithmetic type, when known
+	ASTIndex node;		// What stands for it now, itself unless it was replaced
+	ASTIndex branch;	// The if or while it is the condition of
+	bool constant;
+	bool keep;		// As a statement, false when it does nothing
+	bool skipped;		// Folding does not reach it
+	bool changed;		// Its children are not the tree node's any more
+};
+
+// Arithmetic type of the variable an identifier names, NULL for functions,
+// generics, names not declared before their use and anything else
+static const EvalType *FoldDeclaredType(ASTNode *identifier) {
+	ASTNode *declaration = identifier->declaration;
+	if (declaration == NULL || declaration->type != AST_EXPRESSION) return NULL;
+	if (declaration->expression.body && declaration->expression.body->type == AST_FUNCTION) return NULL;
+	return EvalTypeNamed(declaration->expression.type->name);
+}
+
+static bool FoldIsLiteral(NodeType kind) {
+	return kind == AST_INTLIT || kind == AST_CHARLIT || kind == AST_FLOATLIT || kind == AST_CONSTANT;
+}
+// Appends a node folding made to the arrays, along with its tree node
+static ASTIndex FoldPush(Folder *f, ASTNode *node, ASTIndex lhs, ASTIndex rhs) {
+	TokenType op = node->type == AST_CONSTANT ? (node->constant->type->isFloat ? TOK_DOUBLELIT : TOK_LONGLONGLIT) : node->token.type;
+	ASTIndex index = ASTFlatPush(&f->ast, node->type, op, node->token.offset, lhs, rhs);
+	f->ast.nodes[index] = node;
+	return index;
+}
+// Replaces a constant subtree by its value, returns what stands for it.
+// Infinities and NaN have no C literal and stay as they are written.
+static ASTIndex FoldMaterialize(Folder *f, ASTIndex index, EvalValue value) {
+	if (FoldIsLiteral((NodeType) f->ast.kind[index]) || (value.type->isFloat && !isfinite(value.f))) return index;
+	EvalValue *copy = (EvalValue *) ArenaCalloc(&f->state->arena, 1, sizeof(EvalValue));
+	ASTNode *constant = (ASTNode *) ArenaCalloc(&f->state->arena, 1, sizeof(ASTNode));
+	unsigned long long bits;
+	*copy = value;
+	constant->type = AST_CONSTANT;
+	constant->token = f->ast.nodes[index]->token;
+	constant->constant = copy;
+	memcpy(&bits, &copy->i, sizeof(bits));
+	f->folded++;
+	return FoldPush(f, constant, (ASTIndex) bits, (ASTIndex) (bits >> 32));
+}
+// Points a child slot of index at value. Slots are only good until the
+// next push, so value must be computed first.
+static void FoldSet(Folder *f, ASTIndex index, ASTIndex *slot, ASTIndex value) {
+	if (*slot == value) return;
+	*slot = value;
+	f->nodes[index].changed = true;
+}
+// An expression whose own value is needed, not just its children
+static ASTIndex FoldValue(Folder *f, ASTIndex index) {
+	FoldNode *node = &f->nodes[index];
+	return node->constant ? FoldMaterialize(f, index, node->value) : node->node;
+}
+// A block in place of the statement at index, holding item unless it is AST_NONE
+static ASTIndex FoldScope(Folder *f, ASTIndex index, ASTIndex item) {
+	ASTNode *scope = (ASTNode *) ArenaCalloc(&f->state->arena, 1, sizeof(ASTNode));
+	ASTIndex list[2] = { item != AST_NONE, item };
+	scope->type = AST_SCOPE;
+	scope->token = f->ast.nodes[index]->token;
+	scope->scope.body = (ASTQueue *) ArenaCalloc(&f->state->arena, 1, sizeof(ASTQueue));
+	if (item != AST_NONE) ASTQueuePush(&f->state->arena, scope->scope.body, f->ast.nodes[item]);
+	return FoldPush(f, scope, AST_NONE, ASTFlatPushExtra(&f->ast, list, 1 + list[0]));
+}
+// What the evaluator refuses is undefined or has no value in C, so it is
+// reported and left for the C compiler to see as written
+static void FoldWarn(Folder *f) {
+	ASTNode *node = f->eval.errorNode;
+	if (node) WARNING_AT(f->state, node->token.line, node->token.column, f->eval.error);
+}
+
+static bool FoldIsTrue(EvalValue value) {
+	return value.type->isFloat ? value.f != 0 : value.i != 0;
+}
+
+// x op c or c op x becomes x when c is the identity of op, as long as the
+// result has exactly x's type: x must not be narrower than int, and c must
+// not widen it. x + 0 is left alone for floats, -0.0 + 0 is +0.0.
+static bool FoldIdentity(TokenType op, EvalValue constant, bool constantOnRight, const EvalType *other, const EvalType *result) {
+	if (constant.type->isFloat || other == NULL || result == NULL || other != EvalPromote(other) || result != other) return false;
+	long long c = constant.i;
+	switch (op) {
+		case TOK_STAR:
+			return c == 1;
+		case TOK_PLUS:
+			return c == 0 && !other->isFloat;
+		case TOK_SLASH:
+		case TOK_MINUS:
+			return constantOnRight && c == (op == TOK_SLASH);
+		case TOK_LSHIFT:
+		case TOK_RSHIFT:
+			return constantOnRight && c == 0;
+		case TOK_BITOR:
+		case TOK_BITXOR:
+			return c == 0;
+		default:
+			return false;
+	}
+}
+static void FoldBinary(Folder *f, ASTIndex index) {
+	FoldNode *result = &f->nodes[index];
+	ASTNode *node = f->ast.nodes[index];
+	TokenType op = (TokenType) f->ast.op[index];
+	ASTIndex leftIndex = f->ast.lhs[index], rightIndex = f->ast.rhs[index], slot;
+	FoldNode *left = &f->nodes[leftIndex], *right = &f->nodes[rightIndex];
+
+	FoldSet(f, index, &f->ast.lhs[index], left->node);
+	FoldSet(f, index, &f->ast.rhs[index], right->node);
+	if (ASTInfixPrecedence(op) == PREC_ASSIGNMENT) {
+		slot = FoldValue(f, rightIndex);
+		FoldSet(f, index, &f->ast.rhs[index], slot);
+		result->type = left->type;
+		return;
+	}
+	if (op == TOK_OPENBRACKET || op == TOK_DOT || op == TOK_ARROW) {
+		slot = FoldValue(f, leftIndex);
+		FoldSet(f, index, &f->ast.lhs[index], slot);
+		if (op == TOK_OPENBRACKET) {
+			slot = FoldValue(f, rightIndex);
+			FoldSet(f, index, &f->ast.rhs[index], slot);
+		}
+		return;
+	}
+
+	if (op == TOK_AND || op == TOK_OR) {
+		// A constant left side that decides the result makes the right side dead
+		result->type = EvalTypeNamed("int");
+		if (left->constant && (FoldIsTrue(left->value) == (op == TOK_OR) || right->constant)) {
+			bool value = FoldIsTrue(left->value);
+			if (value == (op == TOK_AND)) value = FoldIsTrue(right->value);
+			result->value = (EvalValue) { .type = result->type, .i = value };
+			result->constant = true;
+			return;
+		}
+	}
+	else if (left->constant && right->constant) {
+		if (EvalBinary(&f->eval, node, op, left->value, right->value, &result->value)) {
+			result->type = result->value.type;
+			result->constant = true;
+			return;
+		}
+		FoldWarn(f);
+	}
+
+	// The result type, when both sides have a known arithmetic type
+	if (op == TOK_AND || op == TOK_OR) {}
+	else if (op == TOK_EQUAL || op == TOK_NOTEQUAL || op == TOK_LESSERTHAN || op == TOK_GREATERTHAN || op == TOK_LESSEROREQUAL || op == TOK_GREATEROREQUAL) result->type = EvalTypeNamed("int");
+	else if (op == TOK_LSHIFT || op == TOK_RSHIFT) result->type = left->type ? EvalPromote(left->type) : NULL;
+	else result->type = left->type && right->type ? EvalCommonType(left->type, right->type) : NULL;
+
+	if (left->constant != right->constant) {
+		bool onRight = right->constant;
+		if (FoldIdentity(op, onRight ? right->value : left->value, onRight, onRight ? left->type : right->type, result->type)) {
+			result->node = onRight ? left->node : right->node;
+			f->simplified++;
+			return;
+		}
+	}
+	slot = FoldValue(f, leftIndex);
+	FoldSet(f, index, &f->ast.lhs[index], slot);
+	slot = FoldValue(f, rightIndex);
+	FoldSet(f, index, &f->ast.rhs[index], slot);
+}
+// c ? a : b becomes the live arm, converted to the type both arms share
+static void FoldTernary(Folder *f, ASTIndex index) {
+	FoldNode *result = &f->nodes[index];
+	ASTIndex rhs = f->ast.rhs[index], arms[2] = { f->ast.extra[rhs], f->ast.extra[rhs + 1] };
+	ASTIndex condition = f->ast.lhs[index], slot;
+	const EvalType *armTypes[2] = { f->nodes[arms[0]].type, f->nodes[arms[1]].type };
+
+	FoldSet(f, index, &f->ast.lhs[index], f->nodes[condition].node);
+	FoldSet(f, index, &f->ast.extra[rhs], f->nodes[arms[0]].node);
+	FoldSet(f, index, &f->ast.extra[rhs + 1], f->nodes[arms[1]].node);
+	result->type = armTypes[0] && armTypes[1] ? EvalCommonType(armTypes[0], armTypes[1]) : NULL;
+
+	if (f->nodes[condition].constant && result->type) {
+		FoldNode *live = &f->nodes[arms[FoldIsTrue(f->nodes[condition].value) ? 0 : 1]];
+		if (live->constant) {
+			EvalValue value = live->value;
+			if (EvalConvert(&f->eval, f->ast.nodes[index], &value, result->type)) {
+				result->value = value;
+				result->constant = true;
+				return;
+			}
+		}
+		else if (live->type == result->type) {
+			result->node = live->node;
+			f->simplified++;
+			return;
+		}
+	}
+	slot = FoldValue(f, condition);
+	FoldSet(f, index, &f->ast.lhs[index], slot);
+	slot = FoldValue(f, arms[0]);
+	FoldSet(f, index, &f->ast.extra[rhs], slot);
+	slot = FoldValue(f, arms[1]);
+	FoldSet(f, index, &f->ast.extra[rhs + 1], slot);
+}
+// Only the largest constant subtrees become literals: constant children of
+// an expression that is not are replaced by their value
+static void FoldExpression(Folder *f, ASTIndex index) {
+	FoldNode *result = &f->nodes[index], *inner;
+	ASTNode *node = f->ast.nodes[index];
+	ASTIndex lhs = f->ast.lhs[index], rhs = f->ast.rhs[index], i, slot;
+	switch (node->type) {
+		case AST_INTLIT:
+		case AST_CHARLIT:
+		case AST_FLOATLIT:
+			result->constant = EvalLiteral(&f->eval, node, &result->value);
+			if (result->constant) result->type = result->value.type;
+			break;
+		case AST_CONSTANT:
+			result->value = *node->constant;
+			result->type = result->value.type;
+			result->constant = true;
+			break;
+		case AST_IDENTIFIER:
+			result->type = FoldDeclaredType(node);
+			break;
+		case AST_CAST:
+			inner = &f->nodes[lhs];
+			result->type = EvalTypeNamed(node->cast.type->name);
+			FoldSet(f, index, &f->ast.lhs[index], inner->node);
+			if (inner->constant) {
+				EvalValue value = inner->value;
+				if (result->type && EvalConvert(&f->eval, node, &value, result->type)) {
+					result->value = value;
+					result->constant = true;
+					break;
+				}
+				slot = FoldMaterialize(f, lhs, value);
+				FoldSet(f, index, &f->ast.lhs[index], slot);
+			}
+			break;
+		case AST_UNARYOP: {
+			TokenType op = node->unaryOp.op;
+			inner = &f->nodes[lhs];
+			// sizeof depends on the target, and the rest needs an lvalue
+			if (op == TOK_SIZEOF) break;
+			if (op != TOK_MINUS && op != TOK_PLUS && op != TOK_NOT && op != TOK_BITNOT) {
+				slot = FoldValue(f, lhs);
+				FoldSet(f, index, &f->ast.lhs[index], slot);
+				break;
+			}
+			FoldSet(f, index, &f->ast.lhs[index], inner->node);
+			if (inner->constant) {
+				if (EvalPrefix(&f->eval, node, op, inner->value, &result->value)) {
+					result->type = result->value.type;
+					result->constant = true;
+					break;
+				}
+				FoldWarn(f);
+				slot = FoldMaterialize(f, lhs, inner->value);
+				FoldSet(f, index, &f->ast.lhs[index], slot);
+			}
+			result->type = op == TOK_NOT ? EvalTypeNamed("int") : inner->type ? EvalPromote(inner->type) : NULL;
+			break;
+		}
+		case AST_BINARYOP:
+			FoldBinary(f, index);
+			break;
+		case AST_TERNARYOP:
+			FoldTernary(f, index);
+			break;
+		case AST_CALL:
+			for (i = 0; i < f->ast.extra[rhs]; i++) {
+				slot = FoldValue(f, f->ast.extra[rhs + 1 + i]);
+				FoldSet(f, index, &f->ast.extra[rhs + 1 + i], slot);
+			}
+			break;
+		default:
+			break;
+	}
+	// An expression statement that folds to a constant does nothing
+	result->keep = !result->constant;
+}
+
+// Drops the statements of a list that turned out to do nothing
+static void FoldStatements(Folder *f, ASTIndex index, ASTIndex list) {
+	ASTIndex count = f->ast.extra[list], kept = 0, i;
+	for (i = 0; i < count; i++) {
+		FoldNode *item = &f->nodes[f->ast.extra[list + 1 + i]];
+		if (item->keep) FoldSet(f, index, &f->ast.extra[list + 1 + kept++], item->node);
+		else f->simplified++;
+	}
+	FoldSet(f, index, &f->ast.extra[list], kept);
+}
+// The statement of an if or a loop, an empty block when it folded away
+static ASTIndex FoldBody(Folder *f, ASTIndex index) {
+	if (index == AST_NONE || f->nodes[index].keep) return f->nodes[index].node;
+	return FoldScope(f, f->nodes[index].node, AST_NONE);
+}
+static void FoldStatement(Folder *f, ASTIndex index) {
+	FoldNode *result = &f->nodes[index];
+	ASTIndex lhs = f->ast.lhs[index], rhs = f->ast.rhs[index], slot;
+	result->keep = true;
+	switch ((NodeType) f->ast.kind[index]) {
+		case AST_EXPRESSION:
+			if (lhs == AST_NONE || f->ast.kind[lhs] != AST_FUNCTION) {
+				slot = FoldValue(f, lhs);
+				FoldSet(f, index, &f->ast.lhs[index], slot);
+			}
+			break;
+		case AST_FUNCTION:
+			FoldSet(f, index, &f->ast.lhs[index], f->nodes[lhs].node);
+			break;
+		case AST_SCOPE:
+		case AST_GENERICARM:
+			FoldStatements(f, index, rhs);
+			break;
+		case AST_RETURN:
+			slot = FoldValue(f, lhs);
+			FoldSet(f, index, &f->ast.lhs[index], slot);
+			break;
+		case AST_IF: {
+			ASTIndex then = f->ast.extra[rhs], otherwise = f->ast.extra[rhs + 1];
+			FoldSet(f, index, &f->ast.lhs[index], f->nodes[lhs].node);
+			// A constant condition keeps only the live branch
+			if (f->nodes[lhs].constant) {
+				ASTIndex live = FoldIsTrue(f->nodes[lhs].value) ? then : otherwise;
+				f->simplified++;
+				if (live == AST_NONE) result->keep = false;
+				// A lone declaration needs the scope of a block
+				else if (f->ast.kind[live] == AST_EXPRESSION) result->node = FoldScope(f, live, live);
+				else {
+					result->node = f->nodes[live].node;
+					result->keep = f->nodes[live].keep;
+				}
+				break;
+			}
+			slot = FoldBody(f, then);
+			FoldSet(f, index, &f->ast.extra[rhs], slot);
+			slot = FoldBody(f, otherwise);
+			FoldSet(f, index, &f->ast.extra[rhs + 1], slot);
+			break;
+		}
+		case AST_WHILE:
+			FoldSet(f, index, &f->ast.lhs[index], f->nodes[lhs].node);
+			if (f->nodes[lhs].constant) {
+				if (!FoldIsTrue(f->nodes[lhs].value)) {
+					result->keep = false;
+					break;
+				}
+				slot = FoldMaterialize(f, lhs, f->nodes[lhs].value);
+				FoldSet(f, index, &f->ast.lhs[index], slot);
+			}
+			slot = FoldBody(f, rhs);
+			FoldSet(f, index, &f->ast.rhs[index], slot);
+			break;
+		case AST_FOR: {
+			ASTIndex init = f->ast.extra[rhs];
+			slot = init != AST_NONE && f->ast.kind[init] == AST_EXPRESSION ? f->nodes[init].node : FoldValue(f, init);
+			FoldSet(f, index, &f->ast.extra[rhs], slot);
+			slot = FoldValue(f, f->ast.extra[rhs + 1]);
+			FoldSet(f, index, &f->ast.extra[rhs + 1], slot);
+			slot = FoldValue(f, f->ast.extra[rhs + 2]);
+			FoldSet(f, index, &f->ast.extra[rhs + 2], slot);
+			slot = FoldBody(f, f->ast.extra[rhs + 3]);
+			FoldSet(f, index, &f->ast.extra[rhs + 3], slot);
+			break;
+		}
+		case AST_GENERIC:
+		case AST_IMPORT:
+		case AST_BREAK:
+		case AST_CONTINUE:
+		case AST_ERROR:
+			break;
+		default:
+			FoldExpression(f, index);
+			break;
+	}
+}
+// Whether folding leaves some child of index alone: callees, parameters,
+// the operand of sizeof and member names are kept as they are
+static bool FoldPrunes(ASTFlat *ast, ASTIndex index) {
+	TokenType op = (TokenType) ast->op[index];
+	switch ((NodeType) ast->kind[index]) {
+		case AST_BINARYOP:
+			return op == TOK_DOT || op == TOK_ARROW;
+		case AST_UNARYOP:
+			return op == TOK_SIZEOF;
+		case AST_CALL:
+		case AST_FUNCTION:
+		case AST_GENERIC:
+			return true;
+		default:
+			return false;
+	}
+}
+static bool FoldReaches(ASTFlat *ast, ASTIndex index, ASTIndex i) {
+	switch ((NodeType) ast->kind[index]) {
+		case AST_BINARYOP:
+			return i == 0;
+		case AST_UNARYOP:
+			return false;
+		case AST_CALL:
+			return i > 0;
+		case AST_FUNCTION:
+			return i == 0;
+		case AST_GENERIC:
+			return i >= ast->extra[ast->rhs[index] + 3];
+		default:
+			return true;
+	}
+}
+// Skips the subtree of a branch a constant condition rules out. In
+// post-order it starts right after the sibling before it.
+static void FoldSkip(Folder *f, ASTIndex sibling, ASTIndex branch) {
+	ASTIndex i;
+	for (i = sibling + 1; i <= branch; i++) f->nodes[i].skipped = true;
+}
+
+// Folds a file parsed by ASTParseNode
+void FoldTree(Folder *f, CompilerState *state, ASTNode *root) {
+	ASTIndex top, count, i, j, *child;
+	*f = (Folder) { 0 };
+	f->state = state;
+	EvalInit(&f->eval, state, NULL, NULL);
+	if (root == NULL || root->type != AST_SCOPE) return;
+	if (!ASTFlatInit(&f->ast, 1024) || !ASTFlatKeepNodes(&f->ast)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	top = ASTFlatten(&f->ast, NULL, root);
+	count = f->ast.count;
+	f->nodes = (FoldNode *) calloc(count, sizeof(FoldNode));
+	if (f->nodes == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	for (i = 1; i < count; i++) {
+		f->nodes[i].node = i;
+		if (f->ast.kind[i] == AST_IF || f->ast.kind[i] == AST_WHILE) f->nodes[f->ast.lhs[i]].branch = i;
+	}
+	// Parents come after their children, so a backward scan passes on
+	// what folding does not reach
+	for (i = top; i > 0; i--) {
+		bool skipped = f->nodes[i].skipped;
+		if (!skipped && !FoldPrunes(&f->ast, i)) continue;
+		for (j = 0; (child = ASTFlatChild(&f->ast, i, j)); j++) {
+			if (skipped || !FoldReaches(&f->ast, i, j)) f->nodes[*child].skipped = true;
+		}
+	}
+
+	for (i = 1; i <= top; i++) {
+		FoldNode *node = &f->nodes[i];
+		if (node->skipped) continue;
+		FoldStatement(f, i);
+		// A constant condition rules out the branch that comes after it
+		ASTIndex branch = node->branch, rhs = f->ast.rhs[branch];
+		if (!node->constant || branch == AST_NONE) continue;
+		if (f->ast.kind[branch] == AST_WHILE) {
+			if (!FoldIsTrue(node->value)) FoldSkip(f, i, rhs);
+		}
+		else if (FoldIsTrue(node->value)) FoldSkip(f, f->ast.extra[rhs] ? f->ast.extra[rhs] : i, f->ast.extra[rhs + 1]);
+		else FoldSkip(f, i, f->ast.extra[rhs]);
+	}
+
+	for (i = 1; i <= top; i++) {
+		if (f->nodes[i].changed) ASTFlatRelink(&f->ast, i);
+	}
+	free(f->nodes);
+	f->nodes = NULL;
+}
+void FoldFree(Folder *f) {
+	ASTFlatFree(&f->ast);
+	EvalFree(&f->eval);
+}
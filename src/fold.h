@@ -0,0 +1,28 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast.h"
+#include "eval.h"
+
+typedef struct Folder Folder;
+typedef struct FoldNode FoldNode;
+
+// Constant folding and algebraic simplification before the C is emitted.
+// The tree is flattened and folded in one forward scan over the arrays,
+// every node after its children, then the result is written back into the
+// tree. Operators are computed with the evaluator, so each literal kind
+// keeps its C type, promotions and overflow behavior; anything that would
+// be undefined is left alone.
+struct Folder {
+	CompilerState *state;
+	Evaluator eval;
+	ASTFlat ast;		// The tree being folded, with the nodes folding made
+	FoldNode *nodes;	// What each node of ast folded to, while folding
+	long folded;		// Nodes replaced by constants
+	long simplified;	// Identities and dead branches removed
+};
+
+void FoldTree(Folder *f, CompilerState *state, ASTNode *root);
+void FoldFree(Folder *f);
+
+#endif
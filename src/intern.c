@@ -0,0 +1,101 @@
+#include "intern.h"
+
+static unsigned int InternHash(const char *str, int length) {
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	int i;
+	for (i = 0; i < length; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+static bool InternGrowSlots(InternTable *t) {
+	int capacity = t->slotCapacity ? t->slotCapacity * 2 : 256;
+	int *slots = (int *) calloc(capacity, sizeof(int));
+	if (slots == NULL) return false;
+
+	int id;
+	for (id = 0; id < t->count; id++) {
+		unsigned int i = t->hashes[id] & (capacity - 1);
+		while (slots[i]) i = (i + 1) & (capacity - 1);
+		slots[i] = id + 1;
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->slotCapacity = capacity;
+	return true;
+}
+static bool InternGrowEntries(InternTable *t) {
+	int capacity = t->capacity ? t->capacity * 2 : 128;
+	const char **strings = (const char **) realloc(t->strings, capacity * sizeof(const char *));
+	if (strings == NULL) return false;
+	t->strings = strings;
+	int *lengths = (int *) realloc(t->lengths, capacity * sizeof(int));
+	if (lengths == NULL) return false;
+	t->lengths = lengths;
+	unsigned int *hashes = (unsigned int *) realloc(t->hashes, capacity * sizeof(unsigned int));
+	if (hashes == NULL) return false;
+	t->hashes = hashes;
+	t->capacity = capacity;
+	return true;
+}
+
+bool InternTableInit(InternTable *t, Arena *arena) {
+	*t = (InternTable) { 0 };
+	t->arena = arena;
+	return InternGrowSlots(t) && InternGrowEntries(t);
+}
+int InternId(InternTable *t, const char *str, int length) {
+	unsigned int hash = InternHash(str, length);
+	unsigned int mask = t->slotCapacity - 1;
+	unsigned int i = hash & mask;
+
+	t->lookups++;
+	t->bytesRequested += length + 1;
+	while (t->slots[i]) {
+		int id = t->slots[i] - 1;
+		if (t->hashes[id] == hash && t->lengths[id] == length && memcmp(t->strings[id], str, length) == 0) return id;
+		i = (i + 1) & mask;
+	}
+
+	// Keep the load factor under one half
+	if ((t->count + 1) * 2 > t->slotCapacity) {
+		if (!InternGrowSlots(t)) return -1;
+		mask = t->slotCapacity - 1;
+		i = hash & mask;
+		while (t->slots[i]) i = (i + 1) & mask;
+	}
+	if (t->count == t->capacity && !InternGrowEntries(t)) return -1;
+
+	char *copy = ArenaStrndup(t->arena, str, length);
+	int id = t->count++;
+	t->strings[id] = copy;
+	t->lengths[id] = length;
+	t->hashes[id] = hash;
+	t->slots[i] = id + 1;
+	t->bytesStored += length + 1;
+	return id;
+}
+const char *InternString(InternTable *t, const char *str, int length) {
+	int id = InternId(t, str, length);
+	if (id < 0) return NULL;
+
+	return t->strings[id];
+}
+const char *InternLookup(InternTable *t, int id) {
+	if (id < 0 || id >= t->count) return NULL;
+
+	return t->strings[id];
+}
+void InternPrintStats(InternTable *t, FILE *stream) {
+	fprintf(stream, "Interned strings: %d unique out of %ld lookups, %ld bytes stored, %ld bytes saved\n",
+		t->count, t->lookups, t->bytesStored, t->bytesRequested - t->bytesStored);
+}
+void InternTableFree(InternTable *t) {
+	free(t->strings);
+	free(t->lengths);
+	free(t->hashes);
+	free(t->slots);
+	*t = (InternTable) { 0 };
+}
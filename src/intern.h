@@ -0,0 +1,36 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+typedef struct InternTable InternTable;
+
+// Every distinct string is stored once and gets a stable id and pointer,
+// so two interned strings are equal exactly when their pointers are equal
+struct InternTable {
+	const char **strings;	// id -> string
+	int *lengths;		// id -> length
+	unsigned int *hashes;	// id -> hash, to rehash without touching the text
+	int *slots;		// Open addressing table of id + 1, 0 is empty
+	int slotCapacity;
+	int count;
+	int capacity;
+	Arena *arena;		// Storage for the text, owned by the caller
+	// Statistics
+	long lookups;
+	long bytesRequested;
+	long bytesStored;
+};
+
+bool InternTableInit(InternTable *t, Arena *arena);
+int InternId(InternTable *t, const char *str, int length);
+const char *InternString(InternTable *t, const char *str, int length);
+const char *InternLookup(InternTable *t, int id);
+void InternPrintStats(InternTable *t, FILE *stream);
+void InternTableFree(InternTable *t);
+
+#endif
@@ -1,4 +1,7 @@
+#include <math.h>
 #include "lexer.h"
+#include "scan.h"
+#include "pool.h"
 
 TokenType TokenTypeParseString(const char *str) {
 	if (strcmp(str, "int") == 0)		return TOK_INT;
@@ -58,338 +61,636 @@ TokenType TokenTypeParseString(const char *str) {
 	return TOK_ID;
 }
 
-Token GetNextToken(CompilerState *state, char **input, int *line, int *column) {
-	// Ignore whitespace and track line/column numbers
-	while (isspace(**input)) {
-		if (**input == '\n') {
-			(*line)++;
-			*column = 0;
-		}
-		else (*column)++;
-		(*input)++;
-	}
-	// End of input
-	if (**input == '\0') return (Token) { TOK_EOF, NULL, *line, *column };
-	// Handle singleline comments
-	if (**input == '/' && (*input)[1] == '/') {
-		// Ignore until end of line, then return recursively
-		while (**input != '\n' && **input != '\0') (*input)++;
-		return GetNextToken(state, input, line, column);
-	}
-	// Handle multiline comments
-	if (**input == '/' && (*input)[1] == '*') {
-		(*input) += 2;
-		while (!(**input == '*' && (*input)[1] == '/') && **input != '\0') {
-			if (**input == '\n') {
-				(*line)++;
-				*column = 1;
+// Keyword recognition straight from a source span: dispatch on length, then on
+// the first character, so an identifier costs at most a couple of memcmp calls
+// instead of the strcmp chains in TokenIsKeyword and TokenTypeParseString.
+#define KEYWORD(kw, tok) if (memcmp(start, kw, len) == 0) return tok
+TokenType TokenKeywordLookup(const char *start, size_t len) {
+	switch (len) {
+		case 2:
+			switch (start[0]) {
+				case 'i': KEYWORD("if", TOK_IF); break;
+				case 'd': KEYWORD("do", TOK_DO); break;
 			}
-			else {
-				(*column)++;
+			break;
+		case 3:
+			switch (start[0]) {
+				case 'i': KEYWORD("int", TOK_INT); break;
+				case 'r': KEYWORD("ref", TOK_REF); break;
+				case 'f': KEYWORD("for", TOK_FOR); break;
 			}
-			(*input)++;
-		}
-		if (**input == '\0') {
-			fprintf(stderr, "Error: Unclosed block comment at line %d, column %d\n", *line, *column);
-			return (Token) { .type = TOK_ERROR, .value = NULL, .line = *line, .column = *column };
-		}
-		(*input) += 2;
-		return GetNextToken(state, input, line, column);
+			break;
+		case 4:
+			switch (start[0]) {
+				case 'c':
+					KEYWORD("char", TOK_CHAR);
+					KEYWORD("case", TOK_CASE);
+					break;
+				case 'v': KEYWORD("void", TOK_VOID); break;
+				case 'l': KEYWORD("long", TOK_LONG); break;
+				case 'b': KEYWORD("bool", TOK_BOOL); break;
+				case 't': KEYWORD("true", TOK_TRUE); break;
+				case 'a': KEYWORD("auto", TOK_AUTO); break;
+				case 'g': KEYWORD("goto", TOK_GOTO); break;
+				case 'e':
+					KEYWORD("else", TOK_ELSE);
+					KEYWORD("enum", TOK_ENUM);
+					break;
+			}
+			break;
+		case 5:
+			switch (start[0]) {
+				case 'f':
+					KEYWORD("float", TOK_FLOAT);
+					KEYWORD("false", TOK_FALSE);
+					break;
+				case 's': KEYWORD("short", TOK_SHORT); break;
+				case 'c': KEYWORD("const", TOK_CONST); break;
+				case 'a': KEYWORD("alloc", TOK_ALLOC); break;
+				case 'u': KEYWORD("union", TOK_UNION); break;
+				case 'w': KEYWORD("while", TOK_WHILE); break;
+				case 'b': KEYWORD("break", TOK_BREAK); break;
+				case 'm': KEYWORD("match", TOK_MATCH); break;
+			}
+			break;
+		case 6:
+			switch (start[0]) {
+				case 'd': KEYWORD("double", TOK_DOUBLE); break;
+				case 's':
+					KEYWORD("signed", TOK_SIGNED);
+					KEYWORD("string", TOK_STRING);
+					KEYWORD("static", TOK_STATIC);
+					KEYWORD("sizeof", TOK_SIZEOF);
+					KEYWORD("struct", TOK_STRUCT);
+					KEYWORD("switch", TOK_SWITCH);
+					break;
+				case 'l': KEYWORD("lambda", TOK_LAMBDA); break;
+				case 'e': KEYWORD("extern", TOK_EXTERN); break;
+				case 'i':
+					KEYWORD("inline", TOK_INLINE);
+					KEYWORD("import", TOK_IMPORT);
+					break;
+				case 'a':
+					KEYWORD("attach", TOK_ATTACH);
+					KEYWORD("atomic", TOK_ATOMIC);
+					break;
+				case 'r': KEYWORD("return", TOK_RETURN); break;
+				case 't': KEYWORD("typeof", TOK_TYPEOF); break;
+			}
+			break;
+		case 7:
+			switch (start[0]) {
+				case 'c': KEYWORD("complex", TOK_COMPLEX); break;
+				case 'n': KEYWORD("nullptr", TOK_NULLPTR); break;
+				case 'g': KEYWORD("generic", TOK_GENERIC); break;
+				case 'a':
+					KEYWORD("alignas", TOK_ALIGNAS);
+					KEYWORD("alignof", TOK_ALIGNOF);
+					break;
+				case 't': KEYWORD("typedef", TOK_TYPEDEF); break;
+				case 'd':
+					KEYWORD("dealloc", TOK_DEALLOC);
+					KEYWORD("default", TOK_DEFAULT);
+					break;
+			}
+			break;
+		case 8:
+			switch (start[0]) {
+				case 'u': KEYWORD("unsigned", TOK_UNSIGNED); break;
+				case 'v': KEYWORD("volatile", TOK_VOLATILE); break;
+				case 'r': KEYWORD("restrict", TOK_RESTRICT); break;
+				case 'c': KEYWORD("continue", TOK_CONTINUE); break;
+			}
+			break;
+		case 9:
+			switch (start[0]) {
+				case 'i': KEYWORD("imaginary", TOK_IMAGINARY); break;
+				case 'c': KEYWORD("constexpr", TOK_CONSTEXPR); break;
+			}
+			break;
+		case 11:
+			KEYWORD("compiletime", TOK_COMPILETIME);
+			break;
 	}
+	return TOK_ID;
+}
+#undef KEYWORD
 
-	// Handle multicharacter operators
-	if (**input == '=' && (*input)[1] == '=') {
-		(*input) += 2;
-		return (Token) { TOK_EQUAL, "==", *line, *column - 1 };
-	}
-	if (**input == '!' && (*input)[1] == '=') {
-		(*input) += 2;
-		return (Token) { TOK_NOTEQUAL, "!=", *line, *column - 1 };
-	}
-	if (**input == '<' && (*input)[1] == '=') {
-		(*input) += 2;
-		return (Token) { TOK_LESSEROREQUAL, "<=", *line, *column - 1 };
-	}
-	if (**input == '>' && (*input)[1] == '=') {
-		(*input) += 2;
-		return (Token) { TOK_GREATEROREQUAL, ">=", *line, *column - 1 };
-	}
-	if (**input == '&' && (*input)[1] == '&') {
-		(*input) += 2;
-		return (Token) { TOK_AND, "&&", *line, *column - 1 };
+// Character classes driving GetNextToken: the first byte of a token picks
+// its scanner with a single table lookup
+enum {
+	CC_OTHER = 0,
+	CC_SPACE,
+	CC_IDENT,
+	CC_DIGIT,
+	CC_DOT,
+	CC_OPERATOR,
+	CC_PUNCT,
+	CC_QUOTE
+};
+static const unsigned char charClass[256] = {
+	[' '] = CC_SPACE, ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE,
+	['a' ... 'z'] = CC_IDENT, ['A' ... 'Z'] = CC_IDENT, ['_'] = CC_IDENT,
+	['0' ... '9'] = CC_DIGIT,
+	['.'] = CC_DOT,
+	['='] = CC_OPERATOR, ['!'] = CC_OPERATOR, ['<'] = CC_OPERATOR, ['>'] = CC_OPERATOR,
+	['+'] = CC_OPERATOR, ['-'] = CC_OPERATOR, ['*'] = CC_OPERATOR, ['/'] = CC_OPERATOR,
+	['%'] = CC_OPERATOR, ['&'] = CC_OPERATOR, ['|'] = CC_OPERATOR, ['^'] = CC_OPERATOR,
+	['~'] = CC_OPERATOR,
+	['('] = CC_PUNCT, [')'] = CC_PUNCT, ['{'] = CC_PUNCT, ['}'] = CC_PUNCT, ['['] = CC_PUNCT,
+	[']'] = CC_PUNCT, [';'] = CC_PUNCT, [','] = CC_PUNCT, [':'] = CC_PUNCT, ['?'] = CC_PUNCT,
+	['"'] = CC_QUOTE, ['\''] = CC_QUOTE
+};
+// Per-byte flags replacing the locale-aware ctype calls
+enum {
+	CF_DIGIT = 1 << 0,
+	CF_HEX = 1 << 1,
+	CF_IDENT = 1 << 2
+};
+static const unsigned char charFlags[256] = {
+	['0' ... '9'] = CF_DIGIT | CF_HEX | CF_IDENT,
+	['a' ... 'f'] = CF_HEX | CF_IDENT, ['A' ... 'F'] = CF_HEX | CF_IDENT,
+	['g' ... 'z'] = CF_IDENT, ['G' ... 'Z'] = CF_IDENT, ['_'] = CF_IDENT
+};
+#define LexIsDigit(c) (charFlags[(unsigned char) (c)] & CF_DIGIT)
+#define LexIsHexDigit(c) (charFlags[(unsigned char) (c)] & CF_HEX)
+#define LexIsIdent(c) (charFlags[(unsigned char) (c)] & CF_IDENT)
+
+// Fixed-length token at the current position
+static inline Token LexFixed(char **input, int *column, int offset, int line, TokenType type, int length) {
+	Token token = { type, offset, length, line, *column, { 0 } };
+	*input += length;
+	*column += length;
+	return token;
+}
+// Operators, longest match first
+static Token LexOperator(char **input, int *line, int *column, int offset) {
+	const char *p = *input;
+	switch (p[0]) {
+		case '=':
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_EQUAL, 2);
+			if (p[1] == '>') return LexFixed(input, column, offset, *line, TOK_ANONOP, 2);
+			return LexFixed(input, column, offset, *line, TOK_ASSIGN, 1);
+		case '!':
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_NOTEQUAL, 2);
+			return LexFixed(input, column, offset, *line, TOK_NOT, 1);
+		case '<':
+			if (p[1] == '<') {
+				if (p[2] == '=') return LexFixed(input, column, offset, *line, TOK_LSHIFTASSIGN, 3);
+				return LexFixed(input, column, offset, *line, TOK_LSHIFT, 2);
+			}
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_LESSEROREQUAL, 2);
+			return LexFixed(input, column, offset, *line, TOK_LESSERTHAN, 1);
+		case '>':
+			if (p[1] == '>') {
+				if (p[2] == '=') return LexFixed(input, column, offset, *line, TOK_RSHIFTASSIGN, 3);
+				return LexFixed(input, column, offset, *line, TOK_RSHIFT, 2);
+			}
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_GREATEROREQUAL, 2);
+			return LexFixed(input, column, offset, *line, TOK_GREATERTHAN, 1);
+		case '+':
+			if (p[1] == '+') return LexFixed(input, column, offset, *line, TOK_PLUSPLUS, 2);
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_PLUSASSIGN, 2);
+			return LexFixed(input, column, offset, *line, TOK_PLUS, 1);
+		case '-':
+			if (p[1] == '-') return LexFixed(input, column, offset, *line, TOK_MINUSMINUS, 2);
+			if (p[1] == '>') return LexFixed(input, column, offset, *line, TOK_ARROW, 2);
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_MINUSASSIGN, 2);
+			return LexFixed(input, column, offset, *line, TOK_MINUS, 1);
+		case '*':
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_STARASSIGN, 2);
+			return LexFixed(input, column, offset, *line, TOK_STAR, 1);
+		case '/':
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_SLASHASSIGN, 2);
+			return LexFixed(input, column, offset, *line, TOK_SLASH, 1);
+		case '%':
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_PERCENTASSIGN, 2);
+			return LexFixed(input, column, offset, *line, TOK_PERCENT, 1);
+		case '&':
+			if (p[1] == '&') return LexFixed(input, column, offset, *line, TOK_AND, 2);
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_BITANDASSIGN, 2);
+			return LexFixed(input, column, offset, *line, TOK_BITAND, 1);
+		case '|':
+			if (p[1] == '|') return LexFixed(input, column, offset, *line, TOK_OR, 2);
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_BITORASSIGN, 2);
+			return LexFixed(input, column, offset, *line, TOK_BITOR, 1);
+		case '^':
+			if (p[1] == '=') return LexFixed(input, column, offset, *line, TOK_BITXORASSIGN, 2);
+			return LexFixed(input, column, offset, *line, TOK_BITXOR, 1);
+		default:
+			return LexFixed(input, column, offset, *line, TOK_BITNOT, 1);
 	}
-	if (**input == '|' && (*input)[1] == '|') {
-		(*input) += 2;
-		return (Token) { TOK_OR, "||", *line, *column - 1 };
+}
+static Token LexPunctuation(char **input, int *line, int *column, int offset) {
+	static const TokenType punctuation[256] = {
+		['('] = TOK_OPENPARENTHESIS,
+		[')'] = TOK_CLOSEPARENTHESIS,
+		['{'] = TOK_OPENCURLYBRACES,
+		['}'] = TOK_CLOSECURLYBRACES,
+		['['] = TOK_OPENBRACKET,
+		[']'] = TOK_CLOSEBRACKET,
+		[';'] = TOK_SEMICOLON,
+		[','] = TOK_COMMA,
+		[':'] = TOK_COLON,
+		['?'] = TOK_QUESTION
+	};
+	return LexFixed(input, column, offset, *line, punctuation[(unsigned char) **input], 1);
+}
+static Token LexIdentifier(char **input, int *line, int *column, int offset) {
+	char *start = *input;
+	int startColumn = *column;
+	while (LexIsIdent(**input)) (*input)++;
+	int length = (int) (*input - start);
+	*column += length;
+
+	return (Token) { TokenKeywordLookup(start, length), offset, length, *line, startColumn, { 0 } };
+}
+// String and character literals, the span keeps the quotes and escapes as written
+static Token LexQuoted(CompilerState *state, char **input, int *line, int *column, int offset) {
+	char quote = **input;
+	char *start = *input;
+	int startColumn = *column;
+	TokenType type = quote == '"' ? TOK_STRINGLIT : TOK_CHARLIT;
+
+	(*input)++;
+	while (**input != quote) {
+		if (**input == '\\' && (*input)[1] != '\0' && (*input)[1] != '\n') (*input)++;
+		else if (**input == '\n' || **input == '\0') {
+			*column += (int) (*input - start);
+			ERROR_AT(state, *line, *column, quote == '"' ? "Unterminated string literal" : "Unterminated character literal");
+			return (Token) { TOK_ERROR, offset, (int) (*input - start), *line, startColumn, { 0 } };
+		}
+		(*input)++;
 	}
-	if (**input == '+' && (*input)[1] == '+') {
-		(*input) += 2;
-		return (Token) { TOK_PLUSPLUS, "++", *line, *column - 1 };
+	(*input)++;
+	int length = (int) (*input - start);
+	*column += length;
+
+	if (type == TOK_CHARLIT && length == 2) {
+		ERROR_AT(state, *line, startColumn, "Empty character literal");
 	}
-	if (**input == '-' && (*input)[1] == '-') {
-		(*input) += 2;
-		return (Token) { TOK_MINUSMINUS, "--", *line, *column - 1 };
+	return (Token) { type, offset, length, *line, startColumn, { 0 } };
+}
+// Numeric literals are decoded here, once, so nothing downstream reparses
+// their text. Integers are exact; floats take the exact fast path when the
+// digits and the power fit the target's significand, and fall back to
+// strtod/strtof otherwise. The compiler never calls setlocale, so those use
+// the C locale and always read '.' as the decimal point.
+static const double lexPowersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const float lexFloatPowersOfTen[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+static inline int LexDigitValue(char c) {
+	return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+// Digits of an integer literal in base, false when they need more than 64 bits
+static bool LexDecodeInteger(const char *digits, const char *end, int base, unsigned long long *value) {
+	unsigned long long result = 0;
+	for (; digits < end; digits++) {
+		unsigned d = (unsigned) LexDigitValue(*digits);
+		if (result > (~0ULL - d) / (unsigned) base) return false;
+		result = result * (unsigned) base + d;
 	}
-	if (**input == '-' && (*input)[1] == '>') {
-		(*input) += 2;
-		return (Token) { TOK_ARROW, "->", *line, *column - 1 };
+	*value = result;
+	return true;
+}
+// Exponent digits after e or p, clamped well past any finite result
+static int LexDecodeExponent(const char *p) {
+	bool negative = *p == '-';
+	int exponent = 0;
+	if (*p == '+' || *p == '-') p++;
+	for (; LexIsDigit(*p); p++) {
+		if (exponent < 100000) exponent = exponent * 10 + (*p - '0');
 	}
-	if (**input == '<' && (*input)[1] == '<') {
-		(*input) += 2;
-		return (Token) { TOK_LSHIFT, "<<", *line, *column - 1 };
+	return negative ? -exponent : exponent;
+}
+// Significant digits of a decimal or hexadecimal float as an integer times
+// base to the power exponent; false when they don't fit in 64 bits
+static bool LexDecodeSignificand(const char **p, int base, unsigned long long *mantissa, int *exponent) {
+	unsigned long long result = 0;
+	int scale = 0;
+	int limit = base == 16 ? 15 : 19;
+	int digits = 0;
+	bool fraction = false;
+	for (; LexIsHexDigit(**p) || **p == '.'; (*p)++) {
+		if (**p == '.') {
+			fraction = true;
+			continue;
+		}
+		if (base == 10 && !LexIsDigit(**p)) break;
+		int d = LexDigitValue(**p);
+		if (result == 0 && d == 0) {
+			// Leading zeros are not significant
+			if (fraction) scale--;
+			continue;
+		}
+		if (++digits > limit) return false;
+		result = result * (unsigned) base + (unsigned) d;
+		if (fraction) scale--;
 	}
-	if (**input == '>' && (*input)[1] == '>') {
-		(*input) += 2;
-		return (Token) { TOK_RSHIFT, ">>", *line, *column - 1 };
+	*mantissa = result;
+	*exponent = scale;
+	return true;
+}
+static double LexDecodeFloat(const char *start, int base, bool single) {
+	const char *p = base == 16 ? start + 2 : start;
+	unsigned long long mantissa;
+	int exponent;
+	if (LexDecodeSignificand(&p, base, &mantissa, &exponent)) {
+		if (base == 16) {
+			// A significand that fits is scaled by a power of two, exactly
+			int binary = exponent * 4 + ((*p == 'p' || *p == 'P') ? LexDecodeExponent(p + 1) : 0);
+			if (mantissa == 0) return 0;
+			if (single && mantissa < (1ULL << 24)) return ldexpf((float) mantissa, binary);
+			if (!single && mantissa < (1ULL << 53)) return ldexp((double) mantissa, binary);
+		}
+		else {
+			if (*p == 'e' || *p == 'E') exponent += LexDecodeExponent(p + 1);
+			if (mantissa == 0) return 0;
+			// Clinger's fast path: both operands are exact, one rounding
+			if (single && mantissa < (1ULL << 24) && exponent >= -10 && exponent <= 10) {
+				return exponent < 0 ? (float) mantissa / lexFloatPowersOfTen[-exponent] : (float) mantissa * lexFloatPowersOfTen[exponent];
+			}
+			if (!single && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+				return exponent < 0 ? (double) mantissa / lexPowersOfTen[-exponent] : (double) mantissa * lexPowersOfTen[exponent];
+			}
+		}
 	}
+	// strtod stops at the suffix, the source always ends in a NUL
+	return single ? strtof(start, NULL) : strtod(start, NULL);
+}
 
+static Token LexNumber(CompilerState *state, char **input, int *line, int *column, int offset) {
+	char *start = *input;
+	int startColumn = *column;
 
-	// Handle numeric literals
-	if (isdigit(**input) || **input == '.') {
-		char *start = *input;
-		int startColumn = *column;
+	bool floatingPoint = false;
+	bool hasExponent = false;
+	int base = 10;
 
-		bool floatingPoint = false;
-		bool hasExponent = false;
-		int base = 10;
+	// Check for hexadecimal or binary prefix
+	if (**input == '0' && ((*input)[1] == 'x' || (*input)[1] == 'X' || (*input)[1] == 'b' || (*input)[1] == 'B')) {
+		if ((*input)[1] == 'x' || (*input)[1] == 'X') {
+			base = 16;
+			*input += 2;
+			*column += 2;
+		}
+		else {
+			base = 2;
+			*input += 2;
+			*column += 2;
+		}
+	}
 
-		// Check for hexadecimal or binary prefix
-		if (**input == '0' && ((*input)[1] == 'x' || (*input)[1] == 'X' || (*input)[1] == 'b' || (*input)[1] == 'B')) {
-			if ((*input)[1] == 'x' || (*input)[1] == 'X') {
-				base = 16;
-				*input += 2;
-				*column += 2;
-			}
-			else {
-				base = 2;
-				*input += 2;
-				*column += 2;
-			}
+	// Parse integer part (if any)
+	if (base == 2) {
+		while (**input == '0' || **input == '1') {
+			(*input)++;
+			(*column)++;
+		}
+	}
+	else if (base == 10) {
+		while (LexIsDigit(**input)) {
+			(*input)++;
+			(*column)++;
 		}
+	}
+	else if (base == 16) {
+		while (LexIsHexDigit(**input)) {
+			(*input)++;
+			(*column)++;
+		}
+	}
+
+	// Check for fractional part
+	if (**input == '.') {
+		floatingPoint = true;
+		(*input)++;
+		(*column)++;
 
-		// Parse integer part (if any)
+		// Parse fractional digits
 		if (base == 2) {
 			while (**input == '0' || **input == '1') {
 				(*input)++;
 				(*column)++;
 			}
-		}
-		else if (base == 10) {
-			while (isdigit(**input)) {
+		} else if (base == 10) {
+			while (LexIsDigit(**input)) {
 				(*input)++;
 				(*column)++;
 			}
-		}
-		else if (base == 16) {
-			while (isxdigit(**input)) {
+		} else if (base == 16) {
+			while (LexIsHexDigit(**input)) {
 				(*input)++;
 				(*column)++;
 			}
 		}
+	}
 
-		// Check for fractional part
-		if (**input == '.') {
-			floatingPoint = true;
+	// Check for exponent part
+	if (base == 10 && (**input == 'e' || **input == 'E')) {
+		floatingPoint = true;
+		hasExponent = true;
+		(*input)++;
+		(*column)++;
+
+		if (**input == '+' || **input == '-') {
 			(*input)++;
 			(*column)++;
+		}
 
-			// Parse fractional digits
-			if (base == 2) {
-				while (**input == '0' || **input == '1') {
-					(*input)++;
-					(*column)++;
-				}
-			} else if (base == 10) {
-				while (isdigit(**input)) {
-					(*input)++;
-					(*column)++;
-				}
-			} else if (base == 16) {
-				while (isxdigit(**input)) {
-					(*input)++;
-					(*column)++;
-				}
-			}
+		if (!LexIsDigit(**input)) {
+			ERROR_AT(state, *line, *column, "Invalid exponent in floating-point literal");
 		}
 
-		// Check for exponent part
-		if (base == 10 && (**input == 'e' || **input == 'E')) {
-			floatingPoint = true;
-			hasExponent = true;
+		while (LexIsDigit(**input)) {
 			(*input)++;
 			(*column)++;
-
-			if (**input == '+' || **input == '-') {
-				(*input)++;
-				(*column)++;
-			}
-
-			if (!isdigit(**input)) {
-				ERROR_AT(state, *line, *column, *input, "Invalid exponent in floating-point literal");
-			}
-
-			while (isdigit(**input)) {
-				(*input)++;
-				(*column)++;
-			}
 		}
-		else if (base == 16 && (**input == 'p' || **input == 'P')) {
-			floatingPoint = true;
-			hasExponent = true;
+	}
+	else if (base == 16 && (**input == 'p' || **input == 'P')) {
+		floatingPoint = true;
+		hasExponent = true;
+		(*input)++;
+		(*column)++;
+
+		if (**input == '+' || **input == '-') {
 			(*input)++;
 			(*column)++;
-
-			if (**input == '+' || **input == '-') {
-				(*input)++;
-				(*column)++;
-			}
-
-			if (!isdigit(**input)) {
-				ERROR_AT(state, *line, *column, *input, "Invalid exponent in hexadecimal floating-point literal");
-			}
-
-			while (isdigit(**input)) {
-				(*input)++;
-				(*column)++;
-			}
-		}
-
-		// Validate floating-point requirements
-		if (floatingPoint && base != 10 && base != 16) {
-			ERROR_AT(state, *line, *column, *input, "Invalid floating-point literal");
 		}
 
-		if (floatingPoint && base == 16 && !hasExponent) {
-			ERROR_AT(state, *line, *column, *input, "Hexadecimal floating-point literal requires exponent");
+		if (!LexIsDigit(**input)) {
+			ERROR_AT(state, *line, *column, "Invalid exponent in hexadecimal floating-point literal");
 		}
 
-		// Parse suffixes
-		bool unsignedSuffix = false;
-		bool longSuffix = false;
-		bool longLongSuffix = false;
-		bool floatSuffix = false;
-
-		while (**input == 'u' || **input == 'U' || **input == 'l' || **input == 'L' || **input == 'f' || **input == 'F') {
-			if (**input == 'u' || **input == 'U') {
-				if (floatingPoint) {
-					ERROR_AT(state, *line, *column, *input, "Invalid suffix 'u' for floating-point literal");
-				}
-				if (unsignedSuffix) {
-					ERROR_AT(state, *line, *column, *input, "Duplicate 'u' suffix");
-				}
-				unsignedSuffix = true;
-			}
-			else if (**input == 'l' || **input == 'L') {
-				if (floatingPoint) {
-					ERROR_AT(state, *line, *column, *input, "Invalid suffix 'l' for floating-point literal");
-				}
-				if (longLongSuffix) {
-					ERROR_AT(state, *line, *column, *input, "Too many 'l' suffixes");
-				}
-				if (longSuffix) {
-					longSuffix = false;
-					longLongSuffix = true;
-				}
-				else {
-					longSuffix = true;
-				}
-			}
-			else if (**input == 'f' || **input == 'F') {
-				if (!floatingPoint) {
-					ERROR_AT(state, *line, *column, *input, "Invalid suffix 'f' for integer literal");
-				}
-				if (floatSuffix) {
-					ERROR_AT(state, *line, *column, *input, "Duplicate 'f' suffix");
-				}
-				floatSuffix = true;
-			}
+		while (LexIsDigit(**input)) {
 			(*input)++;
 			(*column)++;
 		}
+	}
 
-		// Determine token type
-		size_t length = *input - start;
-		char *value = strndup(start, length);
-		TokenType type;
+	// Validate floating-point requirements
+	if (floatingPoint && base != 10 && base != 16) {
+		ERROR_AT(state, *line, *column, "Invalid floating-point literal");
+	}
 
-		if (floatingPoint) {
-			if (floatSuffix) {
-				type = TOK_FLOATLIT;
-			}
-			else if (longSuffix) {
-				type = TOK_LONGDOUBLELIT;
+	if (floatingPoint && base == 16 && !hasExponent) {
+		ERROR_AT(state, *line, *column, "Hexadecimal floating-point literal requires exponent");
+	}
+
+	// Parse suffixes
+	char *digitsEnd = *input;
+	bool unsignedSuffix = false;
+	bool longSuffix = false;
+	bool longLongSuffix = false;
+	bool floatSuffix = false;
+
+	while (**input == 'u' || **input == 'U' || **input == 'l' || **input == 'L' || **input == 'f' || **input == 'F') {
+		if (**input == 'u' || **input == 'U') {
+			if (floatingPoint) {
+				ERROR_AT(state, *line, *column, "Invalid suffix 'u' for floating-point literal");
 			}
-			else {
-				type = TOK_DOUBLELIT;
+			if (unsignedSuffix) {
+				ERROR_AT(state, *line, *column, "Duplicate 'u' suffix");
 			}
+			unsignedSuffix = true;
 		}
-		else {
-			if (longLongSuffix) {
-				type = unsignedSuffix ? TOK_UNSIGNEDLONGLONGLIT : TOK_LONGLONGLIT;
+		else if (**input == 'l' || **input == 'L') {
+			if (floatingPoint) {
+				ERROR_AT(state, *line, *column, "Invalid suffix 'l' for floating-point literal");
 			}
-			else if (longSuffix) {
-				type = unsignedSuffix ? TOK_UNSIGNEDLONGLIT : TOK_LONGLIT;
+			if (longLongSuffix) {
+				ERROR_AT(state, *line, *column, "Too many 'l' suffixes");
 			}
-			else if (unsignedSuffix) {
-				type = TOK_UNSIGNEDLIT;
+			if (longSuffix) {
+				longSuffix = false;
+				longLongSuffix = true;
 			}
 			else {
-				type = TOK_INTLIT;
+				longSuffix = true;
 			}
 		}
+		else if (**input == 'f' || **input == 'F') {
+			if (!floatingPoint) {
+				ERROR_AT(state, *line, *column, "Invalid suffix 'f' for integer literal");
+			}
+			if (floatSuffix) {
+				ERROR_AT(state, *line, *column, "Duplicate 'f' suffix");
+			}
+			floatSuffix = true;
+		}
+		(*input)++;
+		(*column)++;
+	}
 
-		return (Token) { type, value, *line, startColumn };
-	}
-
-	// Handle singlecharacter tokens
-	switch (**input) {
-		case '(': (*input)++; (*column)++; return (Token) { TOK_OPENPARENTHESIS,		"(", *line, *column - 1 };
-		case ')': (*input)++; (*column)++; return (Token) { TOK_CLOSEPARENTHESIS,		")", *line, *column - 1 };
-		case '{': (*input)++; (*column)++; return (Token) { TOK_OPENCURLYBRACES,		"{", *line, *column - 1 };
-		case '}': (*input)++; (*column)++; return (Token) { TOK_CLOSECURLYBRACES,		"}", *line, *column - 1 };
-		case '[': (*input)++; (*column)++; return (Token) { TOK_OPENBRACKET,		"[", *line, *column - 1 };
-		case ']': (*input)++; (*column)++; return (Token) { TOK_CLOSEBRACKET,		"]", *line, *column - 1 };
-		case ';': (*input)++; (*column)++; return (Token) { TOK_SEMICOLON,		";", *line, *column - 1 };
-		case ',': (*input)++; (*column)++; return (Token) { TOK_COMMA,			",", *line, *column - 1 };
-		case ':': (*input)++; (*column)++; return (Token) { TOK_COLON,			":", *line, *column - 1 };
-		case '?': (*input)++; (*column)++; return (Token) { TOK_QUESTION,			"?", *line, *column - 1 };
-		case '!': (*input)++; (*column)++; return (Token) { TOK_NOT,			"!", *line, *column - 1 };
-		case '&': (*input)++; (*column)++; return (Token) { TOK_BITAND,			"&", *line, *column - 1 };
-		case '|': (*input)++; (*column)++; return (Token) { TOK_BITOR,			"|", *line, *column - 1 };
-		case '^': (*input)++; (*column)++; return (Token) { TOK_BITXOR,			"^", *line, *column - 1 };
-		case '~': (*input)++; (*column)++; return (Token) { TOK_BITNOT,			"~", *line, *column - 1 };
-		case '=': (*input)++; (*column)++; return (Token) { TOK_ASSIGN,			"=", *line, *column - 1 };
-		case '+': (*input)++; (*column)++; return (Token) { TOK_PLUS,			"+", *line, *column - 1 };
-		case '-': (*input)++; (*column)++; return (Token) { TOK_MINUS,			"-", *line, *column - 1 };
-		case '*': (*input)++; (*column)++; return (Token) { TOK_STAR,			"*", *line, *column - 1 };
-		case '/': (*input)++; (*column)++; return (Token) { TOK_SLASH,			"/", *line, *column - 1 };
-		case '%': (*input)++; (*column)++; return (Token) { TOK_PERCENT,			"%", *line, *column - 1 };
-		case '<': (*input)++; (*column)++; return (Token) { TOK_LESSERTHAN,		"<", *line, *column - 1 };
-		case '>': (*input)++; (*column)++; return (Token) { TOK_GREATERTHAN,		">", *line, *column - 1 };
-		case '.': (*input)++; (*column)++; return (Token) { TOK_DOT,			".", *line, *column - 1 };
-	}
-
-	// Handle multicharacter tokens, identifiers and keywords,
-	if (isalpha(**input)) {
-		char *start = *input;
-		int startColumn = *column;
-		while (isalnum(**input) || **input == '_') {
-			(*input)++;
-			(*column)++;
+	// Determine token type
+	int length = (int) (*input - start);
+	TokenType type;
+
+	if (floatingPoint) {
+		if (floatSuffix) {
+			type = TOK_FLOATLIT;
+		}
+		else if (longSuffix) {
+			type = TOK_LONGDOUBLELIT;
+		}
+		else {
+			type = TOK_DOUBLELIT;
+		}
+	}
+	else {
+		if (longLongSuffix) {
+			type = unsignedSuffix ? TOK_UNSIGNEDLONGLONGLIT : TOK_LONGLONGLIT;
+		}
+		else if (longSuffix) {
+			type = unsignedSuffix ? TOK_UNSIGNEDLONGLIT : TOK_LONGLIT;
+		}
+		else if (unsignedSuffix) {
+			type = TOK_UNSIGNEDLIT;
+		}
+		else {
+			type = TOK_INTLIT;
 		}
-		size_t len = *input - start;
-		char *value = strndup(start, len);
+	}
 
-		if (TokenIsKeyword(value)) return (Token) { TokenTypeParseString(value), value, *line, startColumn };
+	Token token = { type, offset, length, *line, startColumn, { 0 } };
+	if (floatingPoint) {
+		if (base != 2) token.value.real = LexDecodeFloat(start, base, type == TOK_FLOATLIT);
+	}
+	else {
+		const char *digits = base == 10 ? start : start + 2;
+		// A leading 0 makes a decimal literal octal, as in C
+		if (base == 10 && start[0] == '0' && digitsEnd - start > 1) {
+			base = 8;
+			for (const char *p = digits; p < digitsEnd; p++) {
+				if (*p > '7') {
+					ERROR_AT(state, *line, startColumn + (int) (p - start), "Invalid digit in octal literal");
+					break;
+				}
+			}
+		}
+		if (digits == digitsEnd) {
+			ERROR_AT(state, *line, startColumn, "Missing digits after the base prefix");
+		}
+		else if (!LexDecodeInteger(digits, digitsEnd, base, &token.value.integer)) {
+			ERROR_AT(state, *line, startColumn, "Integer literal is too large for any integer type");
+		}
+	}
+	return token;
+}
+Token GetNextToken(CompilerState *state, char **input, int *line, int *column) {
+	// Skip whitespace and comments until a token starts; a loop rather than
+	// recursion, so runs of comments use constant stack
+	while (1) {
+		// Ignore whitespace and track line/column numbers
+		if (ScanIsSpace(**input)) *input = (char *) ScanWhitespace(*input, line, column);
+		if (**input != '/') break;
+		// Handle singleline comments
+		if ((*input)[1] == '/') {
+			*column += 2;
+			*input = (char *) ScanLineEnd(*input + 2, column);
+		}
+		// Handle multiline comments
+		else if ((*input)[1] == '*') {
+			*column += 2;
+			*input = (char *) ScanBlockCommentEnd(*input + 2, line, column);
+			if (**input == '\0') {
+				ERROR_AT(state, *line, *column, "Unclosed block comment");
+				return (Token) { .type = TOK_ERROR, .offset = (int) (*input - state->source), .length = 0, .line = *line, .column = *column };
+			}
+			(*input) += 2;
+			*column += 2;
+		}
+		else break;
+	}
+	// End of input
+	if (**input == '\0') return (Token) { TOK_EOF, (int) (*input - state->source), 0, *line, *column, { 0 } };
 
-		return (Token) { TOK_ID, value, *line, startColumn };
+	int offset = (int) (*input - state->source);
+	switch (charClass[(unsigned char) **input]) {
+		case CC_IDENT:
+			return LexIdentifier(input, line, column, offset);
+		case CC_DIGIT:
+			return LexNumber(state, input, line, column, offset);
+		case CC_DOT:
+			// A dot only starts a number when a digit follows, e.g. .5
+			if (LexIsDigit((*input)[1])) return LexNumber(state, input, line, column, offset);
+			return LexFixed(input, column, offset, *line, TOK_DOT, 1);
+		case CC_OPERATOR:
+			return LexOperator(input, line, column, offset);
+		case CC_PUNCT:
+			return LexPunctuation(input, line, column, offset);
+		case CC_QUOTE:
+			return LexQuoted(state, input, line, column, offset);
 	}
 
-	fprintf(stderr, "Unknown character: %c\n", **input);
-	exit(1);
+	ERROR_AT(state, *line, *column, "Unknown character");
+	return LexFixed(input, column, offset, *line, TOK_ERROR, 1);
 }
-bool TokenPrint(Token token) {
-	if (token.value == NULL) return false;
+bool TokenPrint(const char *source, Token token) {
+	if (source == NULL) return false;
 	static const char *type[] = {
 					// Data types
 					"TOK_INT",
@@ -500,6 +801,17 @@ bool TokenPrint(Token token) {
 					"TOK_ARROW",
 					"TOK_DOT",
 					"TOK_ANONOP",
+					// Compound assignment operators
+					"TOK_PLUSASSIGN",
+					"TOK_MINUSASSIGN",
+					"TOK_STARASSIGN",
+					"TOK_SLASHASSIGN",
+					"TOK_PERCENTASSIGN",
+					"TOK_BITANDASSIGN",
+					"TOK_BITORASSIGN",
+					"TOK_BITXORASSIGN",
+					"TOK_LSHIFTASSIGN",
+					"TOK_RSHIFTASSIGN",
 					// Comparison operators
 					"TOK_EQUAL",
 					"TOK_NOTEQUAL",
@@ -532,25 +844,17 @@ bool TokenPrint(Token token) {
 					// Special
 					"TOK_EOF",
 					"TOK_ERROR" };
-	printf("[%s, \"%s\"] ", type[(int) token.type] ,token.value);
+	printf("[%s, \"%.*s\"] ", type[(int) token.type], token.length, source + token.offset);
 	return true;
 }
-bool TokenFree(Token *token) {
-	switch (token->type) {
-		case TOK_INT:
-		case TOK_RETURN:
-		case TOK_ID:
-		case TOK_INTLIT:
-			free(token->value);
-			return true;
-		default: return false;
-	}
-}
 bool TokenExpect(TokenQueue *q, TokenType type) {
 	return TokenQueuePeek(q).type == type;
 }
 bool TokenIsDataType(TokenQueue *q) {
-	switch (q->first->token.type) {
+	return TokenTypeIsDataType(TokenQueuePeek(q).type);
+}
+bool TokenTypeIsDataType(TokenType type) {
+	switch (type) {
 		case TOK_INT:
 		case TOK_CHAR:
 		case TOK_FLOAT:
@@ -632,75 +936,409 @@ bool TokenIsKeyword(const char *str) {
 	return false;
 }
 
-bool TokenQueuePush(TokenQueue *q, Token token) {
-	TokenNode *node = (TokenNode *) malloc(sizeof(TokenNode));
-	if (node == NULL) return false;
+bool TokenBufferInit(TokenBuffer *b, const char *source, int capacity) {
+	if (capacity < 16) capacity = 16;
+	b->source = source;
+	b->type = (unsigned char *) malloc(capacity * sizeof(unsigned char));
+	b->offset = (int *) malloc(capacity * sizeof(int));
+	b->length = (int *) malloc(capacity * sizeof(int));
+	b->line = (int *) malloc(capacity * sizeof(int));
+	b->column = (int *) malloc(capacity * sizeof(int));
+	b->value = (TokenValue *) malloc(capacity * sizeof(TokenValue));
+	b->count = 0;
+	b->capacity = capacity;
+	b->errors = NULL;
+	b->errorCount = 0;
+	b->errorCapacity = 0;
+	if (b->type == NULL || b->offset == NULL || b->length == NULL || b->line == NULL || b->column == NULL || b->value == NULL) {
+		TokenBufferFree(b);
+		return false;
+	}
+	return true;
+}
+static bool TokenBufferGrow(TokenBuffer *b) {
+	int capacity = b->capacity ? b->capacity * 2 : 16;
+	unsigned char *type = (unsigned char *) realloc(b->type, capacity * sizeof(unsigned char));
+	if (type == NULL) return false;
+	b->type = type;
+	int *offset = (int *) realloc(b->offset, capacity * sizeof(int));
+	if (offset == NULL) return false;
+	b->offset = offset;
+	int *length = (int *) realloc(b->length, capacity * sizeof(int));
+	if (length == NULL) return false;
+	b->length = length;
+	int *line = (int *) realloc(b->line, capacity * sizeof(int));
+	if (line == NULL) return false;
+	b->line = line;
+	int *column = (int *) realloc(b->column, capacity * sizeof(int));
+	if (column == NULL) return false;
+	b->column = column;
+	TokenValue *value = (TokenValue *) realloc(b->value, capacity * sizeof(TokenValue));
+	if (value == NULL) return false;
+	b->value = value;
+	b->capacity = capacity;
+	return true;
+}
+bool TokenBufferPush(TokenBuffer *b, Token token) {
+	if (b->count == b->capacity && !TokenBufferGrow(b)) return false;
+
+	b->type[b->count] = (unsigned char) token.type;
+	b->offset[b->count] = token.offset;
+	b->length[b->count] = token.length;
+	b->line[b->count] = token.line;
+	b->column[b->count] = token.column;
+	b->value[b->count] = token.value;
+	b->count++;
+	return true;
+}
+Token TokenBufferGet(TokenBuffer *b, int index) {
+	if (index < 0 || index >= b->count) return (Token) { TOK_EOF, 0, 0, 0, 0, { 0 } };
 
-	node->token = token;
-	node->prev = NULL;
+	return (Token) { (TokenType) b->type[index], b->offset[index], b->length[index], b->line[index], b->column[index], b->value[index] };
+}
+bool TokenBufferPrint(TokenBuffer *b) {
+	int i;
+	if (b->count == 0) return false;
 
-	if (q->length) {
-		q->last->prev = node;
-		q->last = q->last->prev;
-		node = NULL;
+	for (i = 0; i < b->count; i++) {
+		TokenPrint(b->source, TokenBufferGet(b, i));
 	}
-	else {
-		q->first = node;
-		q->last = node;
+	return true;
+}
+bool TokenBufferFree(TokenBuffer *b) {
+	free(b->type);
+	free(b->offset);
+	free(b->length);
+	free(b->line);
+	free(b->column);
+	free(b->value);
+	free(b->errors);
+	*b = (TokenBuffer) { b->source, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, NULL, 0, 0 };
+	return true;
+}
+
+// Lexes the next token into *token. Each token is lexed out of panic mode,
+// so every lexical error is reported and noted for LexerFill to replay.
+static bool TokenBufferLexNext(CompilerState *state, TokenBuffer *b, char **input, int *line, int *column, Token *token) {
+	struct TokenError error = { b->count, (int) (*input - state->source), *line, *column };
+	*token = GetNextToken(state, input, line, column);
+	if (!state->panicMode) return true;
+	ExitPanicMode(state);
+	if (b->errorCount == b->errorCapacity) {
+		int capacity = b->errorCapacity ? b->errorCapacity * 2 : 16;
+		struct TokenError *errors = (struct TokenError *) realloc(b->errors, capacity * sizeof(struct TokenError));
+		if (errors == NULL) return false;
+		b->errors = errors;
+		b->errorCapacity = capacity;
 	}
-	q->length++;
+	b->errors[b->errorCount++] = error;
+	return true;
+}
+// Lexes the whole source registered on state, EOF excluded
+bool TokenBufferLex(CompilerState *state, TokenBuffer *b) {
+	char *input = (char *) state->source;
+	int line = 1;
+	int column = 1;
+	while (1) {
+		Token token;
+		if (!TokenBufferLexNext(state, b, &input, &line, &column, &token)) return false;
+		if (token.type == TOK_EOF) break;
+		if (!TokenBufferPush(b, token)) return false;
+	}
+	return !state->hadError;
+}
+
+// Parallel lexing: the source is cut into chunks at line starts, each chunk
+// is lexed on the pool as if nothing came before it, and the chunks are then
+// stitched in order. A chunk's guess is only kept if its tokens line up with
+// where the previous chunk really stopped; otherwise (the cut fell inside a
+// block comment, or the chunk hit an error) that chunk is lexed again
+// sequentially, so the result is always identical to TokenBufferLex.
+#define LEX_PARALLEL_MIN_CHUNK (64 * 1024)
+
+typedef struct LexChunk {
+	CompilerState state;	// Silenced copy, speculative errors are never reported
+	int start;
+	int end;
+	TokenBuffer tokens;
+	int stop;		// Offset of the first token at or past end
+	int stopLine;
+	int stopColumn;
+	bool failed;
+} LexChunk;
+
+// Start of the line after target, skipping lines that look like the inside
+// of a doc comment (" * ...") since cutting there guesses wrong
+static int LexSplitPoint(const char *source, int length, int target) {
+	const char *p = source + target;
+	const char *end = source + length;
+	while (p < end) {
+		const char *newline = memchr(p, '\n', end - p);
+		if (newline == NULL) return length;
+		p = newline + 1;
+		const char *q = p;
+		while (q < end && (*q == ' ' || *q == '\t')) q++;
+		if (q < end && *q != '*') return (int) (p - source);
+	}
+	return length;
+}
+static void LexChunkRun(void *argument) {
+	LexChunk *chunk = (LexChunk *) argument;
+	char *input = (char *) chunk->state.source + chunk->start;
+	int line = 1;
+	int column = 1;
+	chunk->failed = !TokenBufferInit(&chunk->tokens, chunk->state.source, (chunk->end - chunk->start) / 4);
+	while (!chunk->failed) {
+		Token token = GetNextToken(&chunk->state, &input, &line, &column);
+		if (token.type == TOK_EOF || token.offset >= chunk->end) {
+			chunk->stop = token.type == TOK_EOF ? (int) chunk->state.sourceLength : token.offset;
+			chunk->stopLine = token.line;
+			chunk->stopColumn = token.column;
+			break;
+		}
+		if (token.type == TOK_ERROR || !TokenBufferPush(&chunk->tokens, token)) chunk->failed = true;
+	}
+	if (chunk->state.hadError) chunk->failed = true;
+}
+// Index of the chunk token starting at offset, or -1
+static int LexChunkFind(LexChunk *chunk, int offset) {
+	int low = 0;
+	int high = chunk->tokens.count - 1;
+	while (low <= high) {
+		int middle = (low + high) / 2;
+		if (chunk->tokens.offset[middle] == offset) return middle;
+		if (chunk->tokens.offset[middle] < offset) low = middle + 1;
+		else high = middle - 1;
+	}
+	return -1;
+}
+bool TokenBufferLexParallel(CompilerState *state, TokenBuffer *b, ThreadPool *pool, int chunks) {
+	int length = (int) state->sourceLength;
+	if (chunks > length / LEX_PARALLEL_MIN_CHUNK) chunks = length / LEX_PARALLEL_MIN_CHUNK;
+	// Chunks only pay off when they really run side by side
+	if (pool == NULL || pool->threadCount < 2 || PoolDefaultThreads() < 2 || chunks < 2) return TokenBufferLex(state, b);
 
+	LexChunk *chunk = (LexChunk *) calloc(chunks, sizeof(LexChunk));
+	if (chunk == NULL) return TokenBufferLex(state, b);
+
+	int i, j;
+	int start = 0;
+	for (i = 0; i < chunks; i++) {
+		int end = i == chunks - 1 ? length : LexSplitPoint(state->source, length, (int) ((long) length * (i + 1) / chunks));
+		if (end < start) end = start;
+		chunk[i].state = *state;
+		chunk[i].state.hadError = false;
+		chunk[i].state.panicMode = true;
+		DiagnosticInit(&chunk[i].state.diagnostics, NULL);
+		chunk[i].start = start;
+		chunk[i].end = end;
+		start = end;
+		PoolSubmit(pool, LexChunkRun, &chunk[i]);
+	}
+	PoolWait(pool);
+
+	// Where the tokens stitched so far end, and the true position there
+	int resume = 0;
+	int resumeLine = 1;
+	int resumeColumn = 1;
+	bool ok = true;
+	for (i = 0; i < chunks && ok; i++) {
+		if (resume >= chunk[i].end && i != chunks - 1) continue;
+
+		int first = chunk[i].failed ? -1 : LexChunkFind(&chunk[i], resume);
+		bool synced = first >= 0 || (!chunk[i].failed && chunk[i].tokens.count == 0 && chunk[i].stop == resume);
+		if (synced && first >= 0) {
+			int lineDelta = resumeLine - chunk[i].tokens.line[first];
+			int columnLine = chunk[i].tokens.line[first];
+			int columnDelta = resumeColumn - chunk[i].tokens.column[first];
+			for (j = first; j < chunk[i].tokens.count && ok; j++) {
+				Token token = TokenBufferGet(&chunk[i].tokens, j);
+				if (token.line == columnLine) token.column += columnDelta;
+				token.line += lineDelta;
+				ok = TokenBufferPush(b, token);
+			}
+			resumeColumn = chunk[i].stopColumn + (chunk[i].stopLine == columnLine ? columnDelta : 0);
+			resumeLine = chunk[i].stopLine + lineDelta;
+			resume = chunk[i].stop;
+		}
+		else if (!synced) {
+			// Wrong guess or an error: lex this chunk for real, reporting as usual
+			char *input = (char *) state->source + resume;
+			int line = resumeLine;
+			int column = resumeColumn;
+			while (1) {
+				Token token;
+				if (!TokenBufferLexNext(state, b, &input, &line, &column, &token)) {
+					ok = false;
+					break;
+				}
+				if (token.type == TOK_EOF || token.offset >= chunk[i].end) {
+					resume = token.type == TOK_EOF ? length : token.offset;
+					resumeLine = token.line;
+					resumeColumn = token.column;
+					break;
+				}
+				if (!TokenBufferPush(b, token)) {
+					ok = false;
+					break;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < chunks; i++) TokenBufferFree(&chunk[i].tokens);
+	free(chunk);
+	return ok && !state->hadError;
+}
+
+TokenCursor TokenCursorCreate(TokenBuffer *b) {
+	return (TokenCursor) { b, 0 };
+}
+TokenType TokenCursorPeekType(TokenCursor *c, int k) {
+	int index = c->position + k;
+	if (index >= c->buffer->count) return TOK_EOF;
+
+	return (TokenType) c->buffer->type[index];
+}
+Token TokenCursorPeek(TokenCursor *c, int k) {
+	return TokenBufferGet(c->buffer, c->position + k);
+}
+Token TokenCursorNext(TokenCursor *c) {
+	Token token = TokenBufferGet(c->buffer, c->position);
+	if (c->position < c->buffer->count) c->position++;
+	return token;
+}
+const char *TokenCursorText(TokenCursor *c, Token token) {
+	return c->buffer->source + token.offset;
+}
+bool TokenCursorExpect(TokenCursor *c, TokenType type) {
+	return TokenCursorPeekType(c, 0) == type;
+}
+int TokenCursorRemaining(TokenCursor *c) {
+	return c->buffer->count - c->position;
+}
+
+void LexerInit(Lexer *lex, CompilerState *state) {
+	lex->state = state;
+	lex->input = (char *) state->source;
+	lex->line = 1;
+	lex->column = 1;
+	lex->head = 0;
+	lex->count = 0;
+	lex->tokens = NULL;
+	lex->position = 0;
+	lex->error = 0;
+}
+// Serves the tokens of a buffer lexed beforehand, such as by
+// TokenBufferLexParallel, then lexes on from the last one to find the end.
+// A token that reported an error is lexed again when it is reached, so its
+// error is reported, or not, as if it had been lexed only then.
+void LexerInitTokens(Lexer *lex, CompilerState *state, TokenBuffer *tokens) {
+	LexerInit(lex, state);
+	lex->tokens = tokens;
+}
+// Lex until the window holds k + 1 tokens; once the input is exhausted the
+// EOF token is repeated
+static void LexerFill(Lexer *lex, int k) {
+	while (lex->count <= k) {
+		int slot = (lex->head + lex->count) & (LEXER_LOOKAHEAD - 1);
+		if (lex->count && lex->ring[(slot - 1) & (LEXER_LOOKAHEAD - 1)].type == TOK_EOF) {
+			lex->ring[slot] = lex->ring[(slot - 1) & (LEXER_LOOKAHEAD - 1)];
+		}
+		else if (lex->tokens && lex->position < lex->tokens->count) {
+			Token token = TokenBufferGet(lex->tokens, lex->position);
+			if (lex->error < lex->tokens->errorCount && lex->tokens->errors[lex->error].token == lex->position) {
+				struct TokenError *error = &lex->tokens->errors[lex->error++];
+				char *input = (char *) lex->state->source + error->offset;
+				int line = error->line;
+				int column = error->column;
+				GetNextToken(lex->state, &input, &line, &column);
+			}
+			lex->position++;
+			lex->ring[slot] = token;
+			if (lex->position == lex->tokens->count) {
+				lex->input = (char *) lex->state->source + token.offset + token.length;
+				lex->line = token.line;
+				lex->column = token.column + token.length;
+			}
+		}
+		else {
+			lex->ring[slot] = GetNextToken(lex->state, &lex->input, &lex->line, &lex->column);
+		}
+		lex->count++;
+	}
+}
+Token LexerPeek(Lexer *lex, int k) {
+	if (k >= LEXER_LOOKAHEAD) {
+		fprintf(stderr, "Lookahead of %d tokens exceeds the lexer window.\n", k);
+		exit(1);
+	}
+	if (lex->count <= k) LexerFill(lex, k);
+
+	return lex->ring[(lex->head + k) & (LEXER_LOOKAHEAD - 1)];
+}
+TokenType LexerPeekType(Lexer *lex, int k) {
+	return LexerPeek(lex, k).type;
+}
+Token LexerNext(Lexer *lex) {
+	Token token = LexerPeek(lex, 0);
+	if (token.type == TOK_EOF) return token;
+
+	lex->head = (lex->head + 1) & (LEXER_LOOKAHEAD - 1);
+	lex->count--;
+	return token;
+}
+bool LexerExpect(Lexer *lex, TokenType type) {
+	return LexerPeekType(lex, 0) == type;
+}
+// Whether n more tokens follow before the end of input
+bool LexerAvailable(Lexer *lex, int n) {
+	return n <= 0 || LexerPeekType(lex, n - 1) != TOK_EOF;
+}
+const char *LexerText(Lexer *lex, Token token) {
+	return lex->state->source + token.offset;
+}
+
+bool TokenQueueInit(TokenQueue *q, const char *source) {
+	q->head = 0;
+	q->length = 0;
+	return TokenBufferInit(&q->buffer, source, 16);
+}
+bool TokenQueuePush(TokenQueue *q, Token token) {
+	if (!TokenBufferPush(&q->buffer, token)) return false;
+
+	q->length++;
 	return true;
 }
 Token TokenQueuePop(TokenQueue *q) {
-	TokenNode *node;
 	Token token;
-	if (q->length == 0) return (Token) { TOK_EOF, NULL, 0, 0 };
+	if (q->length == 0) return (Token) { TOK_EOF, 0, 0, 0, 0, { 0 } };
 
-	node = q->first;
-	q->first = q->first->prev;
-	node->prev = NULL;
+	token = TokenBufferGet(&q->buffer, q->head);
+	q->head++;
 	q->length--;
 
-	token = node->token;
-	free(node);
-	printf("TokenQueue's current size %d.\n", q->length);
-
 	return token;
 }
 Token TokenQueuePeek(TokenQueue *q) {
-	if (q->length == 0) return (Token) { TOK_EOF, NULL, 0, 0 };
+	if (q->length == 0) return (Token) { TOK_EOF, 0, 0, 0, 0, { 0 } };
 
-	return q->first->token;
+	return TokenBufferGet(&q->buffer, q->head);
 }
 bool TokenQueuePrint(TokenQueue q) {
 	int i;
-	TokenNode *node;
 	if (q.length == 0) return false;
 
-	for (i = 0, node = q.first; i < q.length; i++, node = node->prev) {
-		TokenPrint(node->token);
+	for (i = q.head; i < q.buffer.count; i++) {
+		TokenPrint(q.buffer.source, TokenBufferGet(&q.buffer, i));
 	}
-	node = NULL;
 	return true;
 }
 bool TokenQueueFree(TokenQueue *q) {
-	TokenNode *node;
-	Token token;
-	if (q->length == 0) return false;
-
-	int i;
-	int goal = q->length;
-	q->last = NULL;
-	for (i = 0; i < goal; i++) {
-		node = q->first;
-		q->first = node->prev;
-		token = node->token;
-		node->prev = NULL;
-		TokenFree(&token);
-		free(node);
-	}
+	if (q->buffer.capacity == 0) return false;
 
+	TokenBufferFree(&q->buffer);
+	q->head = 0;
 	q->length = 0;
-	return false;
+	return true;
 }
@@ -4,8 +4,11 @@
 #include "czy.h"
 
 typedef struct Token Token;
-typedef struct TokenNode TokenNode;
+typedef struct TokenBuffer TokenBuffer;
+typedef struct TokenCursor TokenCursor;
 typedef struct TokenQueue TokenQueue;
+typedef struct Lexer Lexer;
+typedef struct ThreadPool ThreadPool;
 
 typedef enum TokenType {
 	// Data types
@@ -128,6 +131,18 @@ typedef enum TokenType {
 	TOK_DOT,
 	TOK_ANONOP,			// Anonymous operator for lambdas, e.g. (x, y) => x + y
 
+	// Compound assignment operators
+	TOK_PLUSASSIGN,
+	TOK_MINUSASSIGN,
+	TOK_STARASSIGN,
+	TOK_SLASHASSIGN,
+	TOK_PERCENTASSIGN,
+	TOK_BITANDASSIGN,
+	TOK_BITORASSIGN,
+	TOK_BITXORASSIGN,
+	TOK_LSHIFTASSIGN,
+	TOK_RSHIFTASSIGN,
+
 	// Comparison operators
 	TOK_EQUAL,
 	TOK_NOTEQUAL,
@@ -166,32 +181,106 @@ typedef enum TokenType {
 	TOK_ERROR
 } TokenType;
 
+// Value of a numeric literal, decoded by the lexer; its type is the token's
+typedef union {
+	unsigned long long integer;	// Integer literals, as the bits of the value
+	double real;			// Floating literals, rounded to float for TOK_FLOATLIT
+} TokenValue;
+
+// Tokens don't own their text, they point into the source buffer
 struct Token {
 	TokenType type;
-	char *value;
+	int offset;   // Start of the lexeme in the source
+	int length;   // Length of the lexeme
 	int line;     // For error reporting
 	int column;   // For error reporting
+	TokenValue value;	// Numeric literals only, zero for anything else
+};
+
+// Growable token array, one column per field so scans over types stay dense
+struct TokenBuffer {
+	const char *source;
+	unsigned char *type;
+	int *offset;
+	int *length;
+	int *line;
+	int *column;
+	TokenValue *value;
+	int count;
+	int capacity;
+	struct TokenError {
+		int token;	// Index of the token whose lexing reported it
+		int offset;	// Where lexing that token started
+		int line;
+		int column;
+	} *errors;		// Lexical errors, in token order
+	int errorCount;
+	int errorCapacity;
 };
 
-struct TokenNode {
-	Token token;
-	TokenNode *prev;
+// Read position over a TokenBuffer; the parser consumes tokens through it
+struct TokenCursor {
+	TokenBuffer *buffer;
+	int position;
 };
 
+// FIFO view over a TokenBuffer, kept for callers of the old linked queue
 struct TokenQueue {
-	TokenNode *first;
-	TokenNode *last;
+	TokenBuffer buffer;
+	int head;
 	int length;
 };
 
+// Tokens the parser can look ahead, must be a power of two
+#define LEXER_LOOKAHEAD 8
+
+// Pull-based lexer: tokens are produced when the parser asks for them and
+// only the lookahead window is kept, so memory doesn't grow with the file
+struct Lexer {
+	CompilerState *state;
+	char *input;
+	int line;
+	int column;
+	Token ring[LEXER_LOOKAHEAD];
+	int head;	// Ring index of the next token
+	int count;	// Tokens lexed but not consumed yet
+	TokenBuffer *tokens;	// Lexed beforehand, read before lexing on; NULL for none
+	int position;		// Next token of tokens
+	int error;		// Next entry of tokens->errors
+};
+
 // Function prototypes
 TokenType TokenTypeParseString(const char *str);
+TokenType TokenKeywordLookup(const char *start, size_t len);
 Token GetNextToken(CompilerState *state, char **input, int *line, int *column);
-bool TokenPrint(Token token);
-bool TokenFree(Token *token);
+bool TokenPrint(const char *source, Token token);
 bool TokenExpect(TokenQueue *q, TokenType type);
 bool TokenIsDataType(TokenQueue *q);
+bool TokenTypeIsDataType(TokenType type);
 bool TokenIsKeyword(const char *str);
+bool TokenBufferInit(TokenBuffer *b, const char *source, int capacity);
+bool TokenBufferPush(TokenBuffer *b, Token token);
+Token TokenBufferGet(TokenBuffer *b, int index);
+bool TokenBufferPrint(TokenBuffer *b);
+bool TokenBufferFree(TokenBuffer *b);
+bool TokenBufferLex(CompilerState *state, TokenBuffer *b);
+bool TokenBufferLexParallel(CompilerState *state, TokenBuffer *b, ThreadPool *pool, int chunks);
+TokenCursor TokenCursorCreate(TokenBuffer *b);
+TokenType TokenCursorPeekType(TokenCursor *c, int k);
+Token TokenCursorPeek(TokenCursor *c, int k);
+Token TokenCursorNext(TokenCursor *c);
+const char *TokenCursorText(TokenCursor *c, Token token);
+bool TokenCursorExpect(TokenCursor *c, TokenType type);
+int TokenCursorRemaining(TokenCursor *c);
+void LexerInit(Lexer *lex, CompilerState *state);
+void LexerInitTokens(Lexer *lex, CompilerState *state, TokenBuffer *tokens);
+TokenType LexerPeekType(Lexer *lex, int k);
+Token LexerPeek(Lexer *lex, int k);
+Token LexerNext(Lexer *lex);
+bool LexerExpect(Lexer *lex, TokenType type);
+bool LexerAvailable(Lexer *lex, int n);
+const char *LexerText(Lexer *lex, Token token);
+bool TokenQueueInit(TokenQueue *q, const char *source);
 bool TokenQueuePush(TokenQueue *q, Token token);
 Token TokenQueuePop(TokenQueue *q);
 Token TokenQueuePeek(TokenQueue *q);
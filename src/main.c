@@ -1,20 +1,361 @@
+#include <errno.h>
+#include <sys/stat.h>
 #include "parser.h"
+#include "codegen.h"
+#include "fold.h"
+#include "source.h"
+#include "pool.h"
+#include "module.h"
+#include "build.h"
+
+typedef struct {
+	bool stats;
+	bool ast;		// Parse and print the tree instead of the tokens
+	bool emit;		// Parse and translate to C
+	bool fold;		// Fold constants before translating
+	const char *output;	// Where the C goes, standard output when NULL
+	int maxErrors;
+	long evalSteps;		// Budget of each compile-time evaluation
+	bool jsonDiagnostics;
+	int lexThreads;		// 0 lexes on demand, otherwise chunks lexed in parallel
+	ThreadPool *pool;
+	ModuleCache *modules;	// Interfaces of imported modules, shared by every file
+	int jobs;		// Files translated at once, 0 for one per processor
+	const char *outDir;	// Where x.czy goes as x.c, standard output when NULL
+	BuildCache *build;	// C of files that did not change, NULL to translate every file
+} Options;
+
+// One input of a parallel run. Its diagnostics and C are held until every
+// file is done, then written in the order the files were given.
+typedef struct {
+	const char *path;
+	Options *options;
+	char *errors;		// Everything the file reported
+	size_t errorsLength;
+	Buffer out;		// Its C, when that goes to standard output
+	bool ok;
+} CompileJob;
+
+static void Usage(const char *program) {
+	fprintf(stderr, "Usage: %s [options] <file.czy | ->...\n", program);
+	fprintf(stderr, "  --stats            Print interner and arena statistics per file\n");
+	fprintf(stderr, "  --ast              Parse and print the syntax tree\n");
+	fprintf(stderr, "  --emit-c           Translate to C on standard output\n");
+	fprintf(stderr, "  -o <file>          Write the C to a file, implies --emit-c\n");
+	fprintf(stderr, "  --no-fold          Emit expressions as written, without constant folding\n");
+	fprintf(stderr, "  --max-errors <n>   Errors reported per file, 0 for no limit (default %d)\n", CZY_DEFAULT_MAX_ERRORS);
+	fprintf(stderr, "  --eval-steps <n>   Steps each compile-time evaluation may take, 0 for no limit (default %d)\n", CZY_DEFAULT_EVAL_STEPS);
+	fprintf(stderr, "  --diagnostics-json Report errors as JSON, one object per line\n");
+	fprintf(stderr, "  --lex-threads <n>  Lex each file in parallel chunks on n threads\n");
+	fprintf(stderr, "  --module-cache <d> Keep the interfaces of imported modules and the C of each file in d (default %s)\n", MODULE_DEFAULT_CACHE);
+	fprintf(stderr, "  --no-module-cache  Parse every imported module, keeping no interfaces or C\n");
+	fprintf(stderr, "  --no-build-cache   Translate every file, even when it and its imports did not change\n");
+	fprintf(stderr, "  --out-dir <d>      Write the C for each x.czy to d/x.c, implies --emit-c\n");
+	fprintf(stderr, "  -j <n>, --jobs <n> Translate n files at once, 1 for one after another (default one per processor)\n");
+	fprintf(stderr, "  -                  Read the source from standard input\n");
+}
+
+// Where the C for path goes: -o, a file in --out-dir, or NULL for standard output
+static const char *OutputPath(const char *path, Options *options, char *buffer, size_t size) {
+	if (options->outDir == NULL) return options->output;
+	const char *slash = strrchr(path, '/');
+	const char *name = slash ? slash + 1 : path;
+	size_t length = strlen(name);
+	if (length > 4 && strcmp(name + length - 4, ".czy") == 0) length -= 4;
+	int written = snprintf(buffer, size, "%s/%.*s.c", options->outDir, (int) length, name);
+	return written > 0 && (size_t) written < size ? buffer : NULL;
+}
+
+// Write the C for path in one go, to a file or standard output. With
+// pending the C meant for standard output is moved there instead.
+static bool WriteOutput(Buffer *out, const char *path, Options *options, FILE *errors, Buffer *pending) {
+	char outputPath[MODULE_MAX_PATH];
+	const char *output = OutputPath(path, options, outputPath, sizeof(outputPath));
+	bool ok;
+	if (options->outDir && output == NULL) {
+		fprintf(errors, "The output path for %s is too long\n", path);
+		BufferFree(out);
+		return false;
+	}
+	if (output == NULL && pending) {
+		*pending = *out;
+		return true;
+	}
+	FILE *stream = output ? fopen(output, "wb") : stdout;
+	if (stream == NULL) {
+		fprintf(errors, "Could not open %s for writing\n", output);
+		ok = false;
+	}
+	else {
+		ok = BufferWrite(out, stream);
+		if (output) ok = fclose(stream) == 0 && ok;
+	}
+	BufferFree(out);
+	return ok;
+}
+
+// Translate a parsed file and keep its C for the next run under key
+static bool EmitFile(CompilerState *state, ASTNode *root, Options *options, const char *path, uint64_t key, Buffer *pending) {
+	Buffer out;
+	if (options->fold) {
+		Folder folder;
+		FoldTree(&folder, state, root);
+		if (options->stats) {
+			fprintf(state->outputStream, "%ld constants folded, %ld simplifications\n", folder.folded, folder.simplified);
+			ASTFlatPrintStats(&folder.ast, state->outputStream);
+		}
+		FoldFree(&folder);
+	}
+	BufferInit(&out, state->sourceLength * 2);
+	if (!CodegenEmit(state, root, &out)) {
+		BufferFree(&out);
+		return false;
+	}
+	if (options->build) BuildCacheStore(options->build, key, state, &out);
+	return WriteOutput(&out, path, options, state->outputStream, pending);
+}
+
+// Lex one source file and print its tokens, or parse it and print the tree or
+// C. Diagnostics go to errors; pending is passed on to EmitFile.
+static bool CompileFile(const char *path, Options *options, FILE *errors, Buffer *pending) {
+	SourceFile file;
+	if (!SourceOpen(&file, path)) return false;
+
+	// Nothing to parse when neither the file nor what it imports changed
+	uint64_t key = options->emit && options->build ? BuildCacheKey(options->build, path, file.data, file.length, options->fold, options->evalSteps) : 0;
+	if (key) {
+		Buffer out;
+		BufferInit(&out, file.length * 2);
+		if (BuildCacheLookup(options->build, key, &out)) {
+			if (options->stats) fprintf(errors, "%s: C reused from the build cache\n", path);
+			SourceClose(&file);
+			return WriteOutput(&out, path, options, errors, pending);
+		}
+		BufferFree(&out);
+	}
 
-int main() {
 	CompilerState state;
-	InitCompiler(&state, stderr);
-	TokenQueue q1 = { NULL, NULL, 0 };
-	TokenQueue q2 = { NULL, NULL, 0 };
-	int line = 1;
-	int column = 1;
-	char *czy = "int main() { return 0; }";
-	Token token;
-	while (1) {
-		token = GetNextToken(&state, &czy, &line, &column);
-		if (token.type == TOK_EOF) break;
-		TokenQueuePush(&q1, token);
-	}
-	TokenQueuePrint(q1);
-	TokenQueueFree(&q1);
-	return 0;
+	InitCompiler(&state, errors);
+	CompilerSetSource(&state, file.data, file.length);
+	state.maxErrors = options->maxErrors;
+	state.evalSteps = options->evalSteps;
+	state.diagnostics.path = path;
+	state.diagnostics.json = options->jsonDiagnostics;
+	state.modules = options->modules;
+
+	int count = 0;
+	bool ok = true;
+	if (options->ast || options->emit) {
+		Lexer lex;
+		ASTNode *root;
+		TokenBuffer tokens = { 0 };
+		// The parser reads the chunks lexed in parallel as it would read the
+		// lexer. They are lexed on a silenced copy of the state, and each
+		// lexical error is reported when the parser reaches its token.
+		if (options->pool && TokenBufferInit(&tokens, file.data, (int) (file.length / 4))) {
+			CompilerState quiet = state;
+			DiagnosticInit(&quiet.diagnostics, NULL);
+			TokenBufferLexParallel(&quiet, &tokens, options->pool, options->lexThreads * 4);
+			LexerInitTokens(&lex, &state, &tokens);
+		}
+		else LexerInit(&lex, &state);
+		ASTParseNode(&root, &state, &lex);
+		TokenBufferFree(&tokens);
+		if (state.hadError) ok = false;
+		else if (options->emit) ok = EmitFile(&state, root, options, path, key, pending);
+		else {
+			ASTFlat flat;
+			if (!ASTFlatInit(&flat, 256)) {
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+			ASTFlatten(&flat, &state.strings, root);
+			ASTFlatVisualize(&flat, &state.strings);
+			if (options->stats) ASTFlatPrintStats(&flat, errors);
+			ASTFlatFree(&flat);
+		}
+	}
+	else if (options->pool) {
+		TokenBuffer tokens;
+		ok = TokenBufferInit(&tokens, file.data, (int) (file.length / 4))
+			&& TokenBufferLexParallel(&state, &tokens, options->pool, options->lexThreads * 4);
+		TokenBufferPrint(&tokens);
+		count = tokens.count;
+		TokenBufferFree(&tokens);
+	}
+	else {
+		// Tokens are pulled one at a time, nothing holds the whole stream
+		Lexer lex;
+		LexerInit(&lex, &state);
+		while (1) {
+			Token token = LexerNext(&lex);
+			if (token.type == TOK_EOF) break;
+			if (token.type == TOK_ERROR) {
+				// Keep going to report every lexical error in one run
+				ok = false;
+				if (CompilerErrorLimitReached(&state)) break;
+				ExitPanicMode(&state);
+				continue;
+			}
+			TokenPrint(file.data, token);
+			count++;
+		}
+	}
+	if (!options->ast && !options->emit) printf("\n");
+
+	if (options->stats) {
+		// The parser pulls tokens without keeping count, only the dump knows it
+		if (options->ast || options->emit) fprintf(errors, "%s: %zu bytes (%s)\n", path, file.length, file.mappedLength ? "mapped" : "read");
+		else fprintf(errors, "%s: %d tokens from %zu bytes (%s)\n", path, count, file.length, file.mappedLength ? "mapped" : "read");
+		InternPrintStats(&state.strings, errors);
+		ArenaPrintStats(&state.arena, errors);
+	}
+
+	ok = ok && !state.hadError;
+	FreeCompiler(&state);
+	SourceClose(&file);
+	return ok;
+}
+
+static void CompileJobRun(void *argument) {
+	CompileJob *job = (CompileJob *) argument;
+	FILE *errors = open_memstream(&job->errors, &job->errorsLength);
+	if (errors == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	job->ok = CompileFile(job->path, job->options, errors, &job->out);
+	fclose(errors);
+}
+
+// Translates every file on a pool of threads, each in a state of its own,
+// and writes what they reported and emitted in input order. Returns the
+// number of files that failed.
+static int CompileParallel(const char **paths, int files, Options *options, int threads) {
+	CompileJob *jobs = (CompileJob *) calloc(files, sizeof(CompileJob));
+	ThreadPool pool;
+	int failed = 0;
+	int i;
+	if (jobs == NULL || !PoolInit(&pool, threads)) {
+		free(jobs);
+		return -1;
+	}
+	for (i = 0; i < files; i++) {
+		jobs[i].path = paths[i];
+		jobs[i].options = options;
+		if (!PoolSubmit(&pool, CompileJobRun, &jobs[i])) CompileJobRun(&jobs[i]);
+	}
+	PoolWait(&pool);
+	if (options->stats) fprintf(stderr, "%d files on %d threads, %ld tasks stolen\n", files, pool.threadCount, pool.steals);
+	PoolDestroy(&pool);
+
+	for (i = 0; i < files; i++) {
+		if (jobs[i].errorsLength) fwrite(jobs[i].errors, 1, jobs[i].errorsLength, stderr);
+		if (jobs[i].out.data && !BufferWrite(&jobs[i].out, stdout)) jobs[i].ok = false;
+		if (!jobs[i].ok) failed++;
+		free(jobs[i].errors);
+		BufferFree(&jobs[i].out);
+	}
+	free(jobs);
+	return failed;
+}
+
+int main(int argc, char **argv) {
+	Options options = { false, false, false, true, NULL, CZY_DEFAULT_MAX_ERRORS, CZY_DEFAULT_EVAL_STEPS, false, 0, NULL, NULL, 0, NULL, NULL };
+	const char *moduleCache = MODULE_DEFAULT_CACHE;
+	ModuleCache modules;
+	BuildCache build;
+	bool buildCache = true;
+	const char **paths = (const char **) malloc(argc * sizeof(const char *));
+	int files = 0;
+	int failed = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--stats") == 0) options.stats = true;
+		else if (strcmp(argv[i], "--ast") == 0) options.ast = true;
+		else if (strcmp(argv[i], "--emit-c") == 0) options.emit = true;
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			options.emit = true;
+			options.output = argv[++i];
+		}
+		else if (strcmp(argv[i], "--no-fold") == 0) options.fold = false;
+		else if (strcmp(argv[i], "--diagnostics-json") == 0) options.jsonDiagnostics = true;
+		else if (strcmp(argv[i], "--max-errors") == 0 && i + 1 < argc) options.maxErrors = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--eval-steps") == 0 && i + 1 < argc) options.evalSteps = atol(argv[++i]);
+		else if (strcmp(argv[i], "--lex-threads") == 0 && i + 1 < argc) options.lexThreads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--module-cache") == 0 && i + 1 < argc) moduleCache = argv[++i];
+		else if (strcmp(argv[i], "--no-module-cache") == 0) moduleCache = NULL;
+		else if (strcmp(argv[i], "--no-build-cache") == 0) buildCache = false;
+		else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+			options.emit = true;
+			options.outDir = argv[++i];
+		}
+		else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) && i + 1 < argc) options.jobs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--help") == 0) {
+			Usage(argv[0]);
+			return 0;
+		}
+		else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			Usage(argv[0]);
+			return 1;
+		}
+		else paths[files++] = argv[i];
+	}
+	if (files == 0) {
+		Usage(argv[0]);
+		return 1;
+	}
+	if (options.output && (files > 1 || options.outDir)) {
+		fprintf(stderr, "-o takes a single input file and no --out-dir\n");
+		return 1;
+	}
+	if (options.outDir) {
+		// Two inputs named alike would overwrite each other's C
+		for (i = 0; i < files; i++) {
+			const char *name = strrchr(paths[i], '/') ? strrchr(paths[i], '/') + 1 : paths[i];
+			int j;
+			if (strcmp(paths[i], "-") == 0) {
+				fprintf(stderr, "--out-dir needs named input files\n");
+				return 1;
+			}
+			for (j = 0; j < i; j++) {
+				const char *other = strrchr(paths[j], '/') ? strrchr(paths[j], '/') + 1 : paths[j];
+				if (strcmp(name, other) == 0) {
+					fprintf(stderr, "%s and %s would both be written to %s\n", paths[j], paths[i], options.outDir);
+					return 1;
+				}
+			}
+		}
+		if (mkdir(options.outDir, 0777) != 0 && errno != EEXIST) {
+			fprintf(stderr, "Could not create %s: %s\n", options.outDir, strerror(errno));
+			return 1;
+		}
+	}
+
+	ModuleCacheInit(&modules, moduleCache);
+	options.modules = &modules;
+	BuildCacheInit(&build, &modules);
+	if (buildCache && moduleCache && options.emit) options.build = &build;
+	// Only translation runs in parallel, the tree and tokens are printed as
+	// they are produced
+	int threads = options.jobs > 0 ? options.jobs : PoolDefaultThreads();
+	if (threads > files) threads = files;
+	failed = options.emit && threads > 1 ? CompileParallel(paths, files, &options, threads) : -1;
+	if (failed < 0) {
+		ThreadPool pool;
+		failed = 0;
+		if (options.lexThreads > 1 && PoolDefaultThreads() > 1 && PoolInit(&pool, options.lexThreads)) options.pool = &pool;
+		for (i = 0; i < files; i++) {
+			if (!CompileFile(paths[i], &options, stderr, NULL)) failed++;
+		}
+		if (options.pool) PoolDestroy(options.pool);
+	}
+	if (options.build && build.hits + build.misses) BuildCachePrintStats(&build, stderr);
+	if (options.stats && modules.hits + modules.builds) ModuleCachePrintStats(&modules, stderr);
+	BuildCacheFree(&build);
+	ModuleCacheFree(&modules);
+	free(paths);
+	return failed ? 1 : 0;
 }
@@ -0,0 +1,487 @@
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "module.h"
+#include "source.h"
+
+// FNV-1a, 64 bits
+uint64_t ModuleHash(const void *data, size_t length) {
+	return ModuleHashUpdate(MODULE_HASH_SEED, data, length);
+}
+// Carries on hash over more data, for keys made of several parts
+uint64_t ModuleHashUpdate(uint64_t hash, const void *data, size_t length) {
+	const unsigned char *bytes = (const unsigned char *) data;
+	size_t i;
+	for (i = 0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+// Maps a whole file read-only, NULL when it cannot be read or is empty
+void *ModuleMapFile(const char *path, size_t *length) {
+	struct stat info;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+	void *mapping = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) return NULL;
+	*length = (size_t) info.st_size;
+	return mapping;
+}
+// Any change to any part of the compiler can change what it writes, so the
+// binary itself stands for its version. 0 when it cannot be read.
+static uint64_t ModuleCompilerHash(void) {
+	size_t length = 0;
+	void *binary = ModuleMapFile("/proc/self/exe", &length);
+	if (binary == NULL) return 0;
+	uint64_t hash = ModuleHash(binary, length);
+	munmap(binary, length);
+	return hash ? hash : 1;
+}
+void ModuleCacheInit(ModuleCache *cache, const char *directory) {
+	*cache = (ModuleCache) { 0 };
+	// Without knowing the compiler nothing cached can be trusted
+	cache->compiler = directory ? ModuleCompilerHash() : 0;
+	cache->directory = cache->compiler ? directory : NULL;
+	pthread_mutex_init(&cache->lock, NULL);
+	pthread_cond_init(&cache->built, NULL);
+}
+void ModuleCacheFree(ModuleCache *cache) {
+	int i;
+	pthread_mutex_destroy(&cache->lock);
+	pthread_cond_destroy(&cache->built);
+	free(cache->building);
+	for (i = 0; i < cache->sourceCapacity; i++) free(cache->sources[i].path);
+	free(cache->sources);
+	cache->building = NULL;
+	cache->sources = NULL;
+	cache->buildingCount = cache->buildingCapacity = 0;
+	cache->sourceCount = cache->sourceCapacity = 0;
+}
+static struct ModuleSource *ModuleSourceSlot(struct ModuleSource *sources, int capacity, const char *path) {
+	unsigned int mask = (unsigned int) capacity - 1;
+	unsigned int i = (unsigned int) ModuleHash(path, strlen(path)) & mask;
+	while (sources[i].path && strcmp(sources[i].path, path) != 0) i = (i + 1) & mask;
+	return &sources[i];
+}
+static void ModuleSourceGrow(ModuleCache *cache) {
+	int capacity = cache->sourceCapacity ? cache->sourceCapacity * 2 : 64;
+	struct ModuleSource *sources = (struct ModuleSource *) calloc(capacity, sizeof(struct ModuleSource));
+	if (sources == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	int i;
+	for (i = 0; i < cache->sourceCapacity; i++) {
+		if (cache->sources[i].path) *ModuleSourceSlot(sources, capacity, cache->sources[i].path) = cache->sources[i];
+	}
+	free(cache->sources);
+	cache->sources = sources;
+	cache->sourceCapacity = capacity;
+}
+// Hash of the source at the canonical path, read once per run since
+// thousands of files may import the same module. False when it cannot be read.
+bool ModuleSourceHash(ModuleCache *cache, const char *path, uint64_t *hash) {
+	pthread_mutex_lock(&cache->lock);
+	struct ModuleSource *slot = cache->sourceCapacity ? ModuleSourceSlot(cache->sources, cache->sourceCapacity, path) : NULL;
+	bool found = slot && slot->path;
+	if (found) *hash = slot->hash;
+	pthread_mutex_unlock(&cache->lock);
+	if (found) return true;
+
+	size_t length = 0;
+	void *source = ModuleMapFile(path, &length);
+	// An empty file cannot be mapped, and hashes to the seed
+	if (source == NULL && access(path, R_OK) != 0) return false;
+	*hash = source ? ModuleHash(source, length) : ModuleHash("", 0);
+	if (source) munmap(source, length);
+
+	// Racing threads may both hash it, the first to get here adds it
+	pthread_mutex_lock(&cache->lock);
+	if ((cache->sourceCount + 1) * 2 > cache->sourceCapacity) ModuleSourceGrow(cache);
+	slot = ModuleSourceSlot(cache->sources, cache->sourceCapacity, path);
+	if (slot->path == NULL) {
+		size_t size = strlen(path) + 1;
+		slot->path = (char *) malloc(size);
+		if (slot->path == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		memcpy(slot->path, path, size);
+		slot->hash = *hash;
+		cache->sourceCount++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return true;
+}
+// C headers are #included, anything else is a Czy module
+bool ModuleIsHeader(const char *path) {
+	size_t length = strlen(path);
+	return length > 2 && strcmp(path + length - 2, ".h") == 0;
+}
+static void ModuleError(CompilerState *state, ASTNode *node, const char *format, const char *name) {
+	char message[256];
+	snprintf(message, sizeof(message), format, name);
+	ERROR_AT(state, node->token.line, node->token.column, message);
+}
+// name next to the file base, with .czy added when it has no extension
+static bool ModuleResolve(const char *base, const char *name, char *path) {
+	const char *slash = base && name[0] != '/' ? strrchr(base, '/') : NULL;
+	int directory = slash ? (int) (slash - base + 1) : 0;
+	size_t length = strlen(name);
+	const char *extension = length > 4 && strcmp(name + length - 4, ".czy") == 0 ? "" : ".czy";
+	int written = snprintf(path, MODULE_MAX_PATH, "%.*s%s%s", directory, base ? base : "", name, extension);
+	return written > 0 && written < MODULE_MAX_PATH;
+}
+static void ModuleInterfacePath(ModuleCache *cache, uint64_t hash, char *path) {
+	snprintf(path, MODULE_MAX_PATH, "%s/%016llx.czyi", cache->directory, (unsigned long long) hash);
+}
+
+// Functions are exported as prototypes, since their C comes from the module's
+// own translation; what the importer evaluates or instantiates goes whole
+static bool ModuleExports(ASTNode *node) {
+	switch (node->type) {
+		case AST_IMPORT:
+		case AST_GENERIC:
+			return true;
+		case AST_EXPRESSION:
+			if (node->expression.isConstexpr || node->expression.isCompiletime) return true;
+			return node->expression.body && node->expression.body->type == AST_FUNCTION && strcmp(node->expression.name, "main") != 0;
+		default:
+			return false;
+	}
+}
+bool ModuleWriteInterface(Buffer *out, CompilerState *module, ASTNode *root, uint64_t hash) {
+	ASTNodeNode *item;
+	if (root == NULL || root->type != AST_SCOPE) return false;
+	ASTNode *scope = (ASTNode *) ArenaCalloc(&module->arena, 1, sizeof(ASTNode));
+	scope->type = AST_SCOPE;
+	scope->scope.body = (ASTQueue *) ArenaCalloc(&module->arena, 1, sizeof(ASTQueue));
+	for (item = root->scope.body->first; item; item = item->prev) {
+		ASTNode *node = item->node;
+		if (!ModuleExports(node)) continue;
+		if (node->type == AST_EXPRESSION && !node->expression.isConstexpr && !node->expression.isCompiletime) {
+			ASTNode *prototype = (ASTNode *) ArenaAlloc(&module->arena, sizeof(ASTNode));
+			ASTNode *function = (ASTNode *) ArenaAlloc(&module->arena, sizeof(ASTNode));
+			*prototype = *node;
+			*function = *node->expression.body;
+			function->function.body = NULL;
+			prototype->expression.body = function;
+			node = prototype;
+		}
+		ASTQueuePush(&module->arena, scope->scope.body, node);
+	}
+
+	// Only the strings the exports use, numbered from 0
+	InternTable strings;
+	ASTFlat flat;
+	if (!InternTableInit(&strings, &module->arena)) return false;
+	if (!ASTFlatInit(&flat, 256)) {
+		InternTableFree(&strings);
+		return false;
+	}
+	ASTIndex rootIndex = ASTFlatten(&flat, &strings, scope);
+
+	ModuleHeader header = { { 'C', 'Z', 'Y', 'I' }, MODULE_VERSION, hash, (uint32_t) strings.count, 0, flat.count, flat.extraCount, rootIndex, 0 };
+	int i;
+	for (i = 0; i < strings.count; i++) header.stringBytes += (uint32_t) strings.lengths[i] + 1;
+	BufferAppend(out, (const char *) &header, sizeof(header));
+	uint32_t offset = 0;
+	for (i = 0; i < strings.count; i++) {
+		BufferAppend(out, (const char *) &offset, sizeof(offset));
+		offset += (uint32_t) strings.lengths[i] + 1;
+	}
+	BufferAppend(out, (const char *) flat.lhs, flat.count * sizeof(ASTIndex));
+	BufferAppend(out, (const char *) flat.rhs, flat.count * sizeof(ASTIndex));
+	BufferAppend(out, (const char *) flat.extra, flat.extraCount * sizeof(ASTIndex));
+	BufferAppend(out, (const char *) flat.kind, flat.count);
+	BufferAppend(out, (const char *) flat.op, flat.count);
+	for (i = 0; i < strings.count; i++) BufferAppend(out, strings.strings[i], strings.lengths[i] + 1);
+
+	ASTFlatFree(&flat);
+	InternTableFree(&strings);
+	return true;
+}
+// Checks that data holds a whole interface for a source with the given hash
+// and points interface's arrays into it
+bool ModuleReadInterface(ModuleInterface *interface, const void *data, size_t length, uint64_t hash) {
+	const ModuleHeader *header = (const ModuleHeader *) data;
+	*interface = (ModuleInterface) { 0 };
+	if (length < sizeof(ModuleHeader) || memcmp(header->magic, "CZYI", 4) != 0) return false;
+	if (header->version != MODULE_VERSION || header->hash != hash) return false;
+	if (header->nodeCount == 0 || header->root >= header->nodeCount) return false;
+	uint64_t words = (uint64_t) header->stringCount + 2 * (uint64_t) header->nodeCount + header->extraCount;
+	uint64_t expected = sizeof(ModuleHeader) + words * sizeof(uint32_t) + 2 * (uint64_t) header->nodeCount + header->stringBytes;
+	if (expected != length) return false;
+
+	const uint32_t *word = (const uint32_t *) (header + 1);
+	interface->header = header;
+	interface->stringOffsets = word;
+	word += header->stringCount;
+	interface->ast.lhs = (ASTIndex *) word;
+	word += header->nodeCount;
+	interface->ast.rhs = (ASTIndex *) word;
+	word += header->nodeCount;
+	interface->ast.extra = (ASTIndex *) word;
+	word += header->extraCount;
+	interface->ast.kind = (unsigned char *) word;
+	interface->ast.op = interface->ast.kind + header->nodeCount;
+	interface->strings = (const char *) (interface->ast.op + header->nodeCount);
+	interface->ast.count = interface->ast.capacity = header->nodeCount;
+	interface->ast.extraCount = interface->ast.extraCapacity = header->extraCount;
+
+	// Every string must end inside the file
+	uint32_t i;
+	if (header->stringCount && (header->stringBytes == 0 || interface->strings[header->stringBytes - 1] != '\0')) return false;
+	for (i = 0; i < header->stringCount; i++) {
+		if (interface->stringOffsets[i] >= header->stringBytes) return false;
+	}
+	return true;
+}
+static bool ModuleMap(ModuleCache *cache, uint64_t hash, ModuleInterface *interface) {
+	char path[MODULE_MAX_PATH];
+	size_t length = 0;
+	if (cache->directory == NULL) return false;
+	ModuleInterfacePath(cache, hash, path);
+	void *mapping = ModuleMapFile(path, &length);
+	if (mapping == NULL) return false;
+	if (!ModuleReadInterface(interface, mapping, length, hash)) {
+		munmap(mapping, length);
+		return false;
+	}
+	interface->mapping = mapping;
+	interface->mappedLength = length;
+	return true;
+}
+// Written under a temporary name and renamed, so a reader never maps half
+// a file. The cache is only an optimization: failing to write is not an error.
+void ModuleCacheWrite(ModuleCache *cache, const char *name, Buffer *data) {
+	char path[MODULE_MAX_PATH], temporary[MODULE_MAX_PATH + 32];
+	if (cache->directory == NULL) return;
+	if (mkdir(cache->directory, 0777) != 0 && errno != EEXIST) return;
+	snprintf(path, sizeof(path), "%s/%s", cache->directory, name);
+	pthread_mutex_lock(&cache->lock);
+	long sequence = cache->sequence++;
+	pthread_mutex_unlock(&cache->lock);
+	snprintf(temporary, sizeof(temporary), "%s.%ld.%ld.tmp", path, (long) getpid(), sequence);
+	FILE *stream = fopen(temporary, "wb");
+	if (stream == NULL) return;
+	bool ok = BufferWrite(data, stream);
+	ok = fclose(stream) == 0 && ok;
+	if (!ok || rename(temporary, path) != 0) remove(temporary);
+}
+// Names the interface of the source with hash as written by this compiler
+static uint64_t ModuleInterfaceKey(ModuleCache *cache, uint64_t hash) {
+	return ModuleHashUpdate(hash, &cache->compiler, sizeof(cache->compiler));
+}
+static void ModuleStore(ModuleCache *cache, uint64_t hash, Buffer *interface) {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.czyi", (unsigned long long) hash);
+	ModuleCacheWrite(cache, name, interface);
+}
+static bool ModuleIsBuilding(ModuleCache *cache, uint64_t hash) {
+	int i;
+	for (i = 0; i < cache->buildingCount; i++) {
+		if (cache->building[i] == hash) return true;
+	}
+	return false;
+}
+// Maps the interface for hash, or claims its build. A file importing
+// directly waits while another thread builds the same module; a module being
+// built never waits, since two of them importing each other would wait
+// forever, and builds again instead.
+static bool ModuleMapOrClaim(ModuleCache *cache, CompilerState *state, uint64_t hash, ModuleInterface *interface, bool *claimed) {
+	*claimed = false;
+	if (ModuleMap(cache, hash, interface)) return true;
+	if (cache->directory == NULL) return false;
+	pthread_mutex_lock(&cache->lock);
+	if (state->importer == NULL && ModuleIsBuilding(cache, hash)) {
+		while (ModuleIsBuilding(cache, hash)) pthread_cond_wait(&cache->built, &cache->lock);
+		pthread_mutex_unlock(&cache->lock);
+		// The build may have failed, then this import reports why
+		if (ModuleMap(cache, hash, interface)) return true;
+		pthread_mutex_lock(&cache->lock);
+	}
+	if (!ModuleIsBuilding(cache, hash)) {
+		if (cache->buildingCount == cache->buildingCapacity) {
+			int capacity = cache->buildingCapacity ? cache->buildingCapacity * 2 : 8;
+			uint64_t *building = (uint64_t *) realloc(cache->building, capacity * sizeof(uint64_t));
+			if (building == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				exit(1);
+			}
+			cache->building = building;
+			cache->buildingCapacity = capacity;
+		}
+		cache->building[cache->buildingCount++] = hash;
+		*claimed = true;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return false;
+}
+static void ModuleRelease(ModuleCache *cache, uint64_t hash) {
+	int i;
+	pthread_mutex_lock(&cache->lock);
+	for (i = 0; i < cache->buildingCount; i++) {
+		if (cache->building[i] == hash) {
+			cache->building[i] = cache->building[--cache->buildingCount];
+			break;
+		}
+	}
+	pthread_cond_broadcast(&cache->built);
+	pthread_mutex_unlock(&cache->lock);
+}
+// Parses the module at path in a state of its own, reporting its errors
+// under its own name, and writes its interface to out
+static bool ModuleBuild(CompilerState *state, const char *path, SourceFile *source, uint64_t hash, Buffer *out) {
+	CompilerState module;
+	Lexer lex;
+	ASTNode *root;
+	InitCompiler(&module, state->outputStream);
+	CompilerSetSource(&module, source->data, source->length);
+	module.maxErrors = state->maxErrors;
+	module.evalSteps = state->evalSteps;
+	module.diagnostics.path = path;
+	module.diagnostics.json = state->diagnostics.json;
+	module.modules = state->modules;
+	module.importer = state;
+	LexerInit(&lex, &module);
+	ASTParseNode(&root, &module, &lex);
+	bool ok = !module.hadError && ModuleWriteInterface(out, &module, root, hash);
+	FreeCompiler(&module);
+	return ok;
+}
+static ASTQueue *ModuleImportFrom(CompilerState *state, ASTNode *node, const char *base);
+// Rebuilds the exports in state and declares them at the import, whose
+// position they take for diagnostics
+static ASTQueue *ModuleInflate(CompilerState *state, ModuleInterface *interface, ASTNode *node, const char *path) {
+	uint32_t count = interface->header->stringCount, i;
+	const char **strings = (const char **) malloc((count ? count : 1) * sizeof(const char *));
+	if (strings == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < count; i++) {
+		const char *text = interface->strings + interface->stringOffsets[i];
+		strings[i] = InternString(&state->strings, text, (int) strlen(text));
+	}
+	ASTNode *scope = ASTInflate(state, &interface->ast, strings, count, interface->header->root, node->token);
+	free(strings);
+	if (scope == NULL || scope->type != AST_SCOPE) {
+		ModuleError(state, node, "The interface of module '%s' is damaged", node->import);
+		return NULL;
+	}
+
+	ASTNodeNode *item;
+	for (item = scope->scope.body->first; item; item = item->prev) {
+		ASTNode *export = item->node;
+		const char *name = export->type == AST_GENERIC ? export->generic.name : export->type == AST_EXPRESSION ? export->expression.name : NULL;
+		if (export->type == AST_IMPORT && !ModuleIsHeader(export->import)) export->exports = ModuleImportFrom(state, export, path);
+		else if (name && !SymbolDeclare(&state->symbols, name, export, 0)) ModuleError(state, node, "'%s' is already declared in this scope", name);
+	}
+	return scope->scope.body;
+}
+static ASTQueue *ModuleImportFrom(CompilerState *state, ASTNode *node, const char *base) {
+	char path[MODULE_MAX_PATH];
+	CompilerState *importer;
+	int i;
+	if (!ModuleResolve(base, node->import, path)) {
+		ModuleError(state, node, "The path of module '%s' is too long", node->import);
+		return NULL;
+	}
+	// Modules are told apart by their canonical path, however they were named
+	char canonical[PATH_MAX], other[PATH_MAX];
+	SourceFile source;
+	if (realpath(path, canonical) == NULL || access(canonical, R_OK) != 0) {
+		ModuleError(state, node, "Cannot find module '%s'", node->import);
+		return NULL;
+	}
+	const char *identity = InternString(&state->strings, canonical, (int) strlen(canonical));
+	for (i = 0; i < state->importCount; i++) {
+		// A module imported twice is declared already
+		if (state->imports[i] == identity) return (ASTQueue *) ArenaCalloc(&state->arena, 1, sizeof(ASTQueue));
+	}
+	for (importer = state; importer; importer = importer->importer) {
+		if (importer->diagnostics.path && realpath(importer->diagnostics.path, other) && strcmp(other, canonical) == 0) {
+			ModuleError(state, node, "Module '%s' is part of an import cycle", node->import);
+			return NULL;
+		}
+	}
+	if (state->importCount == state->importCapacity) {
+		int capacity = state->importCapacity ? state->importCapacity * 2 : 8;
+		const char **imports = (const char **) realloc(state->imports, capacity * sizeof(const char *));
+		if (imports != NULL) state->imports = imports;
+		uint64_t *hashes = (uint64_t *) realloc(state->importHashes, capacity * sizeof(uint64_t));
+		if (hashes != NULL) state->importHashes = hashes;
+		if (imports == NULL || hashes == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		state->importCapacity = capacity;
+	}
+	int index = state->importCount++;
+	ModuleCache *cache = state->modules;
+	uint64_t hash;
+	state->imports[index] = identity;
+	state->importHashes[index] = 0;
+	if (!ModuleSourceHash(cache, canonical, &hash)) {
+		ModuleError(state, node, "Cannot read module '%s'", node->import);
+		return NULL;
+	}
+	// Its diagnostics and the modules it imports go by the path as resolved
+	const char *resolved = InternString(&state->strings, path, (int) strlen(path));
+	state->importHashes[index] = hash;
+	ModuleInterface interface;
+	Buffer built = { 0 };
+	bool claimed;
+	uint64_t key = ModuleInterfaceKey(cache, hash);
+	// The source is only read when there is no interface for it yet
+	if (ModuleMapOrClaim(cache, state, key, &interface, &claimed)) {
+		pthread_mutex_lock(&cache->lock);
+		cache->hits++;
+		pthread_mutex_unlock(&cache->lock);
+	}
+	else {
+		bool ok = SourceOpen(&source, canonical);
+		// Edited since it was hashed: that is what this run goes by
+		if (ok && ModuleHash(source.data, source.length) != hash) ok = false;
+		if (ok) {
+			BufferInit(&built, source.length);
+			ok = ModuleBuild(state, resolved, &source, key, &built) && ModuleReadInterface(&interface, built.data, built.length, key);
+			if (ok) ModuleStore(cache, key, &built);
+			SourceClose(&source);
+		}
+		if (claimed) ModuleRelease(cache, key);
+		if (!ok) {
+			ModuleError(state, node, "Module '%s' has errors", node->import);
+			BufferFree(&built);
+			return NULL;
+		}
+		pthread_mutex_lock(&cache->lock);
+		cache->builds++;
+		pthread_mutex_unlock(&cache->lock);
+	}
+
+	ASTQueue *exports = ModuleInflate(state, &interface, node, resolved);
+	if (interface.mapping) munmap(interface.mapping, interface.mappedLength);
+	BufferFree(&built);
+	return exports;
+}
+// Resolves import "name" of a Czy module next to the importing file: loads
+// the interface cached for the module's current source, or parses it and
+// caches one. Returns its exports, declared in state, or NULL after
+// reporting why it could not be imported.
+ASTQueue *ModuleImport(CompilerState *state, ASTNode *import) {
+	return ModuleImportFrom(state, import, state->diagnostics.path);
+}
+void ModuleCachePrintStats(ModuleCache *cache, FILE *stream) {
+	fprintf(stream, "Modules: %ld interfaces loaded, %ld built\n", cache->hits, cache->builds);
+}
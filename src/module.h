@@ -0,0 +1,80 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "ast.h"
+#include "buffer.h"
+
+// Bumped whenever the layout of an interface changes
+#define MODULE_VERSION 1
+#define MODULE_DEFAULT_CACHE ".czy-cache"
+#define MODULE_MAX_PATH 4096
+#define MODULE_HASH_SEED 0xcbf29ce484222325ULL
+
+typedef struct ModuleHeader ModuleHeader;
+typedef struct ModuleInterface ModuleInterface;
+
+// Start of an interface file. After it come the string offsets, lhs, rhs
+// and extra (all uint32_t), kind and op (a byte each), then the strings,
+// each '\0' terminated. Interfaces are cache files read by the machine that
+// wrote them, so everything is in native byte order.
+struct ModuleHeader {
+	char magic[4];		// "CZYI"
+	uint32_t version;
+	uint64_t hash;		// Of the module's source and the compiler, also the file's name
+	uint32_t stringCount;
+	uint32_t stringBytes;
+	uint32_t nodeCount;	// Including the reserved node 0
+	uint32_t extraCount;
+	uint32_t root;		// An AST_SCOPE holding the exported declarations
+	uint32_t reserved;
+};
+// What a module exports, as the flat AST of ASTFlatten: its functions as
+// prototypes, constexpr and compiletime functions and variables whole, its
+// generics with every arm, and its imports. The arrays point into the
+// mapped file or the buffer the interface was read from.
+struct ModuleInterface {
+	const ModuleHeader *header;
+	const uint32_t *stringOffsets;
+	const char *strings;
+	ASTFlat ast;
+	void *mapping;		// To unmap, NULL when read from memory
+	size_t mappedLength;
+};
+// Shared by every file of one run, which may be compiled on several threads:
+// where interfaces are kept, which ones are being built right now, and how
+// often an import could use one
+struct ModuleCache {
+	const char *directory;	// NULL to parse every imported module
+	uint64_t compiler;	// Hash of the compiler's own binary, part of every key
+	pthread_mutex_t lock;	// Guards everything below
+	pthread_cond_t built;	// Signalled when a build is done
+	uint64_t *building;	// Hashes of the modules being built
+	int buildingCount;
+	int buildingCapacity;
+	long sequence;		// Tells apart temporary files of one process
+	struct ModuleSource {
+		char *path;		// Canonical, owned
+		uint64_t hash;
+	} *sources;		// Sources hashed so far, open addressing by path
+	int sourceCount;
+	int sourceCapacity;
+	long hits;		// Imports that loaded an interface
+	long builds;		// Imports that parsed the module and wrote its interface
+};
+
+uint64_t ModuleHash(const void *data, size_t length);
+uint64_t ModuleHashUpdate(uint64_t hash, const void *data, size_t length);
+void ModuleCacheInit(ModuleCache *cache, const char *directory);
+void ModuleCacheFree(ModuleCache *cache);
+void ModuleCacheWrite(ModuleCache *cache, const char *name, Buffer *data);
+void *ModuleMapFile(const char *path, size_t *length);
+bool ModuleSourceHash(ModuleCache *cache, const char *path, uint64_t *hash);
+bool ModuleIsHeader(const char *path);
+bool ModuleWriteInterface(Buffer *out, CompilerState *module, ASTNode *root, uint64_t hash);
+bool ModuleReadInterface(ModuleInterface *interface, const void *data, size_t length, uint64_t hash);
+ASTQueue *ModuleImport(CompilerState *state, ASTNode *import);
+void ModuleCachePrintStats(ModuleCache *cache, FILE *stream);
+
+#endif
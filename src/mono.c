@@ -0,0 +1,112 @@
+#include "mono.h"
+
+static unsigned int MonoHash(ASTNode *generic, const Type *type) {
+	uintptr_t key = (uintptr_t) generic * 31 ^ (uintptr_t) type;
+	key ^= key >> 17;
+	key *= 0xed5ad4bbu;
+	key ^= key >> 11;
+	return (unsigned int) key;
+}
+static bool MonoGrowSlots(MonoTable *t) {
+	int capacity = t->slotCapacity ? t->slotCapacity * 2 : 64;
+	int *slots = (int *) calloc(capacity, sizeof(int));
+	if (slots == NULL) return false;
+
+	int index;
+	for (index = 0; index < t->count; index++) {
+		unsigned int i = MonoHash(t->instances[index].generic, t->instances[index].type) & (capacity - 1);
+		while (slots[i]) i = (i + 1) & (capacity - 1);
+		slots[i] = index + 1;
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->slotCapacity = capacity;
+	return true;
+}
+// Arms are matched by the canonical type, the default arm catches the rest
+static ASTNode *MonoSelectArm(ASTNode *generic, const Type *type) {
+	ASTNodeNode *item;
+	ASTNode *fallback = NULL;
+	for (item = generic->generic.arms->first; item; item = item->prev) {
+		if (item->node->arm.type == type) return item->node;
+		if (item->node->arm.type == NULL && fallback == NULL) fallback = item->node;
+	}
+	return fallback;
+}
+static bool MonoNameTaken(MonoTable *t, SymbolTable *symbols, const char *name) {
+	int i;
+	if (symbols && SymbolLookup(symbols, name)) return true;
+	for (i = 0; i < t->count; i++) {
+		if (t->instances[i].name == name) return true;
+	}
+	return false;
+}
+// Name_type, with the type's spaces and stars spelled out for C. While that
+// names a file scope declaration or another instance, _2, _3... is added.
+static const char *MonoMangle(MonoTable *t, InternTable *strings, SymbolTable *symbols, const char *name, const Type *argument) {
+	const char *type;
+	Buffer mangled;
+	BufferInit(&mangled, strlen(name) + strlen(argument->name) * 3 + 16);
+	BufferAppendString(&mangled, name);
+	BufferAppendChar(&mangled, '_');
+	for (type = argument->name; *type; type++) {
+		if (*type == ' ') BufferAppendChar(&mangled, '_');
+		else if (*type == '*') BufferAppendString(&mangled, "ptr");
+		else BufferAppendChar(&mangled, *type);
+	}
+	size_t length = mangled.length;
+	int suffix = 1;
+	const char *result = InternString(strings, mangled.data, (int) mangled.length);
+	while (MonoNameTaken(t, symbols, result)) {
+		mangled.length = length;
+		BufferAppendf(&mangled, "_%d", ++suffix);
+		result = InternString(strings, mangled.data, (int) mangled.length);
+	}
+	BufferFree(&mangled);
+	return result;
+}
+
+bool MonoInit(MonoTable *t) {
+	*t = (MonoTable) { 0 };
+	return MonoGrowSlots(t);
+}
+// Returns the instance for generic at type, creating it on first use. Its
+// C name avoids the names declared in symbols, NULL for none.
+MonoInstance *MonoInstantiate(MonoTable *t, InternTable *strings, SymbolTable *symbols, ASTNode *generic, const Type *type) {
+	unsigned int mask = t->slotCapacity - 1;
+	unsigned int i = MonoHash(generic, type) & mask;
+
+	t->lookups++;
+	while (t->slots[i]) {
+		MonoInstance *instance = &t->instances[t->slots[i] - 1];
+		if (instance->generic == generic && instance->type == type) return instance;
+		i = (i + 1) & mask;
+	}
+
+	if ((t->count + 1) * 2 > t->slotCapacity) {
+		if (!MonoGrowSlots(t)) return NULL;
+		mask = t->slotCapacity - 1;
+		i = MonoHash(generic, type) & mask;
+		while (t->slots[i]) i = (i + 1) & mask;
+	}
+	if (t->count == t->capacity) {
+		int capacity = t->capacity ? t->capacity * 2 : 32;
+		MonoInstance *instances = (MonoInstance *) realloc(t->instances, capacity * sizeof(MonoInstance));
+		if (instances == NULL) return NULL;
+		t->instances = instances;
+		t->capacity = capacity;
+	}
+
+	MonoInstance *instance = &t->instances[t->count];
+	instance->generic = generic;
+	instance->type = type;
+	instance->arm = MonoSelectArm(generic, type);
+	instance->name = MonoMangle(t, strings, symbols, generic->generic.name, type);
+	t->slots[i] = ++t->count;
+	return instance;
+}
+void MonoFree(MonoTable *t) {
+	free(t->instances);
+	free(t->slots);
+	*t = (MonoTable) { 0 };
+}
@@ -0,0 +1,33 @@
+#ifndef MONO_H
+#define MONO_H
+
+#include <stdint.h>
+#include "parser.h"
+#include "buffer.h"
+
+typedef struct MonoInstance MonoInstance;
+typedef struct MonoTable MonoTable;
+
+// One specialization of a generic function for a concrete type
+struct MonoInstance {
+	ASTNode *generic;	// AST_GENERIC
+	const Type *type;	// Canonical type argument
+	ASTNode *arm;		// The arm that matched, NULL when none did
+	const char *name;	// Interned name of the C function
+};
+// Instantiation cache keyed by (generic, type). Both keys are pointers to
+// unique objects, so lookups never compare strings.
+struct MonoTable {
+	MonoInstance *instances;	// In the order they were first used
+	int count;
+	int capacity;
+	int *slots;			// Open addressing table of index + 1, 0 is empty
+	int slotCapacity;
+	long lookups;
+};
+
+bool MonoInit(MonoTable *t);
+MonoInstance *MonoInstantiate(MonoTable *t, InternTable *strings, SymbolTable *symbols, ASTNode *generic, const Type *type);
+void MonoFree(MonoTable *t);
+
+#endif
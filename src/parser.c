@@ -1,218 +1,759 @@
 #include "parser.h"
+#include "eval.h"
+#include "module.h"
 
-ASTNode *ASTParseScope(TokenQueue *q1, TokenQueue *q2) {
-	if (q1->length < 2) {
-		fprintf(stderr, "Insufficient tokens in scope.\n");
-		exit(1);
+// Interned text of a token, shared by every node naming the same thing
+static const char *ASTTokenIntern(CompilerState *state, Lexer *lex, Token token) {
+	return InternString(&state->strings, LexerText(lex, token), token.length);
+}
+// Nodes start zeroed so that unset children read as NULL
+static ASTNode *ASTNodeCreate(CompilerState *state, NodeType type, Token token) {
+	ASTNode *node = (ASTNode *) ArenaCalloc(&state->arena, 1, sizeof(ASTNode));
+	node->type = type;
+	node->token = token;
+	return node;
+}
+// Reports that token is not what the grammar expected here. CompilerError
+// stays silent while panicking, so only the first error of a statement shows.
+static void ASTUnexpected(CompilerState *state, Lexer *lex, Token token, const char *expected) {
+	char message[160];
+	if (token.type == TOK_EOF) snprintf(message, sizeof(message), "Unexpected end of input, %s was expected", expected);
+	else snprintf(message, sizeof(message), "Unexpected '%.*s', %s was expected", token.length > 32 ? 32 : token.length, LexerText(lex, token), expected);
+	ERROR_AT(state, token.line, token.column, message);
+}
+static ASTNode *ASTErrorNode(CompilerState *state, Lexer *lex, const char *expected) {
+	Token token = LexerPeek(lex, 0);
+	ASTUnexpected(state, lex, token, expected);
+	return ASTNodeCreate(state, AST_ERROR, token);
+}
+static bool ASTExpect(CompilerState *state, Lexer *lex, TokenType type, const char *expected) {
+	if (LexerExpect(lex, type)) {
+		LexerNext(lex);
+		return true;
+	}
+	ASTUnexpected(state, lex, LexerPeek(lex, 0), expected);
+	return false;
+}
+// Panic-mode recovery: skip to the end of the statement, or to the brace
+// closing the block, so the next statement parses cleanly
+static void ASTSynchronize(CompilerState *state, Lexer *lex) {
+	while (!LexerExpect(lex, TOK_EOF) && !LexerExpect(lex, TOK_CLOSECURLYBRACES)) {
+		if (LexerNext(lex).type == TOK_SEMICOLON) break;
 	}
+	ExitPanicMode(state);
+}
+static bool ASTIsTypeStart(Lexer *lex, int k) {
+	TokenType type = LexerPeekType(lex, k);
+	return TokenTypeIsDataType(type) || type == TOK_CONST || type == TOK_VOLATILE || type == TOK_STRUCT || type == TOK_UNION || type == TOK_ENUM;
+}
+// A declaration starts with constexpr, compiletime or a type, or with a type
+// name such as a generic's type parameter followed by the declared name
+static bool ASTIsDeclarationStart(Lexer *lex) {
+	if (LexerExpect(lex, TOK_CONSTEXPR) || LexerExpect(lex, TOK_COMPILETIME)) return true;
+	return ASTIsTypeStart(lex, 0) || (LexerExpect(lex, TOK_ID) && LexerPeekType(lex, 1) == TOK_ID);
+}
+// A generic arm label: a type or default, then a colon
+static bool ASTIsArmLabel(Lexer *lex) {
+	int k = 0;
+	if (LexerExpect(lex, TOK_DEFAULT)) return LexerPeekType(lex, 1) == TOK_COLON;
+	while (k < LEXER_LOOKAHEAD - 1 && (ASTIsTypeStart(lex, k) || LexerPeekType(lex, k) == TOK_STAR || (k == 0 && LexerExpect(lex, TOK_ID)))) k++;
+	return k > 0 && k < LEXER_LOOKAHEAD && LexerPeekType(lex, k) == TOK_COLON;
+}
+static ASTNode *ASTParseStatement(CompilerState *state, Lexer *lex, bool *needsSemicolon);
+static void ASTParseStatementInto(CompilerState *state, Lexer *lex, ASTQueue *body);
 
-	ASTNode *node = (ASTNode *) malloc(sizeof(ASTNode));
-	if (node == NULL) return NULL;
+// Makes a declaration visible until its scope closes. Redeclaring a name in
+// the same scope is reported without leaving panic mode, parsing is fine.
+static void ASTDeclare(CompilerState *state, const char *name, ASTNode *declaration, Token token) {
+	if (SymbolDeclare(&state->symbols, name, declaration, 0) || state->panicMode) return;
+	char message[160];
+	snprintf(message, sizeof(message), "'%s' is already declared in this scope", name);
+	ERROR_AT(state, token.line, token.column, message);
+	ExitPanicMode(state);
+}
 
-	node->type = AST_SCOPE;
-	if (!TokenExpect(q1, TOK_OPENCURLYBRACES)) {
-		fprintf(stderr, "Unexpected token in scope: %s\nAn opening curly brace was expected.\n", TokenQueuePeek(q1).value);
-		exit(1);
+// The statement of an if or a loop, with its semicolon
+static ASTNode *ASTParseBody(CompilerState *state, Lexer *lex) {
+	bool needsSemicolon;
+	ASTNode *node = ASTParseStatement(state, lex, &needsSemicolon);
+	if (!state->panicMode && needsSemicolon) ASTExpect(state, lex, TOK_SEMICOLON, "a semicolon");
+	return node;
+}
+static ASTNode *ASTParseIf(CompilerState *state, Lexer *lex) {
+	ASTNode *node = ASTNodeCreate(state, AST_IF, LexerNext(lex));
+	if (!ASTExpect(state, lex, TOK_OPENPARENTHESIS, "an opening parenthesis")) return node;
+	node->ifStatement.condition = ASTParseValue(state, lex);
+	if (!ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis")) return node;
+	node->ifStatement.then = ASTParseBody(state, lex);
+	if (!state->panicMode && LexerExpect(lex, TOK_ELSE)) {
+		LexerNext(lex);
+		node->ifStatement.otherwise = ASTParseBody(state, lex);
+	}
+	return node;
+}
+static ASTNode *ASTParseWhile(CompilerState *state, Lexer *lex) {
+	ASTNode *node = ASTNodeCreate(state, AST_WHILE, LexerNext(lex));
+	if (!ASTExpect(state, lex, TOK_OPENPARENTHESIS, "an opening parenthesis")) return node;
+	node->loop.condition = ASTParseValue(state, lex);
+	if (!ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis")) return node;
+	node->loop.body = ASTParseBody(state, lex);
+	return node;
+}
+// (init; condition; step) body, every part but the body is optional
+static void ASTParseForClauses(CompilerState *state, Lexer *lex, ASTNode *node) {
+	if (!ASTExpect(state, lex, TOK_OPENPARENTHESIS, "an opening parenthesis")) return;
+	if (!LexerExpect(lex, TOK_SEMICOLON)) node->loop.init = ASTIsDeclarationStart(lex) ? ASTParseExpression(state, lex) : ASTParseValue(state, lex);
+	if (!ASTExpect(state, lex, TOK_SEMICOLON, "a semicolon")) return;
+	if (!LexerExpect(lex, TOK_SEMICOLON)) node->loop.condition = ASTParseValue(state, lex);
+	if (!ASTExpect(state, lex, TOK_SEMICOLON, "a semicolon")) return;
+	if (!LexerExpect(lex, TOK_CLOSEPARENTHESIS)) node->loop.step = ASTParseValue(state, lex);
+	if (!ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis")) return;
+	node->loop.body = ASTParseBody(state, lex);
+}
+// A declaration in the init clause is only visible in the loop
+static ASTNode *ASTParseFor(CompilerState *state, Lexer *lex) {
+	ASTNode *node = ASTNodeCreate(state, AST_FOR, LexerNext(lex));
+	SymbolScopePush(&state->symbols);
+	ASTParseForClauses(state, lex, node);
+	SymbolScopePop(&state->symbols);
+	return node;
+}
+static ASTNode *ASTParseImport(CompilerState *state, Lexer *lex) {
+	ASTNode *node = ASTNodeCreate(state, AST_IMPORT, LexerNext(lex));
+	if (!LexerExpect(lex, TOK_STRINGLIT)) return ASTErrorNode(state, lex, "a quoted module name");
+	Token path = LexerNext(lex);
+	node->import = InternString(&state->strings, LexerText(lex, path) + 1, path.length - 2);
+	if (state->modules && !ModuleIsHeader(node->import)) node->exports = ModuleImport(state, node);
+	return node;
+}
+// (parameters) { type: statements... default: statements... }, each arm in
+// its own scope nested in the parameters'
+static void ASTParseGenericBody(CompilerState *state, Lexer *lex, ASTNode *node) {
+	if (!ASTExpect(state, lex, TOK_OPENPARENTHESIS, "an opening parenthesis")) return;
+	while (!LexerExpect(lex, TOK_CLOSEPARENTHESIS)) {
+		ASTQueuePush(&state->arena, node->generic.parameters, ASTParseExpression(state, lex));
+		if (state->panicMode || !LexerExpect(lex, TOK_COMMA)) break;
+		LexerNext(lex);
 	}
-	TokenQueuePush(q2, TokenQueuePop(q1));
+	if (!ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis")) return;
 
-	while (q1->length > 0 && !TokenExpect(q1, TOK_CLOSECURLYBRACES)) {
-		if (TokenExpect(q1, TOK_RETURN)) {
-			node->returnStatement.expression = ASTParseReturn(q1, q2);
-			continue;
-		}
-		else if (TokenIsDataType(q1)) {
-			node->expression.body = ASTParseExpression(q1, q2);
+	if (!ASTExpect(state, lex, TOK_OPENCURLYBRACES, "an opening curly brace")) return;
+	ASTNode *arm = NULL;
+	while (!LexerExpect(lex, TOK_EOF) && !LexerExpect(lex, TOK_CLOSECURLYBRACES) && !CompilerErrorLimitReached(state)) {
+		if (ASTIsArmLabel(lex)) {
+			if (arm) SymbolScopePop(&state->symbols);
+			SymbolScopePush(&state->symbols);
+			arm = ASTNodeCreate(state, AST_GENERICARM, LexerPeek(lex, 0));
+			arm->arm.body = (ASTQueue *) ArenaCalloc(&state->arena, 1, sizeof(ASTQueue));
+			if (LexerExpect(lex, TOK_DEFAULT)) LexerNext(lex);
+			else arm->arm.type = ASTParseType(state, lex);
+			LexerNext(lex);
+			ASTQueuePush(&state->arena, node->generic.arms, arm);
 			continue;
 		}
-		else if (TokenExpect(q1, TOK_ID)) {
-			node->expression.body = ASTParseFunction(q1, q2);
+		if (arm == NULL) {
+			ASTUnexpected(state, lex, LexerPeek(lex, 0), "a type label");
+			ASTSynchronize(state, lex);
 			continue;
 		}
-		else if (TokenExpect(q1, TOK_INTLIT)) {
-			node->intLit = ASTParseValue(q1, q2)->intLit;
-			continue;
-		}
-		else {
-			fprintf(stderr, "Unexpected token in scope: %s\n", TokenQueuePeek(q1).value);
-			exit(1);
-		}
+		ASTParseStatementInto(state, lex, arm->arm.body);
 	}
+	if (arm) SymbolScopePop(&state->symbols);
+	if (!CompilerErrorLimitReached(state)) ASTExpect(state, lex, TOK_CLOSECURLYBRACES, "a closing curly brace");
+}
+// generic type name<T>(parameters) { type: statements... default: statements... }
+static ASTNode *ASTParseGeneric(CompilerState *state, Lexer *lex) {
+	ASTNode *node = ASTNodeCreate(state, AST_GENERIC, LexerNext(lex));
+	node->generic.parameters = (ASTQueue *) ArenaCalloc(&state->arena, 1, sizeof(ASTQueue));
+	node->generic.arms = (ASTQueue *) ArenaCalloc(&state->arena, 1, sizeof(ASTQueue));
+	if (!ASTIsDeclarationStart(lex)) return ASTErrorNode(state, lex, "a return type");
+	node->generic.returnType = ASTParseType(state, lex);
+	if (!LexerExpect(lex, TOK_ID)) return ASTErrorNode(state, lex, "a name");
+	Token name = LexerNext(lex);
+	node->generic.name = ASTTokenIntern(state, lex, name);
+	ASTDeclare(state, node->generic.name, node, name);
+	if (!ASTExpect(state, lex, TOK_LESSERTHAN, "'<'")) return node;
+	if (!LexerExpect(lex, TOK_ID)) return ASTErrorNode(state, lex, "a type parameter");
+	node->generic.typeParameter = TypeNamed(&state->types, ASTTokenIntern(state, lex, LexerNext(lex)));
+	if (!ASTExpect(state, lex, TOK_GREATERTHAN, "'>'")) return node;
 
-	if (!TokenExpect(q1, TOK_CLOSECURLYBRACES)) {
-		fprintf(stderr, "Unexpected end of scope: %s\nA closing curly brace was expected.\n", TokenQueuePeek(q1).value);
-		exit(1);
-	}
-	
+	SymbolScopePush(&state->symbols);
+	ASTParseGenericBody(state, lex, node);
+	SymbolScopePop(&state->symbols);
 	return node;
 }
-ASTNode *ASTParseExpression(TokenQueue *q1, TokenQueue *q2) {
-	if (q1->length <= 2) {
-		fprintf(stderr, "Insufficient tokens in expression.\n");
-		exit(1);
+// One statement of a block, the caller handles the terminating semicolon
+static ASTNode *ASTParseStatement(CompilerState *state, Lexer *lex, bool *needsSemicolon) {
+	*needsSemicolon = true;
+	switch (LexerPeekType(lex, 0)) {
+		case TOK_RETURN:
+			return ASTParseReturn(state, lex);
+		case TOK_BREAK:
+			return ASTNodeCreate(state, AST_BREAK, LexerNext(lex));
+		case TOK_CONTINUE:
+			return ASTNodeCreate(state, AST_CONTINUE, LexerNext(lex));
+		case TOK_IMPORT:
+			return ASTParseImport(state, lex);
+		default:
+			break;
 	}
-
-	ASTNode *node = (ASTNode *) malloc(sizeof(ASTNode));
-	if (node == NULL) return NULL;
-
-	node->type = AST_EXPRESSION;
-	if (!TokenIsDataType(q1)) {
-		fprintf(stderr, "Unexpected token in expression: %s\nA type was expected.\n", TokenQueuePeek(q1).value);
-		exit(1);
+	if (ASTIsDeclarationStart(lex)) {
+		ASTNode *node = ASTParseExpression(state, lex);
+		// Function definitions end with their body
+		if (node->type == AST_EXPRESSION && node->expression.body && node->expression.body->type == AST_FUNCTION) *needsSemicolon = false;
+		return node;
 	}
-	node->expression.type = strdup(TokenQueuePeek(q1).value);
-
-	TokenQueuePush(q2, TokenQueuePop(q1));
-	if (!TokenExpect(q1, TOK_ID)) {
-		fprintf(stderr, "Unexpected token in expression: %s\nAn ID was expected.\n", TokenQueuePeek(q1).value);
-		exit(1);
+	*needsSemicolon = false;
+	switch (LexerPeekType(lex, 0)) {
+		case TOK_OPENCURLYBRACES:
+			return ASTParseScope(state, lex);
+		case TOK_IF:
+			return ASTParseIf(state, lex);
+		case TOK_WHILE:
+			return ASTParseWhile(state, lex);
+		case TOK_FOR:
+			return ASTParseFor(state, lex);
+		case TOK_GENERIC:
+			return ASTParseGeneric(state, lex);
+		case TOK_SEMICOLON:
+			LexerNext(lex);
+			return NULL;
+		default:
+			break;
+	}
+	*needsSemicolon = true;
+	return ASTParseValue(state, lex);
+}
+// Parses one statement into body, recovering at the statement boundary
+static void ASTParseStatementInto(CompilerState *state, Lexer *lex, ASTQueue *body) {
+	bool needsSemicolon;
+	ASTQueuePush(&state->arena, body, ASTParseStatement(state, lex, &needsSemicolon));
+	if (!state->panicMode && needsSemicolon) ASTExpect(state, lex, TOK_SEMICOLON, "a semicolon");
+	if (state->panicMode) ASTSynchronize(state, lex);
+}
+// Parses statements into body until a closing brace or the end of input
+static void ASTParseStatements(CompilerState *state, Lexer *lex, ASTQueue *body) {
+	while (!LexerExpect(lex, TOK_EOF) && !LexerExpect(lex, TOK_CLOSECURLYBRACES)) {
+		if (CompilerErrorLimitReached(state)) return;
+		ASTParseStatementInto(state, lex, body);
 	}
-	node->expression.name = strdup(TokenQueuePeek(q1).value);
+}
+
+// { statements } in the scope that is already open
+static ASTNode *ASTParseBlock(CompilerState *state, Lexer *lex) {
+	if (!LexerExpect(lex, TOK_OPENCURLYBRACES)) return ASTErrorNode(state, lex, "an opening curly brace");
 
-	TokenQueuePush(q2, TokenQueuePop(q1));
+	ASTNode *node = ASTNodeCreate(state, AST_SCOPE, LexerNext(lex));
+	node->scope.body = (ASTQueue *) ArenaCalloc(&state->arena, 1, sizeof(ASTQueue));
+	ASTParseStatements(state, lex, node->scope.body);
+	if (!CompilerErrorLimitReached(state)) ASTExpect(state, lex, TOK_CLOSECURLYBRACES, "a closing curly brace");
+	
 	return node;
 }
-ASTNode *ASTParseFunction(TokenQueue *q1, TokenQueue *q2) {
-	if (q1->length <= 1) {
-		fprintf(stderr, "Insufficient tokens in expression.\n");
-		exit(1);
-	}
+ASTNode *ASTParseScope(CompilerState *state, Lexer *lex) {
+	SymbolScopePush(&state->symbols);
+	ASTNode *node = ASTParseBlock(state, lex);
+	SymbolScopePop(&state->symbols);
+	return node;
+}
+// type name [= value], or type name(parameters) { body } for a function
+ASTNode *ASTParseExpression(CompilerState *state, Lexer *lex) {
+	if (!ASTIsDeclarationStart(lex)) return ASTErrorNode(state, lex, "a type");
 
-	ASTNode *node = (ASTNode *) malloc(sizeof(ASTNode));
-	if (node == NULL) return NULL;
+	ASTNode *node = ASTNodeCreate(state, AST_EXPRESSION, LexerPeek(lex, 0));
+	if (LexerExpect(lex, TOK_CONSTEXPR)) node->expression.isConstexpr = LexerNext(lex).type == TOK_CONSTEXPR;
+	else if (LexerExpect(lex, TOK_COMPILETIME)) node->expression.isCompiletime = LexerNext(lex).type == TOK_COMPILETIME;
+	node->expression.type = ASTParseType(state, lex);
 
-	node->type = AST_FUNCTION;
-	if (!TokenExpect(q1, TOK_OPENPARENTHESIS)) {
-		fprintf(stderr, "Unexpected token in expression: %s\nA type was expected.\n", TokenQueuePeek(q1).value);
-		exit(1);
-	}
-	node->expression.type = strdup(TokenQueuePeek(q1).value);
+	if (!LexerExpect(lex, TOK_ID)) return ASTErrorNode(state, lex, "a name");
+	Token name = LexerNext(lex);
+	node->expression.name = ASTTokenIntern(state, lex, name);
+	// Visible in its own initializer and, for a function, its body
+	ASTDeclare(state, node->expression.name, node, name);
 
+	if (LexerExpect(lex, TOK_OPENPARENTHESIS)) node->expression.body = ASTParseFunction(state, lex);
+	else if (LexerExpect(lex, TOK_ASSIGN)) {
+		LexerNext(lex);
+		node->expression.body = ASTParseValue(state, lex);
+	}
 	return node;
+}
+// (type name, ...) { body }, the part of a function definition after its name
+ASTNode *ASTParseFunction(CompilerState *state, Lexer *lex) {
+	if (!LexerExpect(lex, TOK_OPENPARENTHESIS)) return ASTErrorNode(state, lex, "an opening parenthesis");
 
+	ASTNode *node = ASTNodeCreate(state, AST_FUNCTION, LexerNext(lex));
+	node->function.parameters = (ASTQueue *) ArenaCalloc(&state->arena, 1, sizeof(ASTQueue));
+	// The parameters and the outermost block of the body share a scope, as in C
+	SymbolScopePush(&state->symbols);
+	while (!LexerExpect(lex, TOK_CLOSEPARENTHESIS)) {
+		ASTQueuePush(&state->arena, node->function.parameters, ASTParseExpression(state, lex));
+		if (state->panicMode || !LexerExpect(lex, TOK_COMMA)) break;
+		LexerNext(lex);
+	}
+	if (ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis")) node->function.body = ASTParseBlock(state, lex);
+	SymbolScopePop(&state->symbols);
+	return node;
 }
-ASTNode *ASTParseValue(TokenQueue *q1, TokenQueue *q2) {
-	if (q1->length == 0) {
-		fprintf(stderr, "Insufficient tokens in expression.\n");
-		exit(1);
+static const unsigned char infixPrecedence[TOK_ERROR + 1] = {
+	[TOK_ASSIGN] = PREC_ASSIGNMENT,
+	[TOK_PLUSASSIGN] = PREC_ASSIGNMENT,
+	[TOK_MINUSASSIGN] = PREC_ASSIGNMENT,
+	[TOK_STARASSIGN] = PREC_ASSIGNMENT,
+	[TOK_SLASHASSIGN] = PREC_ASSIGNMENT,
+	[TOK_PERCENTASSIGN] = PREC_ASSIGNMENT,
+	[TOK_BITANDASSIGN] = PREC_ASSIGNMENT,
+	[TOK_BITORASSIGN] = PREC_ASSIGNMENT,
+	[TOK_BITXORASSIGN] = PREC_ASSIGNMENT,
+	[TOK_LSHIFTASSIGN] = PREC_ASSIGNMENT,
+	[TOK_RSHIFTASSIGN] = PREC_ASSIGNMENT,
+	[TOK_QUESTION] = PREC_TERNARY,
+	[TOK_OR] = PREC_OR,
+	[TOK_AND] = PREC_AND,
+	[TOK_BITOR] = PREC_BITOR,
+	[TOK_BITXOR] = PREC_BITXOR,
+	[TOK_BITAND] = PREC_BITAND,
+	[TOK_EQUAL] = PREC_EQUALITY,
+	[TOK_NOTEQUAL] = PREC_EQUALITY,
+	[TOK_LESSERTHAN] = PREC_COMPARISON,
+	[TOK_GREATERTHAN] = PREC_COMPARISON,
+	[TOK_LESSEROREQUAL] = PREC_COMPARISON,
+	[TOK_GREATEROREQUAL] = PREC_COMPARISON,
+	[TOK_LSHIFT] = PREC_SHIFT,
+	[TOK_RSHIFT] = PREC_SHIFT,
+	[TOK_PLUS] = PREC_TERM,
+	[TOK_MINUS] = PREC_TERM,
+	[TOK_STAR] = PREC_FACTOR,
+	[TOK_SLASH] = PREC_FACTOR,
+	[TOK_PERCENT] = PREC_FACTOR,
+	[TOK_OPENPARENTHESIS] = PREC_POSTFIX,
+	[TOK_OPENBRACKET] = PREC_POSTFIX,
+	[TOK_DOT] = PREC_POSTFIX,
+	[TOK_ARROW] = PREC_POSTFIX,
+	[TOK_PLUSPLUS] = PREC_POSTFIX,
+	[TOK_MINUSMINUS] = PREC_POSTFIX
+};
+Precedence ASTInfixPrecedence(TokenType op) {
+	return op <= TOK_ERROR ? (Precedence) infixPrecedence[op] : PREC_NONE;
+}
+
+static char ASTDecodeChar(const char *text) {
+	// text points past the opening quote
+	if (text[0] != '\\') return text[0];
+	switch (text[1]) {
+		case 'n': return '\n';
+		case 't': return '\t';
+		case 'r': return '\r';
+		case '0': return '\0';
+		case 'a': return '\a';
+		case 'b': return '\b';
+		case 'f': return '\f';
+		case 'v': return '\v';
+		default: return text[1];
 	}
+}
+static ASTNode *ASTParsePrecedence(CompilerState *state, Lexer *lex, int minPrecedence);
 
-	ASTNode *node = (ASTNode *) malloc(sizeof(ASTNode));
-	if (node == NULL) return NULL;
+// The canonical type of a type name as written; the spelling is normalized
+// to single spaces first, e.g. "unsigned long *"
+const Type *ASTParseType(CompilerState *state, Lexer *lex) {
+	char name[256];
+	int length = 0;
+	while (ASTIsTypeStart(lex, 0) || (length == 0 && LexerExpect(lex, TOK_ID)) || (length && LexerExpect(lex, TOK_ID) && name[length - 1] != '*' && (LexerPeekType(lex, 1) == TOK_ID || LexerPeekType(lex, 1) == TOK_STAR)) || (length && LexerExpect(lex, TOK_STAR))) {
+		Token token = LexerNext(lex);
+		if (length + token.length + 2 >= (int) sizeof(name)) break;
+		if (length && !(token.type == TOK_STAR && name[length - 1] == '*')) name[length++] = ' ';
+		memcpy(name + length, LexerText(lex, token), token.length);
+		length += token.length;
+		// A tag name completes struct/union/enum
+		if ((token.type == TOK_STRUCT || token.type == TOK_UNION || token.type == TOK_ENUM) && LexerExpect(lex, TOK_ID)) {
+			Token tag = LexerNext(lex);
+			name[length++] = ' ';
+			memcpy(name + length, LexerText(lex, tag), tag.length);
+			length += tag.length;
+		}
+	}
+	if (length == 0) {
+		ASTUnexpected(state, lex, LexerPeek(lex, 0), "a type");
+		return NULL;
+	}
+	return TypeNamed(&state->types, InternString(&state->strings, name, length));
+}
+// Whether a token can start a value. Anything else is left in place for
+// ASTSynchronize, so a stray ';' or '}' still ends its statement or block.
+static bool ASTStartsValue(TokenType type) {
+	switch (type) {
+		case TOK_INTLIT:
+		case TOK_LONGLIT:
+		case TOK_LONGLONGLIT:
+		case TOK_UNSIGNEDLIT:
+		case TOK_UNSIGNEDLONGLIT:
+		case TOK_UNSIGNEDLONGLONGLIT:
+		case TOK_TRUE:
+		case TOK_FALSE:
+		case TOK_NULLPTR:
+		case TOK_FLOATLIT:
+		case TOK_DOUBLELIT:
+		case TOK_LONGDOUBLELIT:
+		case TOK_CHARLIT:
+		case TOK_STRINGLIT:
+		case TOK_ID:
+		case TOK_OPENPARENTHESIS:
+		case TOK_SIZEOF:
+		case TOK_MINUS:
+		case TOK_PLUS:
+		case TOK_NOT:
+		case TOK_BITNOT:
+		case TOK_PLUSPLUS:
+		case TOK_MINUSMINUS:
+		case TOK_STAR:
+		case TOK_BITAND:
+			return true;
+		default:
+			return false;
+	}
+}
+static ASTNode *ASTParsePrefix(CompilerState *state, Lexer *lex) {
+	if (!ASTStartsValue(LexerPeekType(lex, 0))) return ASTErrorNode(state, lex, "a value");
 
-	node->type = AST_INTLIT;
-	node->intLit = atoi(TokenQueuePeek(q1).value);
-	return node;
+	Token token = LexerNext(lex);
+	ASTNode *node;
+	switch (token.type) {
+		case TOK_INTLIT:
+		case TOK_LONGLIT:
+		case TOK_LONGLONGLIT:
+		case TOK_UNSIGNEDLIT:
+		case TOK_UNSIGNEDLONGLIT:
+		case TOK_UNSIGNEDLONGLONGLIT:
+			node = ASTNodeCreate(state, AST_INTLIT, token);
+			node->intLit = token.value.integer;
+			return node;
+		case TOK_TRUE:
+		case TOK_FALSE:
+		case TOK_NULLPTR:
+			node = ASTNodeCreate(state, AST_INTLIT, token);
+			node->intLit = token.type == TOK_TRUE;
+			return node;
+		case TOK_FLOATLIT:
+		case TOK_DOUBLELIT:
+		case TOK_LONGDOUBLELIT:
+			node = ASTNodeCreate(state, AST_FLOATLIT, token);
+			node->floatLit = token.value.real;
+			return node;
+		case TOK_CHARLIT:
+			node = ASTNodeCreate(state, AST_CHARLIT, token);
+			node->charLit = ASTDecodeChar(LexerText(lex, token) + 1);
+			return node;
+		case TOK_STRINGLIT:
+			node = ASTNodeCreate(state, AST_STRINGLIT, token);
+			node->stringLit = ASTTokenIntern(state, lex, token);
+			return node;
+		case TOK_ID:
+			node = ASTNodeCreate(state, AST_IDENTIFIER, token);
+			node->identifier = ASTTokenIntern(state, lex, token);
+			node->declaration = SymbolLookup(&state->symbols, node->identifier);
+			return node;
+		case TOK_OPENPARENTHESIS:
+			// (type) value is a cast, anything else is grouping
+			if (ASTIsTypeStart(lex, 0)) {
+				node = ASTNodeCreate(state, AST_CAST, token);
+				node->cast.type = ASTParseType(state, lex);
+				ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis");
+				node->cast.value = ASTParsePrecedence(state, lex, PREC_UNARY);
+				return node;
+			}
+			node = ASTParsePrecedence(state, lex, PREC_ASSIGNMENT);
+			ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis");
+			return node;
+		case TOK_SIZEOF:
+			node = ASTNodeCreate(state, AST_UNARYOP, token);
+			node->unaryOp.op = token.type;
+			if (LexerExpect(lex, TOK_OPENPARENTHESIS) && ASTIsTypeStart(lex, 1)) {
+				LexerNext(lex);
+				node->unaryOp.value = ASTNodeCreate(state, AST_TYPENAME, token);
+				node->unaryOp.value->cast.type = ASTParseType(state, lex);
+				ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis");
+				return node;
+			}
+			node->unaryOp.value = ASTParsePrecedence(state, lex, PREC_UNARY);
+			return node;
+		case TOK_MINUS:
+		case TOK_PLUS:
+		case TOK_NOT:
+		case TOK_BITNOT:
+		case TOK_PLUSPLUS:
+		case TOK_MINUSMINUS:
+		case TOK_STAR:
+		case TOK_BITAND:
+			node = ASTNodeCreate(state, AST_UNARYOP, token);
+			node->unaryOp.op = token.type;
+			node->unaryOp.value = ASTParsePrecedence(state, lex, PREC_UNARY);
+			return node;
+		default:
+			return ASTNodeCreate(state, AST_ERROR, token);
+	}
 }
-ASTNode *ASTParseReturn(TokenQueue *q1, TokenQueue *q2) {
-	if (q1->length == 0) {
-		fprintf(stderr, "Insufficient tokens in expression.\n");
-		exit(1);
+static ASTNode *ASTParsePostfix(CompilerState *state, Lexer *lex, ASTNode *left, Token op) {
+	ASTNode *node;
+	switch (op.type) {
+		case TOK_OPENPARENTHESIS:
+			node = ASTNodeCreate(state, AST_CALL, op);
+			node->call.callee = left;
+			node->call.arguments = (ASTQueue *) ArenaCalloc(&state->arena, 1, sizeof(ASTQueue));
+			while (!LexerExpect(lex, TOK_CLOSEPARENTHESIS)) {
+				ASTQueuePush(&state->arena, node->call.arguments, ASTParsePrecedence(state, lex, PREC_ASSIGNMENT));
+				if (state->panicMode || !LexerExpect(lex, TOK_COMMA)) break;
+				LexerNext(lex);
+			}
+			ASTExpect(state, lex, TOK_CLOSEPARENTHESIS, "a closing parenthesis");
+			return node;
+		case TOK_OPENBRACKET:
+			node = ASTNodeCreate(state, AST_BINARYOP, op);
+			node->binaryOp.op = op.type;
+			node->binaryOp.left = left;
+			node->binaryOp.right = ASTParsePrecedence(state, lex, PREC_ASSIGNMENT);
+			ASTExpect(state, lex, TOK_CLOSEBRACKET, "a closing bracket");
+			return node;
+		case TOK_DOT:
+		case TOK_ARROW:
+			node = ASTNodeCreate(state, AST_BINARYOP, op);
+			node->binaryOp.op = op.type;
+			node->binaryOp.left = left;
+			if (!LexerExpect(lex, TOK_ID)) node->binaryOp.right = ASTErrorNode(state, lex, "a member name");
+			else node->binaryOp.right = ASTParsePrefix(state, lex);
+			return node;
+		default:
+			node = ASTNodeCreate(state, AST_UNARYOP, op);
+			node->unaryOp.op = op.type;
+			node->unaryOp.value = left;
+			node->unaryOp.postfix = true;
+			return node;
 	}
+}
+// Precedence climbing: each operator is looked at once, no backtracking
+static ASTNode *ASTParsePrecedence(CompilerState *state, Lexer *lex, int minPrecedence) {
+	ASTNode *left = ASTParsePrefix(state, lex);
+	while (1) {
+		Token op = LexerPeek(lex, 0);
+		int precedence = infixPrecedence[op.type];
+		if (precedence == PREC_NONE || precedence < minPrecedence) break;
+		LexerNext(lex);
 
-	ASTNode *node = (ASTNode *) malloc(sizeof(ASTNode));
-	if (node == NULL) return NULL;
+		ASTNode *node;
+		switch (precedence) {
+			case PREC_POSTFIX:
+				left = ASTParsePostfix(state, lex, left, op);
+				break;
+			case PREC_TERNARY:
+				node = ASTNodeCreate(state, AST_TERNARYOP, op);
+				node->ternaryOp.condition = left;
+				node->ternaryOp.trueValue = ASTParsePrecedence(state, lex, PREC_ASSIGNMENT);
+				ASTExpect(state, lex, TOK_COLON, "a colon");
+				node->ternaryOp.falseValue = ASTParsePrecedence(state, lex, PREC_TERNARY);
+				left = node;
+				break;
+			default:
+				node = ASTNodeCreate(state, AST_BINARYOP, op);
+				node->binaryOp.op = op.type;
+				node->binaryOp.left = left;
+				// Assignments group to the right, everything else to the left
+				node->binaryOp.right = ASTParsePrecedence(state, lex, precedence == PREC_ASSIGNMENT ? precedence : precedence + 1);
+				left = node;
+				break;
+		}
+	}
+	return left;
+}
+ASTNode *ASTParseValue(CompilerState *state, Lexer *lex) {
+	return ASTParsePrecedence(state, lex, PREC_ASSIGNMENT);
+}
+// return [value], the semicolon is left to the enclosing block
+ASTNode *ASTParseReturn(CompilerState *state, Lexer *lex) {
+	if (!LexerExpect(lex, TOK_RETURN)) return ASTErrorNode(state, lex, "'return'");
 
+	ASTNode *node = ASTNodeCreate(state, AST_RETURN, LexerNext(lex));
+	if (!LexerExpect(lex, TOK_SEMICOLON)) node->returnStatement.expression = ASTParseValue(state, lex);
 	return node;
 }
-int ASTNodeFree(ASTNode **node) {
-	if (node == NULL) return 0;
-
-	NodeType type = (*node)->type;
-	switch (type) {
+const char *ASTOperatorText(TokenType op) {
+	switch (op) {
+		case TOK_ASSIGN: return "=";
+		case TOK_PLUSASSIGN: return "+=";
+		case TOK_MINUSASSIGN: return "-=";
+		case TOK_STARASSIGN: return "*=";
+		case TOK_SLASHASSIGN: return "/=";
+		case TOK_PERCENTASSIGN: return "%=";
+		case TOK_BITANDASSIGN: return "&=";
+		case TOK_BITORASSIGN: return "|=";
+		case TOK_BITXORASSIGN: return "^=";
+		case TOK_LSHIFTASSIGN: return "<<=";
+		case TOK_RSHIFTASSIGN: return ">>=";
+		case TOK_OR: return "||";
+		case TOK_AND: return "&&";
+		case TOK_BITOR: return "|";
+		case TOK_BITXOR: return "^";
+		case TOK_BITAND: return "&";
+		case TOK_EQUAL: return "==";
+		case TOK_NOTEQUAL: return "!=";
+		case TOK_LESSERTHAN: return "<";
+		case TOK_GREATERTHAN: return ">";
+		case TOK_LESSEROREQUAL: return "<=";
+		case TOK_GREATEROREQUAL: return ">=";
+		case TOK_LSHIFT: return "<<";
+		case TOK_RSHIFT: return ">>";
+		case TOK_PLUS: return "+";
+		case TOK_MINUS: return "-";
+		case TOK_STAR: return "*";
+		case TOK_SLASH: return "/";
+		case TOK_PERCENT: return "%";
+		case TOK_NOT: return "!";
+		case TOK_BITNOT: return "~";
+		case TOK_PLUSPLUS: return "++";
+		case TOK_MINUSMINUS: return "--";
+		case TOK_SIZEOF: return "sizeof";
+		case TOK_OPENBRACKET: return "[]";
+		case TOK_DOT: return ".";
+		case TOK_ARROW: return "->";
+		default: return "?";
+	}
+}
+static void ASTVisualizeNode(ASTNode *node, int depth) {
+	ASTNodeNode *item;
+	if (node == NULL) {
+		printf("%*s(null)\n", depth * 2, "");
+		return;
+	}
+	printf("%*s", depth * 2, "");
+	switch (node->type) {
 		case AST_EXPRESSION:
-			free((*node)->expression.type);
-			free((*node)->expression.name);
-			ASTNodeFree(&(*node)->expression.body);
-			free(*node);
-			*node = NULL;
+			printf("Declaration %s%s %s\n", node->expression.isConstexpr ? "constexpr " : node->expression.isCompiletime ? "compiletime " : "", node->expression.type ? node->expression.type->name : "?", node->expression.name);
+			if (node->expression.body) ASTVisualizeNode(node->expression.body, depth + 1);
 			break;
 		case AST_SCOPE:
+			printf("Scope\n");
+			if (node->scope.body) {
+				for (item = node->scope.body->first; item; item = item->prev) ASTVisualizeNode(item->node, depth + 1);
+			}
 			break;
 		case AST_RETURN:
-			ASTNodeFree(&(*node)->returnStatement.body);
-			free(*node);
-			*node = NULL;
+			printf("Return\n");
+			if (node->returnStatement.expression) ASTVisualizeNode(node->returnStatement.expression, depth + 1);
 			break;
 		case AST_FUNCTION:
+			printf("Function\n");
+			for (item = node->function.parameters->first; item; item = item->prev) ASTVisualizeNode(item->node, depth + 1);
+			if (node->function.body) ASTVisualizeNode(node->function.body, depth + 1);
 			break;
 		case AST_INTLIT:
+			printf("Int %llu\n", node->intLit);
+			break;
 		case AST_CHARLIT:
+			printf("Char %d\n", node->charLit);
+			break;
 		case AST_FLOATLIT:
-			free(*node);
-			*node = NULL;
+			printf("Float %g\n", node->floatLit);
+			break;
+		case AST_STRINGLIT:
+			printf("String %s\n", node->stringLit);
 			break;
 		case AST_TERNARYOP:
-			ASTNodeFree(&(*node)->ternaryOp.condition);
-			ASTNodeFree(&(*node)->ternaryOp.trueValue);
-			ASTNodeFree(&(*node)->ternaryOp.falseValue);
-			free(*node);
-			*node = NULL;
+			printf("Ternary\n");
+			ASTVisualizeNode(node->ternaryOp.condition, depth + 1);
+			ASTVisualizeNode(node->ternaryOp.trueValue, depth + 1);
+			ASTVisualizeNode(node->ternaryOp.falseValue, depth + 1);
 			break;
 		case AST_BINARYOP:
-			ASTNodeFree(&(*node)->binaryOp.left);
-			ASTNodeFree(&(*node)->binaryOp.right);
-			ASTNodeFree(&(*node)->binaryOp.op);
-			free(*node);
-			*node = NULL;
+			printf("Binary %s\n", ASTOperatorText(node->binaryOp.op));
+			ASTVisualizeNode(node->binaryOp.left, depth + 1);
+			ASTVisualizeNode(node->binaryOp.right, depth + 1);
 			break;
 		case AST_UNARYOP:
-			ASTNodeFree(&(*node)->unaryOp.value);
-			ASTNodeFree(&(*node)->unaryOp.op);
-			free(*node);
-			*node = NULL;
+			printf("Unary %s%s\n", ASTOperatorText(node->unaryOp.op), node->unaryOp.postfix ? " postfix" : "");
+			ASTVisualizeNode(node->unaryOp.value, depth + 1);
 			break;
-		case AST_ERROR:
+		case AST_IDENTIFIER:
+			printf("Identifier %s\n", node->identifier);
 			break;
-		default:
-			fprintf(stderr, "Insufficient tokens in expression.\n");
-			exit(1);
+		case AST_CALL:
+			printf("Call\n");
+			ASTVisualizeNode(node->call.callee, depth + 1);
+			for (item = node->call.arguments->first; item; item = item->prev) ASTVisualizeNode(item->node, depth + 1);
+			break;
+		case AST_CAST:
+			printf("Cast %s\n", node->cast.type ? node->cast.type->name : "?");
+			ASTVisualizeNode(node->cast.value, depth + 1);
+			break;
+		case AST_TYPENAME:
+			printf("Type %s\n", node->cast.type ? node->cast.type->name : "?");
+			break;
+		case AST_IMPORT:
+			printf("Import %s\n", node->import);
+			if (node->exports) {
+				for (item = node->exports->first; item; item = item->prev) ASTVisualizeNode(item->node, depth + 1);
+			}
+			break;
+		case AST_IF:
+			printf("If\n");
+			ASTVisualizeNode(node->ifStatement.condition, depth + 1);
+			ASTVisualizeNode(node->ifStatement.then, depth + 1);
+			if (node->ifStatement.otherwise) ASTVisualizeNode(node->ifStatement.otherwise, depth + 1);
+			break;
+		case AST_WHILE:
+		case AST_FOR:
+			printf(node->type == AST_WHILE ? "While\n" : "For\n");
+			if (node->type == AST_FOR) ASTVisualizeNode(node->loop.init, depth + 1);
+			ASTVisualizeNode(node->loop.condition, depth + 1);
+			if (node->type == AST_FOR) ASTVisualizeNode(node->loop.step, depth + 1);
+			ASTVisualizeNode(node->loop.body, depth + 1);
+			break;
+		case AST_BREAK:
+			printf("Break\n");
+			break;
+		case AST_CONTINUE:
+			printf("Continue\n");
+			break;
+		case AST_GENERIC:
+			printf("Generic %s %s<%s>\n", node->generic.returnType ? node->generic.returnType->name : "?", node->generic.name, node->generic.typeParameter ? node->generic.typeParameter->name : "?");
+			for (item = node->generic.parameters->first; item; item = item->prev) ASTVisualizeNode(item->node, depth + 1);
+			for (item = node->generic.arms->first; item; item = item->prev) ASTVisualizeNode(item->node, depth + 1);
+			break;
+		case AST_GENERICARM:
+			printf("Arm %s\n", node->arm.type ? node->arm.type->name : "default");
+			for (item = node->arm.body->first; item; item = item->prev) ASTVisualizeNode(item->node, depth + 1);
+			break;
+		case AST_CONSTANT: {
+			Buffer text;
+			BufferInit(&text, 64);
+			if (!EvalFormat(*node->constant, &text)) BufferAppendString(&text, "?");
+			printf("Constant %s %s\n", node->constant->type->name, text.data);
+			BufferFree(&text);
+			break;
+		}
+		case AST_ERROR:
+			printf("Error\n");
 			break;
 	}
 }
 void ASTVisualize(ASTNode *node) {
-
+	ASTVisualizeNode(node, 0);
 }
-void ASTParseNode(ASTNode **node, TokenQueue *q1, TokenQueue *q2) {
-	if (*node == NULL || q1 == NULL || q2 == NULL) {
-		fprintf(stderr, "Invalid parameters for ASTParseNode.\n");
-		exit(1);
-	}
-	TokenNode *current;
-	int i;
-	int length = q1->length;
-	for (i = 0, current = q1->first; i < length; i++, current = current->prev) {
-		if (current == NULL) continue;
-		switch (current->token.type) {
-			case TOK_ID:
-				node->expression.name = strdup(current->token.value);
-				break;
-			case TOK_INTLIT:
-				node->intLit = atoi(current->token.value);
-				break;
-			case TOK_FLOATLIT:
-				node->floatLit = atof(current->token.value);
-				break;
-			case TOK_STRINGLIT:
-				node->stringLit = strdup(current->token.value);
-				break;
-			case TOK_CHARLIT:
-				node->charLit = current->token.value[0];
-				break;
-			case TOK_RETURN:
-				*node = ASTParseReturn(q1, q2);
-				break;
-			case TOK_OPENCURLYBRACES:
-				*node = ASTParseScope(q1, q2);
-				break;
-			default:
-				break;
+// Parses the whole input into *node, a scope of the top-level statements.
+// Errors are reported and recovered from, check state->hadError afterwards.
+void ASTParseNode(ASTNode **node, CompilerState *state, Lexer *lex) {
+	*node = ASTNodeCreate(state, AST_SCOPE, LexerPeek(lex, 0));
+	(*node)->scope.body = (ASTQueue *) ArenaCalloc(&state->arena, 1, sizeof(ASTQueue));
+	while (!LexerExpect(lex, TOK_EOF) && !CompilerErrorLimitReached(state)) {
+		ASTParseStatements(state, lex, (*node)->scope.body);
+		// A '}' without its '{'
+		if (LexerExpect(lex, TOK_CLOSECURLYBRACES)) {
+			ASTUnexpected(state, lex, LexerNext(lex), "a statement");
+			ExitPanicMode(state);
 		}
 	}
 }
-int ASTQueuePush(ASTQueue *q, ASTNode *node) {
-	ASTNodeNode *temp = (ASTNodeNode *) malloc(sizeof(ASTNodeNode));
+int ASTQueuePush(Arena *arena, ASTQueue *q, ASTNode *node) {
 	if (node == NULL) return 0;
+	ASTNodeNode *temp = (ASTNodeNode *) ArenaAlloc(arena, sizeof(ASTNodeNode));
 
 	temp->node = node;
 	temp->prev = NULL;
@@ -232,37 +773,16 @@ int ASTQueuePush(ASTQueue *q, ASTNode *node) {
 }
 ASTNode *ASTQueuePop(ASTQueue *q) {
 	ASTNodeNode *temp;
-	ASTNode *node = NULL;
 	if (q->length == 0) return NULL;
 	
 	temp = q->first;
 	q->first = q->first->prev;
-	temp->prev = NULL;
 	q->length--;
-	
-	node = temp->node;
-	free(temp);
 
-	return node;
+	return temp->node;
 }
-int ASTQueueFree(ASTQueue *q) {
-	ASTNodeNode *node;
-	ASTNode *astNode;
-	if (q->length == 0) return 0;
-
-	int i;
-	int goal = q->length;
-	q->last = NULL;
-	for (i = 0; i < goal; i++) {
-		node = q->first;
-		q->first = node->prev;
-		astNode = node->node;
-		node->prev = NULL;
-		node->node = NULL;
-		ASTNodeFree(&astNode);
-		free(node);
-	}
+ASTNode *ASTQueuePeek(ASTQueue *q) {
+	if (q->length == 0) return NULL;
 
-	q->length = 0;
-	return 1;
-}
\ No newline at end of file
+	return q->first->node;
+}
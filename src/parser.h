@@ -6,6 +6,7 @@
 typedef struct ASTNode ASTNode;
 typedef struct ASTNodeNode ASTNodeNode;
 typedef struct ASTQueue ASTQueue;
+typedef struct EvalValue EvalValue;
 
 typedef enum NodeType{
 	AST_EXPRESSION = 0,
@@ -19,34 +20,54 @@ typedef enum NodeType{
 	AST_TERNARYOP,
 	AST_BINARYOP,
 	AST_UNARYOP,
+	AST_IDENTIFIER,
+	AST_CALL,
+	AST_CAST,
+	AST_TYPENAME,
+	AST_IMPORT,
+	AST_IF,
+	AST_WHILE,
+	AST_FOR,
+	AST_BREAK,
+	AST_CONTINUE,
+	AST_GENERIC,
+	AST_GENERICARM,
+	AST_CONSTANT,
 	AST_ERROR
 } NodeType;
 struct ASTNode{
 	NodeType type;
+	Token token;	// Token the node was built from, for diagnostics
 	union {
 		// AST_EXPRESSION
 		struct {
-			char *type;
-			char *name;
+			const Type *type;
+			const char *name;	// Interned
 			ASTNode *body;
+			bool isConstexpr;	// Evaluated when transpiling, still emitted
+			bool isCompiletime;	// Evaluated when transpiling, only the result is emitted
 		} expression;
 		// AST_SCOPE
 		struct {
 			ASTQueue *body;
 		} scope;
-		// AST_FUNCTION
+		// AST_FUNCTION; parameters are AST_EXPRESSION declarations
+		struct {
+			ASTQueue *parameters;
+			ASTNode *body;
+		} function;
 		// AST_RETURN
 		struct {
 			ASTNode *expression;
 		} returnStatement;
-		// AST_INTLIT; that's it, an int
-		int intLit;
+		// AST_INTLIT; the bits of the value, its C type follows from the token
+		unsigned long long intLit;
 		// AST_CHARLIT; that's it, an char
 		char charLit;
-		// AST_FLOATLIT; that's it, an float
-		float floatLit;
-		// AST_STRINGLIT; I'm gonna
-		char *stringLit;
+		// AST_FLOATLIT; the value, rounded to float for TOK_FLOATLIT
+		double floatLit;
+		// AST_STRINGLIT; I'm gonna, interned
+		const char *stringLit;
 		// AST_TERNARYOP; condition ? true : false; ej: 2 > 3 ? 4 : 5
 		struct {
 			ASTNode *condition;
@@ -54,18 +75,95 @@ struct ASTNode{
 			ASTNode *falseValue;
 		} ternaryOp;
 		// AST_BINARYOP; left op right; ej: 2 - 3; 'a' + 'b'; 3 & 10
+		// also a[i] (op '['), s.x and p->x (op '.' and '->'), and assignments
 		struct {
 			ASTNode *left;
 			ASTNode *right;
-			ASTNode *op;
+			TokenType op;
 		} binaryOp;
-		// AST_UNARYOP; op value; ej: -2; !true; ~0xFF
+		// AST_UNARYOP; op value; ej: -2; !true; ~0xFF; i++ is postfix
 		struct unaryOp {
 			ASTNode *value;
-			ASTNode *op;
+			TokenType op;
+			bool postfix;
 		} unaryOp;
+		// AST_IDENTIFIER; interned name, and the local or earlier file scope
+		// declaration it refers to, NULL when none was visible while parsing
+		struct {
+			const char *identifier;
+			ASTNode *declaration;
+		};
+		// AST_CALL; callee(arguments...)
+		struct {
+			ASTNode *callee;
+			ASTQueue *arguments;
+		} call;
+		// AST_CAST; (type) value
+		// AST_TYPENAME; a bare type as in sizeof(int), value is NULL
+		struct {
+			const Type *type;
+			ASTNode *value;
+		} cast;
+		// AST_IMPORT; import "path"; path is interned, without the quotes.
+		// exports holds the declarations of an imported Czy module, NULL
+		// for a C header
+		struct {
+			const char *import;
+			ASTQueue *exports;
+		};
+		// AST_IF; otherwise is NULL without an else
+		struct {
+			ASTNode *condition;
+			ASTNode *then;
+			ASTNode *otherwise;
+		} ifStatement;
+		// AST_WHILE uses condition and body, AST_FOR all four; any may be NULL
+		struct {
+			ASTNode *init;
+			ASTNode *condition;
+			ASTNode *step;
+			ASTNode *body;
+		} loop;
+		// AST_GENERIC; generic returnType name<typeParameter>(parameters) { arms }
+		struct {
+			const Type *returnType;		// May be the type parameter
+			const char *name;		// Interned
+			const Type *typeParameter;	// A TYPE_NAME, substituted by each instance
+			ASTQueue *parameters;
+			ASTQueue *arms;
+		} generic;
+		// AST_CONSTANT; a value computed by the compiler, see eval.h
+		const EvalValue *constant;
+		// AST_GENERICARM; type: statements..., type is NULL for default
+		struct {
+			const Type *type;
+			ASTQueue *body;
+		} arm;
 	};
 };
+// Binding power of each operator when it follows an operand. Prefix
+// operators bind at PREC_UNARY, postfix ones at PREC_POSTFIX.
+typedef enum Precedence {
+	PREC_NONE = 0,
+	PREC_ASSIGNMENT,	// = += -= *= /= %= &= |= ^= <<= >>=, right associative
+	PREC_TERNARY,		// ?:, right associative
+	PREC_OR,		// ||
+	PREC_AND,		// &&
+	PREC_BITOR,		// |
+	PREC_BITXOR,		// ^
+	PREC_BITAND,		// &
+	PREC_EQUALITY,		// == !=
+	PREC_COMPARISON,	// < > <= >=
+	PREC_SHIFT,		// << >>
+	PREC_TERM,		// + -
+	PREC_FACTOR,		// * / %
+	PREC_UNARY,		// - + ! ~ ++ -- * & sizeof
+	PREC_POSTFIX,		// () [] . -> ++ --
+	PREC_PRIMARY		// Literals and names
+} Precedence;
+
+// Nodes and list cells are allocated from the CompilerState arena and are
+// released together with it, there is no per-node free
 struct ASTNodeNode {
 	ASTNode *node;
 	ASTNodeNode *prev;
@@ -76,17 +174,18 @@ struct ASTQueue {
 	int length;
 };
 
-ASTNode *ASTParseScope(TokenQueue *q1, TokenQueue *q2);
-ASTNode *ASTParseExpression(TokenQueue *q1, TokenQueue *q2);
-ASTNode *ASTParseFunction(TokenQueue *q1, TokenQueue *q2);
-ASTNode *ASTParseValue(TokenQueue *q1, TokenQueue *q2);
-ASTNode *ASTParseReturn(TokenQueue *q1, TokenQueue *q2);
-int ASTNodeFree(ASTNode **node);
+ASTNode *ASTParseScope(CompilerState *state, Lexer *lex);
+ASTNode *ASTParseExpression(CompilerState *state, Lexer *lex);
+ASTNode *ASTParseFunction(CompilerState *state, Lexer *lex);
+ASTNode *ASTParseValue(CompilerState *state, Lexer *lex);
+const Type *ASTParseType(CompilerState *state, Lexer *lex);
+ASTNode *ASTParseReturn(CompilerState *state, Lexer *lex);
 void ASTVisualize(ASTNode *node);
-void ASTParseNode(ASTNode *node, TokenQueue *q1, TokenQueue *q2);
-int ASTQueuePush(ASTQueue *q, ASTNode *node);
+const char *ASTOperatorText(TokenType op);
+Precedence ASTInfixPrecedence(TokenType op);
+void ASTParseNode(ASTNode **node, CompilerState *state, Lexer *lex);
+int ASTQueuePush(Arena *arena, ASTQueue *q, ASTNode *node);
 ASTNode *ASTQueuePop(ASTQueue *q);
 ASTNode *ASTQueuePeek(ASTQueue *q);
-int ASTQueueFree(ASTQueue *q);
 
 #endif
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+// The pool and deque of the worker running on this thread, if any
+static __thread ThreadPool *poolCurrent;
+static __thread int poolWorker;
+
+static bool PoolDequeInit(PoolDeque *deque) {
+	deque->capacity = 64;
+	deque->head = 0;
+	deque->count = 0;
+	deque->items = (struct PoolItem *) malloc(deque->capacity * sizeof(struct PoolItem));
+	if (deque->items == NULL) return false;
+	pthread_mutex_init(&deque->lock, NULL);
+	return true;
+}
+static bool PoolDequePush(PoolDeque *deque, struct PoolItem item) {
+	pthread_mutex_lock(&deque->lock);
+	if (deque->count == deque->capacity) {
+		int capacity = deque->capacity * 2;
+		struct PoolItem *items = (struct PoolItem *) malloc(capacity * sizeof(struct PoolItem));
+		if (items == NULL) {
+			pthread_mutex_unlock(&deque->lock);
+			return false;
+		}
+		int i;
+		for (i = 0; i < deque->count; i++) items[i] = deque->items[(deque->head + i) % deque->capacity];
+		free(deque->items);
+		deque->items = items;
+		deque->head = 0;
+		deque->capacity = capacity;
+	}
+	deque->items[(deque->head + deque->count) % deque->capacity] = item;
+	deque->count++;
+	pthread_mutex_unlock(&deque->lock);
+	return true;
+}
+// The owner takes from the tail, thieves from the head
+static bool PoolDequeTake(PoolDeque *deque, bool steal, struct PoolItem *item) {
+	pthread_mutex_lock(&deque->lock);
+	bool found = deque->count > 0;
+	if (found && steal) {
+		*item = deque->items[deque->head];
+		deque->head = (deque->head + 1) % deque->capacity;
+	}
+	else if (found) *item = deque->items[(deque->head + deque->count - 1) % deque->capacity];
+	if (found) deque->count--;
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+static void PoolDequeFree(PoolDeque *deque) {
+	pthread_mutex_destroy(&deque->lock);
+	free(deque->items);
+	deque->items = NULL;
+}
+// Own deque first, then the others starting with the next one
+static bool PoolFind(ThreadPool *pool, int self, struct PoolItem *item) {
+	int i;
+	if (PoolDequeTake(&pool->deques[self], false, item)) return true;
+	for (i = 1; i < pool->threadCount; i++) {
+		if (PoolDequeTake(&pool->deques[(self + i) % pool->threadCount], true, item)) {
+			pthread_mutex_lock(&pool->lock);
+			pool->steals++;
+			pthread_mutex_unlock(&pool->lock);
+			return true;
+		}
+	}
+	return false;
+}
+
+typedef struct {
+	ThreadPool *pool;
+	int index;
+} PoolWorkerStart;
+
+static void *PoolWorkerRun(void *argument) {
+	PoolWorkerStart start = *(PoolWorkerStart *) argument;
+	ThreadPool *pool = start.pool;
+	struct PoolItem item;
+	free(argument);
+	poolCurrent = pool;
+	poolWorker = start.index;
+	while (1) {
+		if (PoolFind(pool, start.index, &item)) {
+			pthread_mutex_lock(&pool->lock);
+			pool->queued--;
+			pthread_mutex_unlock(&pool->lock);
+
+			item.task(item.argument);
+
+			pthread_mutex_lock(&pool->lock);
+			if (--pool->pending == 0) pthread_cond_broadcast(&pool->idle);
+			pthread_mutex_unlock(&pool->lock);
+			continue;
+		}
+		// queued only drops once a task is taken, so work pushed after the
+		// search above keeps this worker awake
+		pthread_mutex_lock(&pool->lock);
+		while (pool->queued == 0 && !pool->stopping) pthread_cond_wait(&pool->hasWork, &pool->lock);
+		bool stop = pool->queued == 0 && pool->stopping;
+		pthread_mutex_unlock(&pool->lock);
+		if (stop) break;
+	}
+	return NULL;
+}
+
+// Lets the workers finish what is queued, joins the first running of them
+// and frees everything
+static void PoolShutdown(ThreadPool *pool, int running) {
+	int i;
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->hasWork);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < running; i++) pthread_join(pool->threads[i], NULL);
+	for (i = 0; i < pool->threadCount; i++) PoolDequeFree(&pool->deques[i]);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->hasWork);
+	pthread_cond_destroy(&pool->idle);
+	free(pool->threads);
+	free(pool->deques);
+	pool->threads = NULL;
+	pool->deques = NULL;
+	pool->threadCount = 0;
+}
+
+bool PoolInit(ThreadPool *pool, int threads) {
+	int i;
+	if (threads < 1) threads = 1;
+	pool->threads = (pthread_t *) malloc(threads * sizeof(pthread_t));
+	pool->deques = (PoolDeque *) calloc(threads, sizeof(PoolDeque));
+	if (pool->threads == NULL || pool->deques == NULL) {
+		free(pool->threads);
+		free(pool->deques);
+		return false;
+	}
+	for (i = 0; i < threads; i++) {
+		if (!PoolDequeInit(&pool->deques[i])) {
+			while (i--) PoolDequeFree(&pool->deques[i]);
+			free(pool->threads);
+			free(pool->deques);
+			return false;
+		}
+	}
+	pool->threadCount = 0;
+	pool->queued = 0;
+	pool->pending = 0;
+	pool->next = 0;
+	pool->stopping = false;
+	pool->steals = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->hasWork, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+
+	// Workers scan every deque, so the count is fixed before any of them starts
+	int started = 0;
+	pool->threadCount = threads;
+	for (i = 0; i < threads; i++) {
+		PoolWorkerStart *start = (PoolWorkerStart *) malloc(sizeof(PoolWorkerStart));
+		if (start == NULL) break;
+		*start = (PoolWorkerStart) { pool, i };
+		if (pthread_create(&pool->threads[i], NULL, PoolWorkerRun, start) != 0) {
+			free(start);
+			break;
+		}
+		started++;
+	}
+	if (started < threads) {
+		PoolShutdown(pool, started);
+		return false;
+	}
+	return true;
+}
+// The task is counted before it is pushed, so a worker that takes it at
+// once cannot finish it before it was counted and let PoolWait return early
+bool PoolSubmit(ThreadPool *pool, PoolTask task, void *argument) {
+	int deque;
+	pthread_mutex_lock(&pool->lock);
+	deque = poolCurrent == pool ? poolWorker : (int) (pool->next++ % pool->threadCount);
+	pool->queued++;
+	pool->pending++;
+	bool pushed = PoolDequePush(&pool->deques[deque], (struct PoolItem) { task, argument });
+	if (pushed) pthread_cond_signal(&pool->hasWork);
+	else {
+		pool->queued--;
+		if (--pool->pending == 0) pthread_cond_broadcast(&pool->idle);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return pushed;
+}
+// Blocks until every submitted task has finished
+void PoolWait(ThreadPool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending > 0) pthread_cond_wait(&pool->idle, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+void PoolDestroy(ThreadPool *pool) {
+	PoolShutdown(pool, pool->threadCount);
+}
+int PoolDefaultThreads(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int) count : 1;
+}
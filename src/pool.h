@@ -0,0 +1,48 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct ThreadPool ThreadPool;
+typedef struct PoolDeque PoolDeque;
+typedef void (*PoolTask)(void *argument);
+
+// Tasks waiting on one worker. The worker takes the newest from the tail,
+// so a task it submits runs while its data is still in cache; idle workers
+// steal the oldest from the head.
+struct PoolDeque {
+	pthread_mutex_t lock;
+	struct PoolItem {
+		PoolTask task;
+		void *argument;
+	} *items;
+	int head;
+	int count;
+	int capacity;
+};
+// Fixed set of worker threads with a deque each. Tasks submitted from
+// outside are dealt round-robin, tasks a worker submits go on its own deque,
+// and a worker whose deque is empty steals from the others before sleeping.
+struct ThreadPool {
+	pthread_t *threads;
+	int threadCount;
+	PoolDeque *deques;	// One per worker
+	pthread_mutex_t lock;	// Guards the counts below and sleeping, taken before a deque's
+	pthread_cond_t hasWork;
+	pthread_cond_t idle;
+	int queued;		// Tasks in some deque
+	int pending;		// Tasks submitted and not finished yet
+	unsigned int next;	// Deque the next outside submission goes to
+	bool stopping;
+	// Statistics
+	long steals;
+};
+
+bool PoolInit(ThreadPool *pool, int threads);
+bool PoolSubmit(ThreadPool *pool, PoolTask task, void *argument);
+void PoolWait(ThreadPool *pool);
+void PoolDestroy(ThreadPool *pool);
+int PoolDefaultThreads(void);
+
+#endif
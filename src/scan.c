@@ -0,0 +1,268 @@
+#include <stdint.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// Newlines move the position to column 1 of the next line, everything else
+// advances the column by one byte
+static inline void ScanAdvance(const char *from, const char *to, const char *lineStart, int lines, int *line, int *column) {
+	if (lines) {
+		*line += lines;
+		*column = 1 + (int) (to - lineStart);
+	}
+	else *column += (int) (to - from);
+}
+
+static const char *ScanWhitespaceScalar(const char *p, int *line, int *column) {
+	const char *start = p;
+	const char *lineStart = NULL;
+	int lines = 0;
+	while (ScanIsSpace(*p)) {
+		if (*p == '\n') {
+			lines++;
+			lineStart = p + 1;
+		}
+		p++;
+	}
+	ScanAdvance(start, p, lineStart, lines, line, column);
+	return p;
+}
+static const char *ScanLineEndScalar(const char *p, int *column) {
+	const char *start = p;
+	while (*p != '\n' && *p != '\0') p++;
+	*column += (int) (p - start);
+	return p;
+}
+static const char *ScanBlockCommentEndScalar(const char *p, int *line, int *column) {
+	const char *start = p;
+	const char *lineStart = NULL;
+	int lines = 0;
+	while (*p != '\0' && !(p[0] == '*' && p[1] == '/')) {
+		if (*p == '\n') {
+			lines++;
+			lineStart = p + 1;
+		}
+		p++;
+	}
+	ScanAdvance(start, p, lineStart, lines, line, column);
+	return p;
+}
+
+#ifdef SCAN_X86
+// Newlines in the masked part of a block before the stopping index
+static inline void ScanCountLines(const char *block, unsigned int newlines, int *lines, const char **lineStart) {
+	if (newlines == 0) return;
+	*lines += __builtin_popcount(newlines);
+	*lineStart = block + (31 - __builtin_clz(newlines)) + 1;
+}
+// Bits below index, 32 bits wide
+static inline unsigned int ScanBelow(int index) {
+	return index >= 32 ? ~0u : (1u << index) - 1;
+}
+
+static inline __m128i ScanSpaceMask128(__m128i v) {
+	// ' ' or '\t'..'\r', the latter as one unsigned range check
+	__m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+	__m128i range = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+	return _mm_or_si128(range, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+static const char *ScanWhitespaceSSE2(const char *p, int *line, int *column) {
+	const char *block = (const char *) ((uintptr_t) p & ~(uintptr_t) 15);
+	unsigned int valid = 0xFFFFu << (p - block);
+	const char *lineStart = NULL;
+	int lines = 0;
+	while (1) {
+		__m128i v = _mm_load_si128((const __m128i *) block);
+		unsigned int space = (unsigned int) _mm_movemask_epi8(ScanSpaceMask128(v));
+		unsigned int newlines = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))) & valid;
+		unsigned int stop = ~space & valid & 0xFFFFu;
+		if (stop) {
+			int index = __builtin_ctz(stop);
+			ScanCountLines(block, newlines & ScanBelow(index), &lines, &lineStart);
+			ScanAdvance(p, block + index, lineStart, lines, line, column);
+			return block + index;
+		}
+		ScanCountLines(block, newlines, &lines, &lineStart);
+		block += 16;
+		valid = 0xFFFFu;
+	}
+}
+static const char *ScanLineEndSSE2(const char *p, int *column) {
+	const char *block = (const char *) ((uintptr_t) p & ~(uintptr_t) 15);
+	unsigned int valid = 0xFFFFu << (p - block);
+	while (1) {
+		__m128i v = _mm_load_si128((const __m128i *) block);
+		__m128i end = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		unsigned int stop = (unsigned int) _mm_movemask_epi8(end) & valid;
+		if (stop) {
+			const char *found = block + __builtin_ctz(stop);
+			*column += (int) (found - p);
+			return found;
+		}
+		block += 16;
+		valid = 0xFFFFu;
+	}
+}
+static const char *ScanBlockCommentEndSSE2(const char *p, int *line, int *column) {
+	const char *block = (const char *) ((uintptr_t) p & ~(uintptr_t) 15);
+	unsigned int valid = 0xFFFFu << (p - block);
+	const char *lineStart = NULL;
+	int lines = 0;
+	while (1) {
+		__m128i v = _mm_load_si128((const __m128i *) block);
+		unsigned int nul = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		unsigned int star = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+		unsigned int newlines = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))) & valid;
+		unsigned int stop = (nul | star) & valid;
+		// Stars that aren't followed by '/' are dropped one at a time; the byte
+		// after a star is never past the terminator, so reading it is safe
+		while (stop) {
+			int index = __builtin_ctz(stop);
+			if ((nul >> index) & 1 || block[index + 1] == '/') {
+				ScanCountLines(block, newlines & ScanBelow(index), &lines, &lineStart);
+				ScanAdvance(p, block + index, lineStart, lines, line, column);
+				return block + index;
+			}
+			stop &= stop - 1;
+		}
+		ScanCountLines(block, newlines, &lines, &lineStart);
+		block += 16;
+		valid = 0xFFFFu;
+	}
+}
+
+__attribute__((target("avx2")))
+static inline __m256i ScanSpaceMask256(__m256i v) {
+	__m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+	__m256i range = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+	return _mm256_or_si256(range, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+__attribute__((target("avx2")))
+static const char *ScanWhitespaceAVX2(const char *p, int *line, int *column) {
+	const char *block = (const char *) ((uintptr_t) p & ~(uintptr_t) 31);
+	unsigned int valid = ~0u << (p - block);
+	const char *lineStart = NULL;
+	int lines = 0;
+	while (1) {
+		__m256i v = _mm256_load_si256((const __m256i *) block);
+		unsigned int space = (unsigned int) _mm256_movemask_epi8(ScanSpaceMask256(v));
+		unsigned int newlines = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))) & valid;
+		unsigned int stop = ~space & valid;
+		if (stop) {
+			int index = __builtin_ctz(stop);
+			ScanCountLines(block, newlines & ScanBelow(index), &lines, &lineStart);
+			ScanAdvance(p, block + index, lineStart, lines, line, column);
+			return block + index;
+		}
+		ScanCountLines(block, newlines, &lines, &lineStart);
+		block += 32;
+		valid = ~0u;
+	}
+}
+__attribute__((target("avx2")))
+static const char *ScanLineEndAVX2(const char *p, int *column) {
+	const char *block = (const char *) ((uintptr_t) p & ~(uintptr_t) 31);
+	unsigned int valid = ~0u << (p - block);
+	while (1) {
+		__m256i v = _mm256_load_si256((const __m256i *) block);
+		__m256i end = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+		unsigned int stop = (unsigned int) _mm256_movemask_epi8(end) & valid;
+		if (stop) {
+			const char *found = block + __builtin_ctz(stop);
+			*column += (int) (found - p);
+			return found;
+		}
+		block += 32;
+		valid = ~0u;
+	}
+}
+__attribute__((target("avx2")))
+static const char *ScanBlockCommentEndAVX2(const char *p, int *line, int *column) {
+	const char *block = (const char *) ((uintptr_t) p & ~(uintptr_t) 31);
+	unsigned int valid = ~0u << (p - block);
+	const char *lineStart = NULL;
+	int lines = 0;
+	while (1) {
+		__m256i v = _mm256_load_si256((const __m256i *) block);
+		unsigned int nul = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+		unsigned int star = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')));
+		unsigned int newlines = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))) & valid;
+		unsigned int stop = (nul | star) & valid;
+		while (stop) {
+			int index = __builtin_ctz(stop);
+			if ((nul >> index) & 1 || block[index + 1] == '/') {
+				ScanCountLines(block, newlines & ScanBelow(index), &lines, &lineStart);
+				ScanAdvance(p, block + index, lineStart, lines, line, column);
+				return block + index;
+			}
+			stop &= stop - 1;
+		}
+		ScanCountLines(block, newlines, &lines, &lineStart);
+		block += 32;
+		valid = ~0u;
+	}
+}
+#endif
+
+typedef struct ScanFunctions {
+	ScanImplementation implementation;
+	const char *(*whitespace)(const char *p, int *line, int *column);
+	const char *(*lineEnd)(const char *p, int *column);
+	const char *(*blockCommentEnd)(const char *p, int *line, int *column);
+} ScanFunctions;
+
+static const ScanFunctions scanScalar = { SCAN_SCALAR, ScanWhitespaceScalar, ScanLineEndScalar, ScanBlockCommentEndScalar };
+#ifdef SCAN_X86
+static const ScanFunctions scanSSE2 = { SCAN_SSE2, ScanWhitespaceSSE2, ScanLineEndSSE2, ScanBlockCommentEndSSE2 };
+static const ScanFunctions scanAVX2 = { SCAN_AVX2, ScanWhitespaceAVX2, ScanLineEndAVX2, ScanBlockCommentEndAVX2 };
+#endif
+static const ScanFunctions *scan = NULL;
+
+static const ScanFunctions *ScanResolve(ScanImplementation implementation) {
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	bool sse2 = __builtin_cpu_supports("sse2");
+	bool avx2 = __builtin_cpu_supports("avx2");
+	if (implementation == SCAN_AUTO) implementation = avx2 ? SCAN_AVX2 : sse2 ? SCAN_SSE2 : SCAN_SCALAR;
+	if (implementation == SCAN_AVX2 && avx2) return &scanAVX2;
+	if (implementation >= SCAN_SSE2 && sse2) return &scanSSE2;
+#else
+	(void) implementation;
+#endif
+	return &scanScalar;
+}
+static inline const ScanFunctions *ScanGet(void) {
+	// Files are lexed on several threads; racing first calls all store the
+	// same pointer
+	const ScanFunctions *functions = __atomic_load_n(&scan, __ATOMIC_RELAXED);
+	if (functions == NULL) {
+		functions = ScanResolve(SCAN_AUTO);
+		__atomic_store_n(&scan, functions, __ATOMIC_RELAXED);
+	}
+	return functions;
+}
+
+const char *ScanWhitespace(const char *p, int *line, int *column) {
+	return ScanGet()->whitespace(p, line, column);
+}
+const char *ScanLineEnd(const char *p, int *column) {
+	return ScanGet()->lineEnd(p, column);
+}
+const char *ScanBlockCommentEnd(const char *p, int *line, int *column) {
+	return ScanGet()->blockCommentEnd(p, line, column);
+}
+ScanImplementation ScanSetImplementation(ScanImplementation implementation) {
+	__atomic_store_n(&scan, ScanResolve(implementation), __ATOMIC_RELAXED);
+	return scan->implementation;
+}
+const char *ScanImplementationName(ScanImplementation implementation) {
+	switch (implementation) {
+		case SCAN_SCALAR: return "scalar";
+		case SCAN_SSE2: return "sse2";
+		case SCAN_AVX2: return "avx2";
+		default: return "auto";
+	}
+}
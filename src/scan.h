@@ -0,0 +1,35 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdbool.h>
+
+// Byte scanners used by the lexer to skip whitespace and comments. Each has a
+// scalar version and, on x86, SSE2 and AVX2 versions that look at 16 or 32
+// bytes per step; the widest one the CPU supports is picked at first use.
+// All of them stop at '\0' and only read aligned blocks that contain at least
+// one byte of the string, so they never touch memory past its page.
+
+typedef enum ScanImplementation {
+	SCAN_AUTO = 0,
+	SCAN_SCALAR,
+	SCAN_SSE2,
+	SCAN_AVX2
+} ScanImplementation;
+
+// Whitespace as the C locale's isspace sees it
+static inline bool ScanIsSpace(char c) {
+	return c == ' ' || (unsigned char) (c - '\t') <= '\r' - '\t';
+}
+
+// Skips whitespace, returns the first other byte ('\0' included)
+const char *ScanWhitespace(const char *p, int *line, int *column);
+// Returns the '\n' or '\0' that ends a line comment
+const char *ScanLineEnd(const char *p, int *column);
+// Returns the "*/" closing a block comment, or the '\0' if it's unclosed
+const char *ScanBlockCommentEnd(const char *p, int *line, int *column);
+
+// Force an implementation (for benchmarks), returns the one now in use
+ScanImplementation ScanSetImplementation(ScanImplementation implementation);
+const char *ScanImplementationName(ScanImplementation implementation);
+
+#endif
@@ -0,0 +1,94 @@
+#include "source.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Maps the file followed by at least one zeroed page. The tail of the last
+// file page is zero-filled by the kernel, and the anonymous page behind it
+// covers files whose size is an exact multiple of the page size.
+static bool SourceMap(SourceFile *file, int fd, size_t size) {
+	size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	size_t fileSpan = (size + page - 1) & ~(page - 1);
+	size_t total = fileSpan + page;
+
+	char *reserve = (char *) mmap(NULL, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (reserve == MAP_FAILED) return false;
+
+	char *data = (char *) mmap(reserve, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+	if (data == MAP_FAILED) {
+		munmap(reserve, total);
+		return false;
+	}
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	file->data = data;
+	file->length = size;
+	file->mappedLength = total;
+	return true;
+}
+static bool SourceRead(SourceFile *file, int fd) {
+	size_t capacity = 64 * 1024;
+	size_t length = 0;
+	char *data = (char *) malloc(capacity);
+	if (data == NULL) return false;
+
+	while (1) {
+		if (capacity - length < 2) {
+			capacity *= 2;
+			char *grown = (char *) realloc(data, capacity);
+			if (grown == NULL) {
+				free(data);
+				return false;
+			}
+			data = grown;
+		}
+		ssize_t count = read(fd, data + length, capacity - length - 1);
+		if (count == 0) break;
+		if (count < 0) {
+			if (errno == EINTR) continue;
+			free(data);
+			return false;
+		}
+		length += (size_t) count;
+	}
+	data[length] = '\0';
+
+	file->data = data;
+	file->length = length;
+	file->mappedLength = 0;
+	return true;
+}
+
+bool SourceOpen(SourceFile *file, const char *path) {
+	*file = (SourceFile) { path, NULL, 0, 0 };
+
+	bool standardInput = strcmp(path, "-") == 0;
+	int fd = standardInput ? STDIN_FILENO : open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	struct stat info;
+	bool loaded = false;
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+		loaded = SourceMap(file, fd, (size_t) info.st_size);
+	}
+	// Pipes, empty files and failed mappings are streamed instead
+	if (!loaded) loaded = SourceRead(file, fd);
+	if (!loaded) fprintf(stderr, "Could not read %s: %s\n", path, strerror(errno));
+
+	if (!standardInput) close(fd);
+	return loaded;
+}
+void SourceClose(SourceFile *file) {
+	if (file->data == NULL) return;
+
+	if (file->mappedLength) munmap((void *) file->data, file->mappedLength);
+	else free((void *) file->data);
+	file->data = NULL;
+	file->length = 0;
+	file->mappedLength = 0;
+}
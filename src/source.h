@@ -0,0 +1,25 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct SourceFile SourceFile;
+
+// A source file loaded for lexing. Regular files are memory-mapped read-only,
+// anything else (pipes, terminals, "-" for stdin) is read into the heap.
+// Either way data[length] is '\0' and stays readable, so the lexer can keep
+// using '\0' as its end-of-input sentinel.
+struct SourceFile {
+	const char *path;
+	const char *data;
+	size_t length;
+	size_t mappedLength;	// Size of the mapping, 0 when data is on the heap
+};
+
+bool SourceOpen(SourceFile *file, const char *path);
+void SourceClose(SourceFile *file);
+
+#endif
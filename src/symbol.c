@@ -0,0 +1,124 @@
+#include "symbol.h"
+
+static unsigned int SymbolHash(const char *name) {
+	uintptr_t key = (uintptr_t) name;
+	key ^= key >> 17;
+	key *= 0xed5ad4bbu;
+	key ^= key >> 11;
+	return (unsigned int) key;
+}
+static void *SymbolGrow(void *array, int *capacity, size_t size) {
+	int grown = *capacity ? *capacity * 2 : 64;
+	void *resized = realloc(array, grown * size);
+	if (resized == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	*capacity = grown;
+	return resized;
+}
+static void SymbolRehash(SymbolTable *t) {
+	int capacity = t->slotCapacity ? t->slotCapacity * 2 : 64;
+	Symbol *slots = (Symbol *) calloc(capacity, sizeof(Symbol));
+	if (slots == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	int j;
+	for (j = 0; j < t->slotCapacity; j++) {
+		if (t->slots[j].name == NULL) continue;
+		unsigned int i = SymbolHash(t->slots[j].name) & (capacity - 1);
+		while (slots[i].name) i = (i + 1) & (capacity - 1);
+		slots[i] = t->slots[j];
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->slotCapacity = capacity;
+}
+// Slot holding name, or the empty slot where it would go
+static unsigned int SymbolSlot(SymbolTable *t, const char *name) {
+	unsigned int mask = t->slotCapacity - 1;
+	unsigned int i = SymbolHash(name) & mask;
+	t->probes++;
+	while (t->slots[i].name && t->slots[i].name != name) {
+		i = (i + 1) & mask;
+		t->probes++;
+	}
+	return i;
+}
+// Empties slot i, moving the rest of its probe run back so no lookup
+// stops early at the gap
+static void SymbolRemove(SymbolTable *t, unsigned int i) {
+	unsigned int mask = t->slotCapacity - 1;
+	unsigned int j = i;
+	t->slots[i].name = NULL;
+	t->count--;
+	while (1) {
+		j = (j + 1) & mask;
+		if (t->slots[j].name == NULL) return;
+		unsigned int home = SymbolHash(t->slots[j].name) & mask;
+		// The entry can fill the gap unless its home lies in (i, j]
+		if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+			t->slots[i] = t->slots[j];
+			t->slots[j].name = NULL;
+			i = j;
+		}
+	}
+}
+
+void SymbolTableInit(SymbolTable *t) {
+	*t = (SymbolTable) { 0 };
+	SymbolRehash(t);
+}
+void SymbolScopePush(SymbolTable *t) {
+	if (t->depth == t->scopeCapacity) t->scopes = (int *) SymbolGrow(t->scopes, &t->scopeCapacity, sizeof(int));
+	t->scopes[t->depth++] = t->undoCount;
+}
+// Closes the innermost scope, making the declarations it hid visible again
+void SymbolScopePop(SymbolTable *t) {
+	if (t->depth == 0) return;
+	int start = t->scopes[--t->depth];
+	while (t->undoCount > start) {
+		Symbol previous = t->undo[--t->undoCount];
+		unsigned int i = SymbolSlot(t, previous.name);
+		if (previous.depth < 0) SymbolRemove(t, i);
+		else t->slots[i] = previous;
+	}
+}
+// Declares name in the innermost scope; false when it already was, the
+// new declaration replaces the old one
+bool SymbolDeclare(SymbolTable *t, const char *name, ASTNode *declaration, int index) {
+	if ((t->count + 1) * 2 > t->slotCapacity) SymbolRehash(t);
+	unsigned int i = SymbolSlot(t, name);
+	Symbol *slot = &t->slots[i];
+	Symbol symbol = { name, declaration, index, t->depth };
+	if (slot->name && slot->depth == t->depth) {
+		*slot = symbol;
+		return false;
+	}
+
+	if (t->undoCount == t->undoCapacity) t->undo = (Symbol *) SymbolGrow(t->undo, &t->undoCapacity, sizeof(Symbol));
+	if (slot->name) t->undo[t->undoCount++] = *slot;
+	else {
+		t->undo[t->undoCount++] = (Symbol) { name, NULL, 0, -1 };
+		t->count++;
+	}
+	*slot = symbol;
+	return true;
+}
+// The visible declaration of name, NULL when there is none
+Symbol *SymbolFind(SymbolTable *t, const char *name) {
+	t->lookups++;
+	Symbol *slot = &t->slots[SymbolSlot(t, name)];
+	return slot->name ? slot : NULL;
+}
+ASTNode *SymbolLookup(SymbolTable *t, const char *name) {
+	Symbol *symbol = SymbolFind(t, name);
+	return symbol ? symbol->declaration : NULL;
+}
+void SymbolTableFree(SymbolTable *t) {
+	free(t->slots);
+	free(t->undo);
+	free(t->scopes);
+	*t = (SymbolTable) { 0 };
+}
@@ -0,0 +1,47 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct ASTNode ASTNode;
+typedef struct Symbol Symbol;
+typedef struct SymbolTable SymbolTable;
+
+// The innermost declaration of a name
+struct Symbol {
+	const char *name;	// Interned, NULL for an empty slot
+	ASTNode *declaration;
+	int index;		// The caller's own data, e.g. an index into its bindings
+	int depth;		// Scope the declaration belongs to, 0 is file scope
+};
+// Names in nested scopes, keyed by the interned name's address. One open
+// addressing table holds the visible declaration of every name; declaring
+// logs what it replaced, and closing a scope replays its part of the log
+// backwards, so opening and closing scopes never copies a table.
+struct SymbolTable {
+	Symbol *slots;
+	int slotCapacity;
+	int count;
+	Symbol *undo;		// Replaced entries, name set and declaration NULL when there was none
+	int undoCount;
+	int undoCapacity;
+	int *scopes;		// undoCount when each open scope began
+	int depth;
+	int scopeCapacity;
+	// Statistics
+	long lookups;
+	long probes;
+};
+
+void SymbolTableInit(SymbolTable *t);
+void SymbolScopePush(SymbolTable *t);
+void SymbolScopePop(SymbolTable *t);
+bool SymbolDeclare(SymbolTable *t, const char *name, ASTNode *declaration, int index);
+Symbol *SymbolFind(SymbolTable *t, const char *name);
+ASTNode *SymbolLookup(SymbolTable *t, const char *name);
+void SymbolTableFree(SymbolTable *t);
+
+#endif
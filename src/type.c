@@ -0,0 +1,182 @@
+#include "type.h"
+
+static const char *const typeBuiltinNames[TYPE_BUILTIN_COUNT] = {
+	"void", "bool", "char", "int", "unsigned int", "long", "unsigned long", "long long",
+	"unsigned long long", "float", "double", "long double", "string"
+};
+// Words a primitive type is spelled with
+static const char *const typePrimitiveWords[] = {
+	"void", "bool", "string", "lambda", "char", "short", "int", "long", "float", "double",
+	"signed", "unsigned", "const", "complex", "imaginary", NULL
+};
+
+static unsigned int TypeHash(const char *name) {
+	uintptr_t key = (uintptr_t) name;
+	key ^= key >> 17;
+	key *= 0xed5ad4bbu;
+	key ^= key >> 11;
+	return (unsigned int) key;
+}
+// Rank for the usual arithmetic conversions: everything narrower than int
+// promotes, then each type converts to any with a higher rank
+static int TypeRank(const char *name) {
+	static const char *const ranks[] = { "int", "unsigned int", "long", "unsigned long", "long long", "unsigned long long", "float", "double", "long double" };
+	int i;
+	if (strcmp(name, "char") == 0 || strcmp(name, "short") == 0 || strcmp(name, "bool") == 0 || strcmp(name, "signed") == 0) return 1;
+	if (strcmp(name, "unsigned") == 0) return 2;
+	for (i = 0; i < (int) (sizeof(ranks) / sizeof(ranks[0])); i++) {
+		if (strcmp(name, ranks[i]) == 0) return i + 1;
+	}
+	return 0;
+}
+static TypeKind TypeKindOf(const char *name) {
+	if (strncmp(name, "struct ", 7) == 0 || strncmp(name, "union ", 6) == 0 || strncmp(name, "enum ", 5) == 0) return TYPE_STRUCT;
+	while (*name) {
+		const char *end = strchr(name, ' ');
+		size_t length = end ? (size_t) (end - name) : strlen(name);
+		int i;
+		for (i = 0; typePrimitiveWords[i]; i++) {
+			if (strlen(typePrimitiveWords[i]) == length && memcmp(typePrimitiveWords[i], name, length) == 0) break;
+		}
+		if (typePrimitiveWords[i] == NULL) return TYPE_NAME;
+		name += length;
+		while (*name == ' ') name++;
+	}
+	return TYPE_PRIMITIVE;
+}
+static void TypeGrow(TypeTable *t) {
+	int capacity = t->slotCapacity ? t->slotCapacity * 2 : 64;
+	Type **slots = (Type **) calloc(capacity, sizeof(Type *));
+	if (slots == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	int j;
+	for (j = 0; j < t->slotCapacity; j++) {
+		if (t->slots[j] == NULL) continue;
+		unsigned int i = TypeHash(t->slots[j]->name) & (capacity - 1);
+		while (slots[i]) i = (i + 1) & (capacity - 1);
+		slots[i] = t->slots[j];
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->slotCapacity = capacity;
+}
+static Type **TypeSlot(TypeTable *t, const char *name) {
+	unsigned int mask = t->slotCapacity - 1;
+	unsigned int i = TypeHash(name) & mask;
+	while (t->slots[i] && t->slots[i]->name != name) i = (i + 1) & mask;
+	return &t->slots[i];
+}
+static Type *TypeInsert(TypeTable *t, TypeKind kind, const char *name, const Type *base) {
+	if ((t->count + 1) * 2 > t->slotCapacity) TypeGrow(t);
+	Type *type = (Type *) ArenaCalloc(t->arena, 1, sizeof(Type));
+	type->kind = kind;
+	type->name = name;
+	type->base = base;
+	type->rank = kind == TYPE_PRIMITIVE ? TypeRank(name) : 0;
+	*TypeSlot(t, name) = type;
+	t->count++;
+	return type;
+}
+
+bool TypeTableInit(TypeTable *t, Arena *arena, InternTable *strings) {
+	int i;
+	*t = (TypeTable) { 0 };
+	t->arena = arena;
+	t->strings = strings;
+	TypeGrow(t);
+	for (i = 0; i < TYPE_BUILTIN_COUNT; i++) {
+		t->builtins[i] = TypeFromText(t, typeBuiltinNames[i]);
+		if (t->builtins[i] == NULL) return false;
+	}
+	return true;
+}
+// The canonical type spelled name, an interned string in the normal form
+// ASTParseType produces; created on first use
+const Type *TypeNamed(TypeTable *t, const char *name) {
+	if (name == NULL) return NULL;
+	t->lookups++;
+	Type **slot = TypeSlot(t, name);
+	if (*slot) return *slot;
+
+	size_t length = strlen(name);
+	if (length && name[length - 1] == '*') {
+		// The pointer to whatever precedes the last star
+		length--;
+		while (length && name[length - 1] == ' ') length--;
+		return TypePointer(t, TypeNamed(t, InternString(t->strings, name, (int) length)));
+	}
+	const Type *base = strcmp(name, "string") == 0 ? TypeFromText(t, "char") : NULL;
+	return TypeInsert(t, TypeKindOf(name), name, base);
+}
+const Type *TypeFromText(TypeTable *t, const char *text) {
+	return TypeNamed(t, InternString(t->strings, text, (int) strlen(text)));
+}
+const Type *TypePointer(TypeTable *t, const Type *base) {
+	if (base == NULL) return NULL;
+	if (base->pointer) return base->pointer;
+
+	// char * * is spelled char **, as the parser writes it
+	size_t length = strlen(base->name);
+	char *text = (char *) malloc(length + 3);
+	if (text == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memcpy(text, base->name, length);
+	if (base->kind != TYPE_POINTER) text[length++] = ' ';
+	text[length++] = '*';
+	const char *name = InternString(t->strings, text, (int) length);
+	free(text);
+
+	Type **slot = TypeSlot(t, name);
+	Type *pointer = *slot ? *slot : TypeInsert(t, TYPE_POINTER, name, base);
+	((Type *) base)->pointer = pointer;
+	return pointer;
+}
+// A qualified name such as "const T" spelled again with argument for T
+static const Type *TypeSubstituteWords(TypeTable *t, const Type *type, const Type *parameter, const Type *argument) {
+	const char *name = type->name;
+	size_t parameterLength = strlen(parameter->name), argumentLength = strlen(argument->name);
+	size_t length = 0;
+	bool changed = false;
+	char *text = (char *) malloc((strlen(name) / (parameterLength + 1) + 1) * argumentLength + strlen(name) + 1);
+	if (text == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	while (*name) {
+		const char *end = strchr(name, ' ');
+		size_t word = end ? (size_t) (end - name) : strlen(name);
+		if (length) text[length++] = ' ';
+		if (word == parameterLength && memcmp(name, parameter->name, word) == 0) {
+			memcpy(text + length, argument->name, argumentLength);
+			length += argumentLength;
+			changed = true;
+		}
+		else {
+			memcpy(text + length, name, word);
+			length += word;
+		}
+		name = end ? end + 1 : name + word;
+	}
+	const Type *substituted = changed ? TypeNamed(t, InternString(t->strings, text, (int) length)) : type;
+	free(text);
+	return substituted;
+}
+// type with parameter replaced by argument, also behind pointers and
+// qualifiers
+const Type *TypeSubstitute(TypeTable *t, const Type *type, const Type *parameter, const Type *argument) {
+	if (type == NULL || parameter == NULL) return type;
+	if (type == parameter) return argument;
+	if (type->kind == TYPE_NAME) return strchr(type->name, ' ') ? TypeSubstituteWords(t, type, parameter, argument) : type;
+	if (type->kind != TYPE_POINTER) return type;
+	const Type *base = TypeSubstitute(t, type->base, parameter, argument);
+	return base == type->base ? type : TypePointer(t, base);
+}
+void TypeTableFree(TypeTable *t) {
+	free(t->slots);
+	t->slots = NULL;
+	t->slotCapacity = t->count = 0;
+}
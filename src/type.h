@@ -0,0 +1,68 @@
+#ifndef TYPE_H
+#define TYPE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "intern.h"
+
+typedef struct Type Type;
+typedef struct TypeTable TypeTable;
+
+typedef enum TypeKind {
+	TYPE_PRIMITIVE,		// void, bool, string, lambda and the arithmetic types
+	TYPE_STRUCT,		// struct, union or enum with its tag
+	TYPE_NAME,		// Any other name: a typedef or a generic's type parameter
+	TYPE_POINTER
+} TypeKind;
+
+// Types literals and operators produce, created up front
+typedef enum TypeBuiltin {
+	TYPE_VOID,
+	TYPE_BOOL,
+	TYPE_CHAR,
+	TYPE_INT,
+	TYPE_UNSIGNED_INT,
+	TYPE_LONG,
+	TYPE_UNSIGNED_LONG,
+	TYPE_LONG_LONG,
+	TYPE_UNSIGNED_LONG_LONG,
+	TYPE_FLOAT,
+	TYPE_DOUBLE,
+	TYPE_LONG_DOUBLE,
+	TYPE_STRING,
+	TYPE_BUILTIN_COUNT
+} TypeBuiltin;
+
+// Every distinct type has exactly one entry, so two types are the same
+// exactly when their pointers are equal
+struct Type {
+	TypeKind kind;
+	const char *name;	// Interned spelling, e.g. "unsigned long *"
+	const Type *base;	// What a pointer or string points to
+	int rank;		// In the usual arithmetic conversions, 0 when not arithmetic
+	const Type *pointer;	// The pointer to this type, once it was asked for
+};
+// Canonical types of one compilation unit, keyed by interned spelling.
+// Pointers are also cached on their base, so building one is a field read.
+struct TypeTable {
+	Type **slots;		// Open addressing by the spelling's address
+	int slotCapacity;
+	int count;
+	Arena *arena;		// Storage for the entries, owned by the caller
+	InternTable *strings;
+	const Type *builtins[TYPE_BUILTIN_COUNT];
+	long lookups;
+};
+
+bool TypeTableInit(TypeTable *t, Arena *arena, InternTable *strings);
+const Type *TypeNamed(TypeTable *t, const char *name);
+const Type *TypeFromText(TypeTable *t, const char *text);
+const Type *TypePointer(TypeTable *t, const Type *base);
+const Type *TypeSubstitute(TypeTable *t, const Type *type, const Type *parameter, const Type *argument);
+void TypeTableFree(TypeTable *t);
+
+#endif